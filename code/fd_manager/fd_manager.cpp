@@ -140,9 +140,13 @@ FileDescriptor::_ptr FileDescriptorManagerImpl::get(int fd, bool auto_create)
     }
     lock.unlock();
 
-    assert(m_data.size() > static_cast<size_t>(fd));
-
     WriteScopedLock lock2(&m_lock);
+    if(m_data.size() <= static_cast<size_t>(fd)) {
+        m_data.resize(fd * 1.5 + 1);
+    }
+    else if(m_data[fd]) {
+        return m_data[fd];  //释放读锁之后已经被其他线程创建
+    }
 
     FileDescriptor::_ptr dfp(new FileDescriptor(fd));
     m_data[fd] = dfp;
@@ -0,0 +1,164 @@
+#include "channel.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "util.h"
+
+#include <assert.h>
+
+namespace hxk
+{
+
+ChannelBase::ChannelBase():m_closed(false)
+{
+
+}
+
+void ChannelBase::close()
+{
+    WaiterList send_waiters, recv_waiters;
+    {
+        ScopedSpinLock lock(&m_lock);
+        if(m_closed) {
+            return;
+        }
+        m_closed = true;
+        send_waiters.swap(m_send_waiters);
+        recv_waiters.swap(m_recv_waiters);
+    }
+    for(auto& parker : send_waiters) {
+        parker->unpark();
+    }
+    for(auto& parker : recv_waiters) {
+        parker->unpark();
+    }
+}
+
+bool ChannelBase::isClosed()
+{
+    ScopedSpinLock lock(&m_lock);
+    return m_closed;
+}
+
+void ChannelBase::addWaiter(const FiberParker::_ptr& parker, bool send)
+{
+    ScopedSpinLock lock(&m_lock);
+    (send ? m_send_waiters : m_recv_waiters).push_back(parker);
+}
+
+void ChannelBase::removeWaiter(const FiberParker::_ptr& parker, bool send)
+{
+    ScopedSpinLock lock(&m_lock);
+    (send ? m_send_waiters : m_recv_waiters).remove(parker);
+}
+
+void ChannelBase::wake(bool send, size_t count)
+{
+    while(count > 0) {
+        FiberParker::_ptr parker;
+        {
+            ScopedSpinLock lock(&m_lock);
+            WaiterList& waiters = send ? m_send_waiters : m_recv_waiters;
+            if(waiters.empty() || !isReadyLocked(send)) {
+                return;
+            }
+            parker = std::move(waiters.front());
+            waiters.pop_front();
+        }
+        //等待者同时在多个通道上select时，可能已经被其他通道唤醒
+        if(parker->unpark()) {
+            --count;
+        }
+    }
+}
+
+
+ChannelSelector::ChannelSelector():m_start(0)
+{
+
+}
+
+int ChannelSelector::select(uint64_t timeout_ms)
+{
+    assert(!m_cases.empty());
+    uint64_t deadline = timeout_ms == WAIT_FOREVER ? WAIT_FOREVER : GetCurrentMS() + timeout_ms;
+    while(true) {
+        int index = tryCases();
+        if(index >= 0) {
+            return index;
+        }
+        uint64_t now = GetCurrentMS();
+        if(now >= deadline) {
+            return -1;
+        }
+
+        auto parker = std::make_shared<FiberParker>();
+        registerWaiter(parker);
+        //登记之后再尝试一次，避免在两次检查之间到达的唤醒丢失
+        index = tryCases();
+        if(index >= 0) {
+            bool woken = !parker->cancel();
+            if(woken) {
+                parker->park();     //唤醒已经发出，协程已被重新调度
+            }
+            unregisterWaiter(parker, woken);
+            return index;
+        }
+
+        Timer::_ptr timer;
+        if(deadline != WAIT_FOREVER) {
+            TimerManager* timer_manager = dynamic_cast<TimerManager*>(Scheduler::getThis());
+            assert(timer_manager && "select超时需要在IOManager中调用");
+            timer = timer_manager->addTimer(deadline - now, [parker](){
+                parker->unpark();
+            });
+        }
+        parker->park();
+        if(timer) {
+            timer->cancel();
+        }
+        unregisterWaiter(parker, true);
+    }
+}
+
+void ChannelSelector::clear()
+{
+    m_cases.clear();
+    m_start = 0;
+}
+
+int ChannelSelector::tryCases()
+{
+    //每次从不同的分支开始尝试，避免靠前的通道一直就绪时后面的通道饿死
+    size_t size = m_cases.size();
+    size_t start = m_start;
+    m_start = (m_start + 1) % size;
+    for(size_t i = 0; i < size; i++) {
+        size_t index = (start + i) % size;
+        if(m_cases[index].m_try()) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+void ChannelSelector::registerWaiter(const FiberParker::_ptr& parker)
+{
+    for(auto& c : m_cases) {
+        c.m_channel->addWaiter(parker, c.m_send);
+    }
+}
+
+void ChannelSelector::unregisterWaiter(const FiberParker::_ptr& parker, bool woken)
+{
+    for(auto& c : m_cases) {
+        c.m_channel->removeWaiter(parker, c.m_send);
+    }
+    if(woken) {
+        //唤醒可能来自一个最终没有被选中的通道，把它传递给该通道的其他等待者
+        for(auto& c : m_cases) {
+            c.m_channel->wake(c.m_send);
+        }
+    }
+}
+
+}
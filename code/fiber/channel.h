@@ -0,0 +1,365 @@
+#pragma once
+
+#include <list>
+#include <deque>
+#include <vector>
+#include <functional>
+
+#include "noncopyable.h"
+#include "lock.h"
+#include "fiber_lock.h"
+
+namespace hxk
+{
+class TimerManager;
+
+/**
+ * @Author: hxk
+ * @brief: 通道的公共部分：等待队列和关闭状态，供ChannelSelector以统一的方式等待不同类型的通道
+ *      等待者被唤醒只代表通道“可能就绪”，醒来后需要重新尝试，被其他执行流抢先时重新等待
+ */
+class ChannelBase : public noncopyable
+{
+public:
+    typedef std::list<FiberParker::_ptr> WaiterList;
+
+    ChannelBase();
+    virtual ~ChannelBase() = default;
+
+    /**
+     * @Author: hxk
+     * @brief: 关闭通道，之后send失败，recv取完剩余数据后失败，唤醒所有等待者
+     * @return {*}
+     */
+    void close();
+
+    bool isClosed();
+
+    void addWaiter(const FiberParker::_ptr& parker, bool send);     //登记等待者
+    void removeWaiter(const FiberParker::_ptr& parker, bool send);  //取消登记
+
+    /**
+     * @Author: hxk
+     * @brief: 通道就绪时唤醒等待者，跳过已经被其他通道唤醒的等待者（select）
+     * @param {bool} send   唤醒发送方还是接收方
+     * @param {size_t} count 最多唤醒的数量
+     * @return {*}
+     */
+    void wake(bool send, size_t count = 1);
+
+protected:
+    virtual bool isReadyLocked(bool send) = 0;  //持有m_lock时调用，send/recv是否可以立即完成
+
+protected:
+    SpinLock m_lock;
+    bool m_closed;
+    WaiterList m_send_waiters;
+    WaiterList m_recv_waiters;
+};
+
+/**
+ * @Author: hxk
+ * @brief: 多生产者多消费者通道，通道满/空时挂起当前协程而不是阻塞线程
+ *      capacity为0时为无界通道，send永远不会挂起
+ *      在调度器之外的线程中使用时退化为阻塞线程
+ */
+template<class T>
+class Channel : public ChannelBase
+{
+public:
+    typedef std::shared_ptr<Channel> _ptr;
+
+    explicit Channel(size_t capacity = 0):m_capacity(capacity)
+    {
+
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 发送数据，通道满时挂起
+     * @return {bool} 通道已经关闭时返回false
+     */
+    template<class U>
+    bool send(U&& value)
+    {
+        //只有需要等待时才创建parker：先在锁内尝试，失败后在锁外创建，再加锁检查一次
+        FiberParker::_ptr parker;
+        while(true) {
+            {
+                ScopedSpinLock lock(&m_lock);
+                if(m_closed) {
+                    return false;
+                }
+                if(!isFullLocked()) {
+                    pushLocked(std::forward<U>(value), lock);
+                    return true;
+                }
+                if(parker) {
+                    m_send_waiters.push_back(parker);
+                }
+            }
+            if(!parker) {
+                parker = std::make_shared<FiberParker>();
+                continue;
+            }
+            parker->park();
+            parker.reset();
+        }
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 尝试发送，不会挂起
+     * @return {bool} 通道满或已经关闭时返回false
+     */
+    template<class U>
+    bool trySend(U&& value)
+    {
+        ScopedSpinLock lock(&m_lock);
+        if(m_closed || isFullLocked()) {
+            return false;
+        }
+        pushLocked(std::forward<U>(value), lock);
+        return true;
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 接收数据，通道空时挂起
+     * @return {bool} 通道已经关闭并且没有剩余数据时返回false
+     */
+    bool recv(T& value)
+    {
+        FiberParker::_ptr parker;   //同send，只在需要等待时创建
+        while(true) {
+            {
+                ScopedSpinLock lock(&m_lock);
+                if(!m_queue.empty()) {
+                    popLocked(&value, 1, lock);
+                    return true;
+                }
+                if(m_closed) {
+                    return false;
+                }
+                if(parker) {
+                    m_recv_waiters.push_back(parker);
+                }
+            }
+            if(!parker) {
+                parker = std::make_shared<FiberParker>();
+                continue;
+            }
+            parker->park();
+            parker.reset();
+        }
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 尝试接收，不会挂起
+     * @return {bool} 通道空时返回false
+     */
+    bool tryRecv(T& value)
+    {
+        ScopedSpinLock lock(&m_lock);
+        if(m_queue.empty()) {
+            return false;
+        }
+        popLocked(&value, 1, lock);
+        return true;
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 批量接收，至少有一个数据时返回，一次加锁取走最多max_count个数据，
+     *      并一次性唤醒对应数量的发送方
+     * @param {vector<T>&} values   接收到的数据追加到末尾
+     * @param {size_t} max_count    最多接收的数量
+     * @return {size_t} 接收到的数量，通道已经关闭并且没有剩余数据时返回0
+     */
+    size_t recvMany(std::vector<T>& values, size_t max_count)
+    {
+        FiberParker::_ptr parker;   //同send，只在需要等待时创建
+        while(true) {
+            {
+                ScopedSpinLock lock(&m_lock);
+                if(!m_queue.empty()) {
+                    size_t count = std::min(max_count, m_queue.size());
+                    size_t offset = values.size();
+                    values.resize(offset + count);
+                    popLocked(&values[offset], count, lock);
+                    return count;
+                }
+                if(m_closed || max_count == 0) {
+                    return 0;
+                }
+                if(parker) {
+                    m_recv_waiters.push_back(parker);
+                }
+            }
+            if(!parker) {
+                parker = std::make_shared<FiberParker>();
+                continue;
+            }
+            parker->park();
+            parker.reset();
+        }
+    }
+
+    size_t size()
+    {
+        ScopedSpinLock lock(&m_lock);
+        return m_queue.size();
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+protected:
+    bool isReadyLocked(bool send) override
+    {
+        return m_closed || (send ? !isFullLocked() : !m_queue.empty());
+    }
+
+private:
+    bool isFullLocked() const
+    {
+        return m_capacity != 0 && m_queue.size() >= m_capacity;
+    }
+
+    template<class U>
+    void pushLocked(U&& value, ScopedSpinLock& lock)
+    {
+        m_queue.push_back(std::forward<U>(value));
+        bool wake_receiver = !m_recv_waiters.empty();
+        //被唤醒的发送方可能被抢先，仍有空位时把唤醒传递下去
+        bool wake_sender = !m_send_waiters.empty() && !isFullLocked();
+        lock.unlock();
+        if(wake_receiver) {
+            wake(false);
+        }
+        if(wake_sender) {
+            wake(true);
+        }
+    }
+
+    void popLocked(T* values, size_t count, ScopedSpinLock& lock)
+    {
+        for(size_t i = 0; i < count; i++) {
+            values[i] = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        bool wake_sender = !m_send_waiters.empty();
+        //被唤醒的接收方可能被抢先，仍有数据时把唤醒传递下去
+        bool wake_receiver = !m_recv_waiters.empty() && !m_queue.empty();
+        lock.unlock();
+        if(wake_sender) {
+            wake(true, count);
+        }
+        if(wake_receiver) {
+            wake(false);
+        }
+    }
+
+private:
+    size_t m_capacity;
+    std::deque<T> m_queue;
+};
+
+/**
+ * @Author: hxk
+ * @brief: 同时等待多个通道，第一个可以完成的操作被执行
+ *      ChannelSelector selector;
+ *      selector.onRecv(ch1, value1).onRecv(ch2, value2).onSend(ch3, data);
+ *      int index = selector.select(100);
+ */
+class ChannelSelector : public noncopyable
+{
+public:
+    static const uint64_t WAIT_FOREVER = ~0ull;
+
+    ChannelSelector();
+
+    /**
+     * @Author: hxk
+     * @brief: 添加接收分支
+     * @param {T&} value    接收到的数据
+     * @param {bool*} ok    可选，分支完成时写入是否成功接收（通道关闭时为false）
+     * @return {*}
+     */
+    template<class T>
+    ChannelSelector& onRecv(Channel<T>& channel, T& value, bool* ok = nullptr)
+    {
+        Channel<T>* ch = &channel;
+        T* out = &value;
+        m_cases.push_back({ch, false, [ch, out, ok]() {
+            bool success = ch->tryRecv(*out);
+            if(!success) {
+                //关闭之后不会再有新数据，但关闭前写入的数据仍需要取出
+                if(!ch->isClosed()) {
+                    return false;
+                }
+                success = ch->tryRecv(*out);
+            }
+            if(ok) {
+                *ok = success;
+            }
+            return true;
+        }});
+        return *this;
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 添加发送分支，value被拷贝保存
+     * @param {bool*} ok    可选，分支完成时写入是否成功发送（通道关闭时为false）
+     * @return {*}
+     */
+    template<class T>
+    ChannelSelector& onSend(Channel<T>& channel, const T& value, bool* ok = nullptr)
+    {
+        Channel<T>* ch = &channel;
+        m_cases.push_back({ch, true, [ch, value, ok]() {
+            bool success = ch->trySend(value);
+            if(!success && !ch->isClosed()) {
+                return false;
+            }
+            if(ok) {
+                *ok = success;
+            }
+            return true;
+        }});
+        return *this;
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 等待任意一个分支完成，多个分支同时就绪时轮流选择，避免总是选中第一个
+     * @param {uint64_t} timeout_ms  超时时间，0表示不等待，WAIT_FOREVER表示一直等待；
+     *      超时依赖当前线程所在调度器的TimerManager（IOManager）
+     * @return {int} 完成的分支下标（按添加顺序），超时返回-1
+     */
+    int select(uint64_t timeout_ms = WAIT_FOREVER);
+
+    void clear();
+
+private:
+    int tryCases();
+    void registerWaiter(const FiberParker::_ptr& parker);
+    void unregisterWaiter(const FiberParker::_ptr& parker, bool woken);
+
+private:
+    struct Case
+    {
+        ChannelBase* m_channel;
+        bool m_send;
+        std::function<bool()> m_try;    //尝试完成该分支，不会挂起
+    };
+
+    std::vector<Case> m_cases;
+    size_t m_start;     //下一次从哪个分支开始尝试
+};
+
+}
@@ -0,0 +1,235 @@
+#include "context.h"
+#include "exception.h"
+
+#include <stdint.h>
+
+#ifndef HXK_FIBER_USE_UCONTEXT
+
+extern "C"
+{
+/**
+ * @brief: 保存callee-saved寄存器到当前栈上，栈顶写入*from_sp，然后切换到to_sp并恢复寄存器
+ */
+void hxk_fiber_context_swap(void** from_sp, void* to_sp);
+
+/// @brief 新协程第一次被切换时的跳板，调用保存在寄存器中的入口函数
+void hxk_fiber_context_entry();
+}
+
+#if defined(__x86_64__)
+/*
+    栈上布局（从低地址到高地址）：
+        mxcsr(4B) x87控制字(4B) | r15 | r14 | r13 | r12 | rbx | rbp | 返回地址
+*/
+__asm__(
+    ".text\n"
+    ".globl hxk_fiber_context_swap\n"
+    ".type hxk_fiber_context_swap,@function\n"
+    ".p2align 4\n"
+    "hxk_fiber_context_swap:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size hxk_fiber_context_swap,.-hxk_fiber_context_swap\n"
+
+    ".globl hxk_fiber_context_entry\n"
+    ".type hxk_fiber_context_entry,@function\n"
+    ".p2align 4\n"
+    "hxk_fiber_context_entry:\n"
+    "    .cfi_startproc\n"
+    "    .cfi_undefined rip\n"
+    "    callq *%r12\n"
+    "    ud2\n"
+    "    .cfi_endproc\n"
+    ".size hxk_fiber_context_entry,.-hxk_fiber_context_entry\n"
+);
+
+namespace
+{
+const size_t CONTEXT_FRAME_SLOTS = 8;   //csr + 6个寄存器 + 返回地址
+const size_t CONTEXT_SLOT_R12 = 4;
+const size_t CONTEXT_SLOT_RET = 7;
+const uint64_t CONTEXT_DEFAULT_CSR = 0x037F00001F80ull; //x87控制字0x037F，mxcsr 0x1F80
+}
+
+#elif defined(__aarch64__)
+/*
+    栈上布局（从低地址到高地址）：
+        x19 - x28 | x29(fp) | x30(lr) | d8 - d15
+*/
+__asm__(
+    ".text\n"
+    ".globl hxk_fiber_context_swap\n"
+    ".type hxk_fiber_context_swap,%function\n"
+    ".p2align 4\n"
+    "hxk_fiber_context_swap:\n"
+    "    sub sp, sp, #160\n"
+    "    stp x19, x20, [sp, #0]\n"
+    "    stp x21, x22, [sp, #16]\n"
+    "    stp x23, x24, [sp, #32]\n"
+    "    stp x25, x26, [sp, #48]\n"
+    "    stp x27, x28, [sp, #64]\n"
+    "    stp x29, x30, [sp, #80]\n"
+    "    stp d8, d9, [sp, #96]\n"
+    "    stp d10, d11, [sp, #112]\n"
+    "    stp d12, d13, [sp, #128]\n"
+    "    stp d14, d15, [sp, #144]\n"
+    "    mov x9, sp\n"
+    "    str x9, [x0]\n"
+    "    mov sp, x1\n"
+    "    ldp x19, x20, [sp, #0]\n"
+    "    ldp x21, x22, [sp, #16]\n"
+    "    ldp x23, x24, [sp, #32]\n"
+    "    ldp x25, x26, [sp, #48]\n"
+    "    ldp x27, x28, [sp, #64]\n"
+    "    ldp x29, x30, [sp, #80]\n"
+    "    ldp d8, d9, [sp, #96]\n"
+    "    ldp d10, d11, [sp, #112]\n"
+    "    ldp d12, d13, [sp, #128]\n"
+    "    ldp d14, d15, [sp, #144]\n"
+    "    add sp, sp, #160\n"
+    "    ret\n"
+    ".size hxk_fiber_context_swap,.-hxk_fiber_context_swap\n"
+
+    ".globl hxk_fiber_context_entry\n"
+    ".type hxk_fiber_context_entry,%function\n"
+    ".p2align 4\n"
+    "hxk_fiber_context_entry:\n"
+    "    .cfi_startproc\n"
+    "    .cfi_undefined x30\n"
+    "    blr x19\n"
+    "    brk #0\n"
+    "    .cfi_endproc\n"
+    ".size hxk_fiber_context_entry,.-hxk_fiber_context_entry\n"
+);
+
+namespace
+{
+const size_t CONTEXT_FRAME_SLOTS = 20;  //x19-x30共12个 + d8-d15共8个
+const size_t CONTEXT_SLOT_X19 = 0;
+const size_t CONTEXT_SLOT_X29 = 10;
+const size_t CONTEXT_SLOT_X30 = 11;
+}
+#endif
+
+#endif  //HXK_FIBER_USE_UCONTEXT
+
+namespace hxk
+{
+
+#ifdef HXK_FIBER_USE_UCONTEXT
+
+void FiberContext::init()
+{
+    if(getcontext(&m_ucontext)) {
+        THROW_EXCEPTION_WITH_ERRNO;
+    }
+}
+
+void FiberContext::make(void* stack, size_t size, EntryFunc entry)
+{
+    if(getcontext(&m_ucontext)) {
+        THROW_EXCEPTION_WITH_ERRNO;
+    }
+    m_ucontext.uc_link = nullptr;   //nullptr代表入口函数返回后线程退出
+    m_ucontext.uc_stack.ss_sp = stack;
+    m_ucontext.uc_stack.ss_size = size;
+    makecontext(&m_ucontext, entry, 0);
+}
+
+void FiberContext::swapTo(FiberContext& to)
+{
+    if(swapcontext(&m_ucontext, &to.m_ucontext)) {
+        THROW_EXCEPTION_WITH_ERRNO;
+    }
+}
+
+void* FiberContext::getStackPointer() const
+{
+#if defined(__x86_64__)
+    return reinterpret_cast<void*>(m_ucontext.uc_mcontext.gregs[REG_RSP]);
+#elif defined(__aarch64__)
+    return reinterpret_cast<void*>(m_ucontext.uc_mcontext.sp);
+#else
+    return nullptr;
+#endif
+}
+
+const char* FiberContext::backend()
+{
+    return "ucontext";
+}
+
+#else
+
+void FiberContext::init()
+{
+    //master fiber运行在线程自己的栈上，第一次切换出去时才会保存栈顶
+    m_sp = nullptr;
+}
+
+void FiberContext::make(void* stack, size_t size, EntryFunc entry)
+{
+    //栈顶按16字节对齐，构造一个“刚被切换出去”的栈帧
+    uintptr_t top = (reinterpret_cast<uintptr_t>(stack) + size) & ~static_cast<uintptr_t>(15);
+#if defined(__x86_64__)
+    //从跳板函数开始执行时rsp需要16字节对齐，因此返回地址放在 top - 24 处
+    uint64_t* frame = reinterpret_cast<uint64_t*>(top - 16 - CONTEXT_FRAME_SLOTS * sizeof(uint64_t));
+    for(size_t i = 0; i < CONTEXT_FRAME_SLOTS; i++) {
+        frame[i] = 0;
+    }
+    frame[0] = CONTEXT_DEFAULT_CSR;
+    frame[CONTEXT_SLOT_R12] = reinterpret_cast<uint64_t>(entry);
+    frame[CONTEXT_SLOT_RET] = reinterpret_cast<uint64_t>(&hxk_fiber_context_entry);
+#elif defined(__aarch64__)
+    uint64_t* frame = reinterpret_cast<uint64_t*>(top - CONTEXT_FRAME_SLOTS * sizeof(uint64_t));
+    for(size_t i = 0; i < CONTEXT_FRAME_SLOTS; i++) {
+        frame[i] = 0;
+    }
+    frame[CONTEXT_SLOT_X19] = reinterpret_cast<uint64_t>(entry);
+    frame[CONTEXT_SLOT_X29] = 0;
+    frame[CONTEXT_SLOT_X30] = reinterpret_cast<uint64_t>(&hxk_fiber_context_entry);
+#endif
+    m_sp = frame;
+}
+
+void FiberContext::swapTo(FiberContext& to)
+{
+    hxk_fiber_context_swap(&m_sp, to.m_sp);
+}
+
+void* FiberContext::getStackPointer() const
+{
+    return m_sp;
+}
+
+const char* FiberContext::backend()
+{
+#if defined(__x86_64__)
+    return "asm-x86_64";
+#else
+    return "asm-aarch64";
+#endif
+}
+
+#endif
+
+}
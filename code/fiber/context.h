@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+    协程上下文切换的实现在编译期选择：
+        * x86-64 / aarch64 默认使用手写汇编，只保存callee-saved寄存器，不保存/恢复信号掩码，
+          切换时不会进入内核
+        * 定义 HXK_FIBER_USE_UCONTEXT（-DHXK_FIBER_USE_UCONTEXT）或在其他平台上，
+          回退到glibc的 getcontext/makecontext/swapcontext
+*/
+#if !defined(HXK_FIBER_USE_UCONTEXT) && !defined(__x86_64__) && !defined(__aarch64__)
+#define HXK_FIBER_USE_UCONTEXT
+#endif
+
+#ifdef HXK_FIBER_USE_UCONTEXT
+#include <ucontext.h>
+#endif
+
+namespace hxk
+{
+
+/**
+ * @Author: hxk
+ * @brief: 协程上下文，对具体的上下文切换实现的封装
+ */
+class FiberContext
+{
+public:
+    typedef void (*EntryFunc)();
+
+    /**
+     * @Author: hxk
+     * @brief: 以当前执行流初始化上下文，用于master fiber
+     * @return {*}
+     */
+    void init();
+
+    /**
+     * @Author: hxk
+     * @brief: 在指定的栈空间上构造上下文，第一次切换到该上下文时执行entry
+     * @param {void*} stack     栈空间起始地址（低地址）
+     * @param {size_t} size     栈空间大小
+     * @param {EntryFunc} entry 入口函数，不允许返回
+     * @return {*}
+     */
+    void make(void* stack, size_t size, EntryFunc entry);
+
+    /**
+     * @Author: hxk
+     * @brief: 将当前执行流保存到this，并切换到to
+     * @param {FiberContext&} to 要切换到的上下文
+     * @return {*}
+     */
+    void swapTo(FiberContext& to);
+
+    /**
+     * @Author: hxk
+     * @brief: 获取上下文被切换出去时的栈顶，在此之上的栈空间为活跃数据
+     * @return {void*} 当前实现无法获取时返回nullptr
+     */
+    void* getStackPointer() const;
+
+public:
+    static const char* backend();   //当前使用的上下文切换实现名称
+
+private:
+#ifdef HXK_FIBER_USE_UCONTEXT
+    ucontext_t m_ucontext{};    //glibc上下文
+#else
+    void* m_sp = nullptr;       //切换出去时保存的栈顶，寄存器保存在栈上
+#endif
+};
+
+}
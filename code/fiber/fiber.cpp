@@ -2,30 +2,215 @@
 #include "scheduler.h"
 #include "exception.h"
 #include "log.h"
+#include "cpu_topology.h"
+
+#include <sys/mman.h>
+#include <unordered_map>
+#include <vector>
+
 namespace hxk
 {
 static Logger::_ptr g_logger = GET_LOGGER("system");
 
+static ConfigVar<std::string>::_ptr g_fiber_stack_allocator =
+    Config::lookUp<std::string>("fiber.stack_allocator", "malloc", "fiber stack allocator, malloc or pooled");
+
+static ConfigVar<uint64_t>::_ptr g_fiber_stack_pool_size =
+    Config::lookUp<uint64_t>("fiber.stack_pool_size", 64, "max cached fiber stacks per thread");
+
+static ConfigVar<uint64_t>::_ptr g_fiber_stack_hot_size =
+    Config::lookUp<uint64_t>("fiber.stack_hot_size", 16 * 1024, "bytes kept resident at the top of a cached fiber stack");
+
+static ConfigVar<uint64_t>::_ptr g_fiber_shared_stack_size =
+    Config::lookUp<uint64_t>("fiber.shared_stack_size", 1024 * 1024, "per-thread shared fiber stack size");
+
+/// @brief 线程共享栈，共享栈模式的协程都运行在所属线程的共享栈上
+struct SharedStack
+{
+    void* m_stack;
+    uint64_t m_size;
+
+    explicit SharedStack(uint64_t size) : m_stack(stackAllocator::Alloc(size)), m_size(size)
+    {
+
+    }
+    ~SharedStack()
+    {
+        stackAllocator::Delalloc(m_stack, m_size);
+    }
+};
+
+//当前线程的共享栈，第一次创建共享栈协程时分配；协程持有其引用，线程退出后依旧有效
+static thread_local std::shared_ptr<SharedStack> t_shared_stack;
+
+namespace
+{
+/// @brief 线程私有的空闲栈缓存，key为对齐到页后的栈大小
+struct StackCache
+{
+    std::unordered_map<uint64_t, std::vector<void*>> m_free_list;
+    uint64_t m_count = 0;
+
+    ~StackCache();
+};
+
+static std::atomic_uint64_t s_mapped_stack_count = {0};
+
+//线程退出时StackCache先于部分协程析构，用不需要析构的裸指针判断缓存是否仍然可用
+static thread_local StackCache* t_stack_cache = nullptr;
+
+static uint64_t pageSize()
+{
+    static const uint64_t s_page_size = sysconf(_SC_PAGESIZE);
+    return s_page_size;
+}
+
+static uint64_t roundToPage(uint64_t size)
+{
+    uint64_t page = pageSize();
+    return (size + page - 1) / page * page;
+}
+
+static void unmapStack(void* ptr, uint64_t size)
+{
+    //ptr之前还有一个保护页
+    munmap(static_cast<char*>(ptr) - pageSize(), size + pageSize());
+    --s_mapped_stack_count;
+}
+
+StackCache::~StackCache()
+{
+    for(auto& pair : m_free_list) {
+        for(void* ptr : pair.second) {
+            unmapStack(ptr, pair.first);
+        }
+    }
+    t_stack_cache = nullptr;
+}
+
+static StackCache* getStackCache()
+{
+    static thread_local bool t_inited = false;
+    static thread_local StackCache t_cache;
+    if(!t_inited) {
+        t_inited = true;
+        t_stack_cache = &t_cache;
+    }
+    return t_stack_cache;
+}
+}
+
+void* PooledStackAllocator::Alloc(uint64_t size)
+{
+    size = roundToPage(size);
+    StackCache* cache = getStackCache();
+    if(cache) {
+        auto it = cache->m_free_list.find(size);
+        if(it != cache->m_free_list.end() && !it->second.empty()) {
+            void* ptr = it->second.back();
+            it->second.pop_back();
+            --cache->m_count;
+            return ptr;
+        }
+    }
+
+    uint64_t page = pageSize();
+    void* base = mmap(nullptr, size + page, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if(base == MAP_FAILED) {
+        THROW_EXCEPTION_WITH_ERRNO;
+    }
+    //栈向低地址增长，保护页放在最低端
+    if(mprotect(base, page, PROT_NONE)) {
+        munmap(base, size + page);
+        THROW_EXCEPTION_WITH_ERRNO;
+    }
+    //绑定到NUMA节点的线程，新栈在该节点上分配；之后归还时MADV_DONTNEED的页也按此策略重新分配
+    //只有一个节点时不需要mbind
+    if(Thread::getThisNode() >= 0 && CpuTopology::GetInstance()->getNodeCount() > 1) {
+        CpuTopologyImpl::bindMemory(static_cast<char*>(base) + page, size, Thread::getThisNode());
+    }
+    ++s_mapped_stack_count;
+    return static_cast<char*>(base) + page;
+}
+
+void PooledStackAllocator::Delalloc(void* ptr, uint64_t size)
+{
+    if(!ptr) {
+        return;
+    }
+    size = roundToPage(size);
+    StackCache* cache = t_stack_cache;
+    if(!cache || cache->m_count >= g_fiber_stack_pool_size->getValue()) {
+        unmapStack(ptr, size);
+        return;
+    }
+    //只保留栈顶的热区，其余页归还给系统，下次使用时按需重新分配零页
+    uint64_t hot = roundToPage(g_fiber_stack_hot_size->getValue());
+    if(size > hot) {
+        madvise(ptr, size - hot, MADV_DONTNEED);
+    }
+    cache->m_free_list[size].push_back(ptr);
+    ++cache->m_count;
+}
+
+uint64_t PooledStackAllocator::getMappedCount()
+{
+    return s_mapped_stack_count;
+}
+
+uint64_t PooledStackAllocator::getCachedCount()
+{
+    StackCache* cache = t_stack_cache;
+    return cache ? cache->m_count : 0;
+}
+
+bool StackAllocator::usePool()
+{
+    static const bool s_use_pool = [](){
+        std::string type = g_fiber_stack_allocator->getValue();
+        LOG_FORMAT_INFO(g_logger, "fiber stack allocator: %s", type.c_str());
+        return type == "pooled";
+    }();
+    return s_use_pool;
+}
+
+void* StackAllocator::Alloc(uint64_t size)
+{
+    if(usePool()) {
+        return PooledStackAllocator::Alloc(size);
+    }
+    return MallocStackAllocator::Alloc(size);
+}
+
+void StackAllocator::Delalloc(void* ptr, uint64_t size)
+{
+    if(usePool()) {
+        PooledStackAllocator::Delalloc(ptr, size);
+    }
+    else {
+        MallocStackAllocator::Delalloc(ptr, size);
+    }
+}
+
 
 //master fiber
-Fiber::Fiber(): m_id(0), m_stack_size(0),m_state(EXEC), m_ucontext(), m_stack(nullptr),m_callback()
+Fiber::Fiber(): m_id(0), m_stack_size(0),m_state(EXEC), m_context(), m_stack(nullptr),m_callback()
 {
     setThis(this);  //设置当前线程正在执行的协程
 
-    //获取上下文对象，将当前上下文保存到m_ucontext中
-    if(getcontext(&m_ucontext)) {
-        throw Exception(std::string(strerror(errno)));
-    }
+    //以当前执行流初始化上下文
+    m_context.init();
 
     ++FiberInfo::s_fiber_count; //存在协程数量增加
 
     LOG_FORMAT_DEBUG(g_logger, "use Fiber::Fiber() to create master fiber, thread id = %ld, fiber id = %ld.",GetThreadID(), m_id);
 }
 
-Fiber::Fiber(FiberFunc callback, size_t stack_size, bool use_caller):m_id(++FiberInfo::s_fiber_id),
+Fiber::Fiber(FiberFunc callback, size_t stack_size, bool use_caller, bool shared_stack):m_id(++FiberInfo::s_fiber_id),
                                                     m_stack_size(stack_size),
                                                     m_state(INIT),
-                                                    m_ucontext(),
+                                                    m_context(),
                                                     m_stack(nullptr),
                                                     m_callback(std::move(callback))
 {   
@@ -33,20 +218,26 @@ Fiber::Fiber(FiberFunc callback, size_t stack_size, bool use_caller):m_id(++Fibe
     if(stack_size == 0) {
         m_stack_size = FiberInfo::g_fiber_stack_size->getValue();
     }
-    //获取当前协程的上下文信息
-    if(getcontext(&m_ucontext)){
-        throw Exception(std::string(strerror(errno)));
+    if(shared_stack) {
+        //共享栈在每次换入时才构造上下文，这里只绑定线程和共享栈
+        assert(!use_caller);
+        if(!t_shared_stack) {
+            t_shared_stack = std::make_shared<SharedStack>(g_fiber_shared_stack_size->getValue());
+        }
+        m_shared_stack = t_shared_stack;
+        m_stack = m_shared_stack->m_stack;
+        m_stack_size = m_shared_stack->m_size;
+        m_bound_thread = GetThreadID();
     }
-    m_stack = stackAllocator::Alloc(m_stack_size);  //为当前协程分配栈空间
-    m_ucontext.uc_link = nullptr;                   //nullptr代表当前协程执行完毕，线程就退出
-    m_ucontext.uc_stack.ss_sp = m_stack;
-    m_ucontext.uc_stack.ss_size = m_stack_size;
+    else {
+        m_stack = stackAllocator::Alloc(m_stack_size);  //为当前协程分配栈空间
 
-    if(!use_caller){
-        makecontext(&m_ucontext, &Fiber::mainFunc, 0);  //给上下文绑定入口函数Fiber::mainFunc
-    }
-    else{
-        makecontext(&m_ucontext, &Fiber::callerMainFunc, 0);
+        if(!use_caller){
+            m_context.make(m_stack, m_stack_size, &Fiber::mainFunc);  //给上下文绑定入口函数Fiber::mainFunc
+        }
+        else{
+            m_context.make(m_stack, m_stack_size, &Fiber::callerMainFunc);
+        }
     }
     ++FiberInfo::s_fiber_count;
 
@@ -60,7 +251,12 @@ Fiber::~Fiber()
     if(m_stack){    //存在栈，说明是子协程
         //只有子协程未运行或者异常，才能被销毁
         assert(m_state == INIT || m_state == TERM || m_state == EXCEPTION) ;
-        stackAllocator::Delalloc(m_stack, m_stack_size);
+        if(m_shared_stack) {
+            free(m_saved_stack);
+        }
+        else {
+            stackAllocator::Delalloc(m_stack, m_stack_size);
+        }
             // LOG_FORMAT_DEBUG(g_logger,
             //      "调用 Fiber::~Fiber 析构协程，thread_id = %ld, fiber_id = %ld",
             //      GetThreadID(), m_id);
@@ -83,28 +279,66 @@ void Fiber::reset(FiberFunc callback)   //重新设置协程的执行函数
     //协程不在运行状态
     assert(m_state == INIT || m_state == TERM || m_state == EXCEPTION);
     m_callback = std::move(callback);
-    if(getcontext(&m_ucontext)){
-        throw Exception(std::string(strerror(errno)));
+    if(m_shared_stack) {
+        m_saved_size = 0;
+    }
+    else {
+        m_context.make(m_stack, m_stack_size, &Fiber::mainFunc);
     }
-    m_ucontext.uc_link = nullptr;
-    m_ucontext.uc_stack.ss_sp = m_stack;
-    m_ucontext.uc_stack.ss_size = m_stack_size;
-    makecontext(&m_ucontext, &Fiber::mainFunc, 0);
+    m_deadline_us = 0;
     m_state = INIT;
 }
 
+void Fiber::restoreSharedStack()
+{
+    //调用方不能运行在共享栈上，否则会覆盖自己的栈
+    assert(!FiberInfo::t_fiber || !FiberInfo::t_fiber->m_shared_stack);
+    assert(m_bound_thread == GetThreadID() && "共享栈协程只能在创建它的线程上运行");
+    if(m_state == INIT) {
+        m_context.make(m_stack, m_stack_size, &Fiber::mainFunc);
+        return;
+    }
+    char* top = static_cast<char*>(m_stack) + m_stack_size;
+    memcpy(top - m_saved_size, m_saved_stack, m_saved_size);
+}
+
+void Fiber::saveSharedStack()
+{
+    if(finish()) {
+        m_saved_size = 0;
+        return;
+    }
+    char* sp = static_cast<char*>(m_context.getStackPointer());
+    char* top = static_cast<char*>(m_stack) + m_stack_size;
+    assert(sp && sp > static_cast<char*>(m_stack) && sp <= top);
+    m_saved_size = top - sp;
+    //缓冲区大小跟随活跃栈数据，明显偏大时收缩
+    if(m_saved_size > m_saved_capacity || m_saved_size * 2 < m_saved_capacity) {
+        char* buffer = static_cast<char*>(realloc(m_saved_stack, m_saved_size));
+        if(!buffer) {
+            throw std::bad_alloc();
+        }
+        m_saved_stack = buffer;
+        m_saved_capacity = m_saved_size;
+    }
+    memcpy(m_saved_stack, sp, m_saved_size);
+}
+
 void Fiber::swapIn()
 {
     //只有协程是等待执行的状态才能被换入
     assert(m_state == INIT || m_state == READY || m_state == HOLD);
+    if(m_shared_stack) {
+        restoreSharedStack();
+    }
     setThis(this);
     m_state = EXEC;
 
     //挂起master fiber，切换到当前fiber
     assert(Scheduler::getMainFiber() && "请勿手动调用该函数");
-    //执行m_ucontext的上下文，如果m-ucontext.uc_link为空，则线程结束
-    if(swapcontext(&(Scheduler::getMainFiber()->m_ucontext), &m_ucontext)){
-        throw Exception(std::string(strerror(errno)));
+    Scheduler::getMainFiber()->m_context.swapTo(m_context);
+    if(m_shared_stack) {
+        saveSharedStack();
     }
 }
 
@@ -115,19 +349,21 @@ void Fiber::swapOut()   //和scheduler的master fiber切换
 
     //挂起当前fiber，切换到master fiber
     assert(Scheduler::getMainFiber() && "请勿手动调用该函数");
-    if(swapcontext(&m_ucontext, &(Scheduler::getMainFiber()->m_ucontext))){
-        throw Exception(std::string(strerror(errno)));
-    }
+    m_context.swapTo(Scheduler::getMainFiber()->m_context);
 }
 
 void Fiber::call()  //从master fiber切换到当前的协程
 {
     assert(FiberInfo::t_master_fiber && "当前线程不存在主协程");
     assert(m_state == INIT || m_state == READY || m_state == HOLD);
+    if(m_shared_stack) {
+        restoreSharedStack();
+    }
     setThis(this);
     m_state = EXEC;
-    if(swapcontext(&(FiberInfo::t_master_fiber->m_ucontext), &m_ucontext)){
-        throw Exception(std::string(strerror(errno)));
+    FiberInfo::t_master_fiber->m_context.swapTo(m_context);
+    if(m_shared_stack) {
+        saveSharedStack();
     }
 }
 
@@ -136,18 +372,20 @@ void Fiber::back()//从当前协程切换回主协程master fiber
     assert(FiberInfo::t_master_fiber && "当前线程不存在主线程");
     assert(m_stack);
     setThis(FiberInfo::t_master_fiber.get());
-    if(swapcontext(&m_ucontext, &(FiberInfo::t_master_fiber->m_ucontext))){
-        throw Exception(std::string(strerror(errno)));
-    }
+    m_context.swapTo(FiberInfo::t_master_fiber->m_context);
 }
 
 void Fiber::swapIn(Fiber::_ptr fiber_ptr)
 {
     assert(m_state == INIT || m_state == READY || m_state == HOLD);
+    if(m_shared_stack) {
+        restoreSharedStack();
+    }
     setThis(this);
     m_state = EXEC;
-    if(swapcontext(&(fiber_ptr->m_ucontext), &m_ucontext)){
-        throw Exception(std::string(strerror(errno)));
+    fiber_ptr->m_context.swapTo(m_context);
+    if(m_shared_stack) {
+        saveSharedStack();
     }
 }
 
@@ -156,9 +394,7 @@ void Fiber::swapOut(Fiber::_ptr fiber_ptr)
     assert(m_state);
     setThis(fiber_ptr.get());
     m_state = EXEC;
-    if(swapcontext(&m_ucontext, &(fiber_ptr->m_ucontext))) {
-        throw Exception(std::string(strerror(errno)));
-    }
+    m_context.swapTo(fiber_ptr->m_context);
 }
 
 uint64_t Fiber::getId()
@@ -176,6 +412,26 @@ bool Fiber::finish() const noexcept
     return (m_state == TERM || m_state == EXCEPTION);
 }
 
+bool Fiber::isSharedStack() const noexcept
+{
+    return m_shared_stack != nullptr;
+}
+
+long Fiber::getBoundThread() const noexcept
+{
+    return m_bound_thread;
+}
+
+uint64_t Fiber::getDeadline() const noexcept
+{
+    return m_deadline_us;
+}
+
+void Fiber::setDeadline(uint64_t deadline_us) noexcept
+{
+    m_deadline_us = deadline_us;
+}
+
 Fiber::_ptr Fiber::getThis()
 {
     if(FiberInfo::t_fiber != nullptr) {
@@ -201,7 +457,8 @@ void Fiber::yieldToReady()
 void Fiber::yieldToHold()
 {
     Fiber::_ptr current_fiber = getThis();
-    current_fiber->m_state = HOLD;
+    //状态保持为EXEC，由调度器在切换完成后置为HOLD，
+    //避免协程在上下文保存之前就被其他线程唤醒并换入
     current_fiber->swapOut();
 }
 
@@ -211,6 +468,11 @@ uint64_t Fiber::getTotalFiberCount()
     return FiberInfo::s_fiber_count;
 }
 
+bool Fiber::hasBoundFibers()
+{
+    return t_shared_stack && t_shared_stack.use_count() > 1;
+}
+
 uint64_t Fiber::getThisFiberId()
 {
     if(FiberInfo::t_fiber != nullptr){
@@ -219,6 +481,27 @@ uint64_t Fiber::getThisFiberId()
     return 0;
 }
 
+uint64_t Fiber::getThisDeadline()
+{
+    if(FiberInfo::t_fiber != nullptr) {
+        return FiberInfo::t_fiber->m_deadline_us;
+    }
+    return 0;
+}
+
+void Fiber::setThisDeadline(uint64_t deadline_us)
+{
+    if(FiberInfo::t_fiber != nullptr) {
+        FiberInfo::t_fiber->m_deadline_us = deadline_us;
+    }
+}
+
+bool Fiber::isThisDeadlineExceeded()
+{
+    uint64_t deadline = getThisDeadline();
+    return deadline != 0 && GetCurrentUS() > deadline;
+}
+
 void Fiber::callerMainFunc()
 {
 
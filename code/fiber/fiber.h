@@ -2,17 +2,19 @@
 
 #include <memory>
 #include <functional>
-#include <ucontext.h>
 #include <atomic>
 
 #include "noncopyable.h"
 #include "config.h"
+#include "context.h"
+#include "unique_function.h"
 
 
 
 namespace hxk
 {
 class Scheduler;
+struct SharedStack;
 
 /**
  * @Author: hxk
@@ -26,7 +28,7 @@ class Fiber : public std::enable_shared_from_this<Fiber>, public noncopyable
 public:
     using _ptr = std::shared_ptr<Fiber>;
     using _uptr = std::unique_ptr<Fiber>;
-    using FiberFunc = std::function<void()> ;
+    using FiberFunc = unique_function<void()> ;
 
     enum STATE{
         INIT,       //初始化
@@ -44,9 +46,12 @@ public:
      * @param {FiberFunc} callback 协程执行函数
      * @param {size_t} stack_size   协程栈空间大小
      * @param {bool}   use_caller   是否在main fiber上调度
+     * @param {bool}   shared_stack 是否运行在线程共享栈上，此时stack_size无效
+     *                  协程被切换出去时只把活跃的栈数据拷贝到私有缓冲区，切换回来时再拷贝回共享栈，
+     *                  因此协程只能在创建它的线程上运行，挂起期间其他协程不能访问它栈上的数据
      * @return {*}
      */
-    explicit Fiber(FiberFunc callback, size_t stack_size = 0,bool user_caller = false);
+    explicit Fiber(FiberFunc callback, size_t stack_size = 0,bool user_caller = false, bool shared_stack = false);
     ~Fiber();
 
     /**
@@ -99,9 +104,19 @@ public:
 
     bool finish() const noexcept;   //判断协程是否执行结束
 
+    bool isSharedStack() const noexcept;    //是否运行在线程共享栈上
+
+    long getBoundThread() const noexcept;   //协程绑定的线程id，-1表示可以在任意线程上运行
+
+    uint64_t getDeadline() const noexcept;  //协程的截止时间（us，与GetCurrentUS相同的时钟），0表示没有截止时间
+    void setDeadline(uint64_t deadline_us) noexcept;
+
 private:    
     Fiber();    //用于创建master fiber
 
+    void restoreSharedStack();  //切换到共享栈协程之前，恢复其栈数据
+    void saveSharedStack();     //共享栈协程切换出去之后，保存其活跃的栈数据
+
 public:
     static Fiber::_ptr getThis();   //获取当前正在执行的fiber指针
                                     //如果不存在，在当前线程上创建master fiber
@@ -115,6 +130,18 @@ public:
 
     static uint64_t getThisFiberId();       //获取当前协程的id
 
+    static bool hasBoundFibers();   //当前线程是否还有未结束的共享栈协程，它们只能在当前线程恢复执行
+
+    /**
+     * @Author: hxk
+     * @brief: 当前协程的截止时间，不在协程中时返回0
+     *      截止时间随协程一起被调度：协程创建的定时器、注册的IO事件回调，以及协程被唤醒时的任务都带有该截止时间
+     * @return {uint64_t}
+     */
+    static uint64_t getThisDeadline();
+    static void setThisDeadline(uint64_t deadline_us);  //设置当前协程的截止时间，不在协程中时什么都不做
+    static bool isThisDeadlineExceeded();   //当前协程是否已经超过截止时间，长时间执行的请求可以据此提前放弃
+
     /**
      * @Author: hxk
      * @brief: 协程执行函数
@@ -136,13 +163,27 @@ private:
 
     uint64_t m_stack_size;  //协程栈大小
 
-    STATE m_state;          //协程状态
+    std::atomic<STATE> m_state; //协程状态，挂起和唤醒可能发生在不同线程
 
-    ucontext_t m_ucontext;   //协程上下文
+    FiberContext m_context;   //协程上下文
 
     void* m_stack;  //协程栈空间指针
 
     FiberFunc m_callback;   //执行函数  
+
+    bool m_recyclable = false;  //由调度器为callback任务创建，结束后可以被调度器缓存复用
+
+    std::shared_ptr<SharedStack> m_shared_stack;    //共享栈模式下所在线程的共享栈
+
+    char* m_saved_stack = nullptr;  //共享栈模式下，挂起时保存的栈数据
+
+    uint64_t m_saved_size = 0;      //保存的栈数据大小
+
+    uint64_t m_saved_capacity = 0;  //保存栈数据的缓冲区大小
+
+    long m_bound_thread = -1;       //共享栈模式下绑定的线程id
+
+    uint64_t m_deadline_us = 0;     //截止时间，0表示没有截止时间
 };
 
 /**
@@ -165,8 +206,46 @@ public:
 };
 
 
+/**
+ * @Author: hxk
+ * @brief: 基于mmap的协程栈池
+ *      每个栈的低地址端有一个PROT_NONE的保护页，栈溢出时直接产生段错误，而不是破坏堆
+ *      每个线程按栈大小维护空闲链表，归还的栈优先缓存复用，超过fiber.stack_pool_size时munmap
+ *      缓存的栈只保留栈顶fiber.stack_hot_size字节，其余冷页通过madvise(MADV_DONTNEED)归还系统
+ * @return {*}
+ */
+class PooledStackAllocator
+{
+public:
+    static void* Alloc(uint64_t size);
+
+    static void Delalloc(void *ptr, uint64_t size);
+
+    static uint64_t getMappedCount();   //当前所有线程已映射的栈数量
+
+    static uint64_t getCachedCount();   //当前线程缓存的空闲栈数量
+};
+
+/**
+ * @Author: hxk
+ * @brief: 根据配置fiber.stack_allocator选择栈分配器，可选 malloc / pooled
+ *      配置在第一次分配协程栈时读取，之后修改不再生效，保证分配和释放使用同一个分配器
+ * @return {*}
+ */
+class StackAllocator
+{
+public:
+    static void* Alloc(uint64_t size);
+
+    static void Delalloc(void *ptr, uint64_t size);
+
+private:
+    static bool usePool();
+};
+
+
 /// @brief 协程栈空间分配器
-using stackAllocator = MallocStackAllocator;
+using stackAllocator = StackAllocator;
 
 namespace FiberInfo
 {
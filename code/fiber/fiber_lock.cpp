@@ -0,0 +1,321 @@
+#include "fiber_lock.h"
+#include "scheduler.h"
+
+namespace hxk
+{
+
+FiberParker::FiberParker():m_scheduler(nullptr),
+                           m_semaphore(0),
+                           m_notified(false)
+{
+    Scheduler* scheduler = Scheduler::getThis();
+    Fiber::_ptr current = Fiber::getThis();
+    //只有调度器正在执行的任务协程才能挂起，master fiber和调度协程只能阻塞线程
+    if(scheduler && current->getId() != 0 && current.get() != Scheduler::getMainFiber()) {
+        m_scheduler = scheduler;
+        m_fiber = std::move(current);
+    }
+}
+
+void FiberParker::park()
+{
+    if(m_scheduler) {
+        Fiber::yieldToHold();
+    }
+    else {
+        m_semaphore.wait();
+    }
+}
+
+bool FiberParker::unpark()
+{
+    bool expected = false;
+    if(!m_notified.compare_exchange_strong(expected, true)) {
+        return false;
+    }
+    if(m_scheduler) {
+        //协程可能还没有完成切换，调度器会等到协程状态不再是EXEC时才换入
+        m_scheduler->schedule(std::move(m_fiber));
+    }
+    else {
+        m_semaphore.notify();
+    }
+    return true;
+}
+
+bool FiberParker::cancel()
+{
+    bool expected = false;
+    return m_notified.compare_exchange_strong(expected, true);
+}
+
+bool FiberParker::isNotified() const
+{
+    return m_notified;
+}
+
+
+FiberMutex::FiberMutex():m_state(0), m_wait_count(0)
+{
+
+}
+
+void FiberMutex::lock()
+{
+    uint32_t expected = 0;
+    if(m_state.compare_exchange_strong(expected, 1, std::memory_order_acquire)) {
+        return;
+    }
+    lockSlow();
+}
+
+bool FiberMutex::tryLock()
+{
+    uint32_t expected = 0;
+    return m_state.compare_exchange_strong(expected, 1, std::memory_order_acquire);
+}
+
+void FiberMutex::unlock()
+{
+    m_state.store(0);
+    if(m_wait_count > 0) {
+        dispatch();
+    }
+}
+
+void FiberMutex::lockSlow()
+{
+    auto parker = std::make_shared<FiberParker>();
+    {
+        ScopedSpinLock lock(&m_lock);
+        //先登记等待者再重试，保证解锁方一定能看到等待者
+        ++m_wait_count;
+        if(tryLock()) {
+            --m_wait_count;
+            return;
+        }
+        m_waiters.push_back(parker);
+    }
+    parker->park();     //被唤醒时锁已经交给当前执行流
+}
+
+void FiberMutex::dispatch()
+{
+    FiberParker::_ptr parker;
+    {
+        ScopedSpinLock lock(&m_lock);
+        //锁已经被其他执行流抢到时，由它解锁时再分发
+        if(m_waiters.empty() || !tryLock()) {
+            return;
+        }
+        parker = std::move(m_waiters.front());
+        m_waiters.pop_front();
+        --m_wait_count;
+    }
+    parker->unpark();
+}
+
+
+void FiberCondVar::wait(FiberMutex& mutex)
+{
+    auto parker = std::make_shared<FiberParker>();
+    {
+        ScopedSpinLock lock(&m_lock);
+        m_waiters.push_back(parker);
+    }
+    mutex.unlock();
+    parker->park();
+    mutex.lock();
+}
+
+void FiberCondVar::notifyOne()
+{
+    FiberParker::_ptr parker;
+    {
+        ScopedSpinLock lock(&m_lock);
+        if(m_waiters.empty()) {
+            return;
+        }
+        parker = std::move(m_waiters.front());
+        m_waiters.pop_front();
+    }
+    parker->unpark();
+}
+
+void FiberCondVar::notifyAll()
+{
+    std::deque<FiberParker::_ptr> waiters;
+    {
+        ScopedSpinLock lock(&m_lock);
+        waiters.swap(m_waiters);
+    }
+    for(auto& parker : waiters) {
+        parker->unpark();
+    }
+}
+
+
+FiberSemaphore::FiberSemaphore(uint32_t count):m_count(count), m_wait_count(0)
+{
+
+}
+
+bool FiberSemaphore::tryWait()
+{
+    int64_t count = m_count.load();
+    while(count > 0) {
+        if(m_count.compare_exchange_weak(count, count - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FiberSemaphore::wait()
+{
+    if(tryWait()) {
+        return;
+    }
+    auto parker = std::make_shared<FiberParker>();
+    {
+        ScopedSpinLock lock(&m_lock);
+        ++m_wait_count;
+        if(tryWait()) {
+            --m_wait_count;
+            return;
+        }
+        m_waiters.push_back(parker);
+    }
+    parker->park();     //被唤醒时已经获得了一个计数
+}
+
+void FiberSemaphore::notify()
+{
+    ++m_count;
+    if(m_wait_count > 0) {
+        dispatch();
+    }
+}
+
+void FiberSemaphore::dispatch()
+{
+    FiberParker::_ptr parker;
+    {
+        ScopedSpinLock lock(&m_lock);
+        if(m_waiters.empty() || !tryWait()) {
+            return;
+        }
+        parker = std::move(m_waiters.front());
+        m_waiters.pop_front();
+        --m_wait_count;
+    }
+    parker->unpark();
+}
+
+
+FiberRWLock::FiberRWLock():m_state(0), m_reader_wait_count(0), m_writer_wait_count(0)
+{
+
+}
+
+bool FiberRWLock::tryReadLock()
+{
+    //写优先，有写者等待时读者不能插队
+    if(m_writer_wait_count > 0) {
+        return false;
+    }
+    int32_t state = m_state.load();
+    while(state >= 0) {
+        if(m_state.compare_exchange_weak(state, state + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FiberRWLock::tryWriteLock()
+{
+    int32_t expected = 0;
+    return m_state.compare_exchange_strong(expected, -1);
+}
+
+void FiberRWLock::readLock()
+{
+    if(tryReadLock()) {
+        return;
+    }
+    auto parker = std::make_shared<FiberParker>();
+    {
+        ScopedSpinLock lock(&m_lock);
+        ++m_reader_wait_count;
+        if(tryReadLock()) {
+            --m_reader_wait_count;
+            return;
+        }
+        m_readers.push_back(parker);
+    }
+    parker->park();
+}
+
+void FiberRWLock::writeLock()
+{
+    if(tryWriteLock()) {
+        return;
+    }
+    auto parker = std::make_shared<FiberParker>();
+    {
+        ScopedSpinLock lock(&m_lock);
+        ++m_writer_wait_count;
+        if(tryWriteLock()) {
+            --m_writer_wait_count;
+            return;
+        }
+        m_writers.push_back(parker);
+    }
+    parker->park();
+}
+
+void FiberRWLock::unlock()
+{
+    if(m_state.load() == -1) {
+        m_state.store(0);
+    }
+    else {
+        --m_state;
+    }
+    if(m_reader_wait_count > 0 || m_writer_wait_count > 0) {
+        dispatch();
+    }
+}
+
+void FiberRWLock::dispatch()
+{
+    std::deque<FiberParker::_ptr> wake_list;
+    {
+        ScopedSpinLock lock(&m_lock);
+        if(!m_writers.empty()) {
+            //有写者等待时只唤醒写者，读者排在写者之后
+            if(tryWriteLock()) {
+                wake_list.push_back(std::move(m_writers.front()));
+                m_writers.pop_front();
+                --m_writer_wait_count;
+            }
+        }
+        else if(!m_readers.empty()) {
+            int32_t count = m_readers.size();
+            int32_t state = m_state.load();
+            while(state >= 0) {
+                if(m_state.compare_exchange_weak(state, state + count)) {
+                    wake_list.swap(m_readers);
+                    m_reader_wait_count -= count;
+                    break;
+                }
+            }
+        }
+    }
+    for(auto& parker : wake_list) {
+        parker->unpark();
+    }
+}
+
+}
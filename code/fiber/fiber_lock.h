@@ -0,0 +1,240 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <memory>
+
+#include "noncopyable.h"
+#include "lock.h"
+#include "fiber.h"
+
+namespace hxk
+{
+class Scheduler;
+
+/**
+ * @Author: hxk
+ * @brief: 挂起/唤醒当前执行流
+ *      在调度器的任务协程中创建时，park挂起协程，unpark将协程重新交给原调度器
+ *      在普通线程（或调度协程）中创建时，park阻塞线程
+ *      unpark只有第一次调用有效，可以先于park调用
+ */
+class FiberParker : public noncopyable
+{
+public:
+    typedef std::shared_ptr<FiberParker> _ptr;
+
+    FiberParker();
+
+    void park();        //挂起当前执行流，直到被unpark
+
+    bool unpark();      //唤醒，返回是否为第一次唤醒
+
+    /**
+     * @Author: hxk
+     * @brief: 不再需要挂起时取消等待，之后的unpark都会失败
+     * @return {bool} 返回false说明已经被unpark，调用方必须再调用park消耗这次唤醒，
+     *      否则协程会被重复调度
+     */
+    bool cancel();
+
+    bool isNotified() const;
+
+private:
+    Scheduler* m_scheduler;     //协程所属的调度器，为nullptr时阻塞线程
+    Fiber::_ptr m_fiber;        //被挂起的协程
+    Semaphore m_semaphore;      //阻塞线程时使用
+    std::atomic_bool m_notified;
+};
+
+/**
+ * @Author: hxk
+ * @brief: 协程互斥锁，竞争时挂起协程而不是阻塞线程
+ *      无竞争时只有一次CAS；解锁时直接把锁交给队首的等待者
+ */
+class FiberMutex : public noncopyable
+{
+public:
+    FiberMutex();
+
+    void lock();
+    bool tryLock();
+    void unlock();
+
+private:
+    void lockSlow();
+    void dispatch();    //锁被释放后，把锁交给等待者
+
+private:
+    std::atomic_uint32_t m_state;       //0：未加锁，1：已加锁
+    std::atomic_uint32_t m_wait_count;  //等待者数量
+    SpinLock m_lock;                    //保护等待队列
+    std::deque<FiberParker::_ptr> m_waiters;
+};
+
+/**
+ * @Author: hxk
+ * @brief: 协程条件变量，配合FiberMutex使用
+ */
+class FiberCondVar : public noncopyable
+{
+public:
+    /**
+     * @Author: hxk
+     * @brief: 释放mutex并挂起，被唤醒后重新获取mutex
+     * @param {FiberMutex&} mutex 调用时必须已经持有
+     * @return {*}
+     */
+    void wait(FiberMutex& mutex);
+
+    void notifyOne();
+    void notifyAll();
+
+private:
+    SpinLock m_lock;
+    std::deque<FiberParker::_ptr> m_waiters;
+};
+
+/**
+ * @Author: hxk
+ * @brief: 协程信号量，count为0时wait挂起协程
+ */
+class FiberSemaphore : public noncopyable
+{
+public:
+    explicit FiberSemaphore(uint32_t count = 0);
+
+    void wait();        //-1操作，值为0时挂起
+    bool tryWait();
+    void notify();      //+1操作
+
+private:
+    void dispatch();
+
+private:
+    std::atomic_int64_t m_count;
+    std::atomic_uint32_t m_wait_count;
+    SpinLock m_lock;
+    std::deque<FiberParker::_ptr> m_waiters;
+};
+
+/**
+ * @Author: hxk
+ * @brief: 协程读写锁，写优先：有写者等待时新的读者也会等待
+ */
+class FiberRWLock : public noncopyable
+{
+public:
+    FiberRWLock();
+
+    void readLock();
+    void writeLock();
+    bool tryReadLock();
+    bool tryWriteLock();
+    void unlock();
+
+private:
+    void dispatch();
+
+private:
+    std::atomic_int32_t m_state;            //-1：写锁，>=0：持有读锁的数量
+    std::atomic_uint32_t m_reader_wait_count;
+    std::atomic_uint32_t m_writer_wait_count;
+    SpinLock m_lock;
+    std::deque<FiberParker::_ptr> m_readers;
+    std::deque<FiberParker::_ptr> m_writers;
+};
+
+
+/**
+ * @Author: hxk
+ * @brief: FiberMutex的RAII
+ * @return {*}
+ */
+using FiberScopedLock = ScopedLockImpl<FiberMutex>;
+
+/**
+ * @Author: hxk
+ * @brief: FiberRWLock针对读操作的RAII实现
+ * @return {*}
+ */
+using FiberReadScopedLock = ReadScopedLockImpl<FiberRWLock>;
+
+/**
+ * @Author: hxk
+ * @brief: FiberRWLock针对写操作的RAII实现
+ * @return {*}
+ */
+using FiberWriteScopedLock = WriteScopedLockImpl<FiberRWLock>;
+
+/**
+ * @Author: hxk
+ * @brief: 在另一个执行流中执行函数时，把返回值或异常交还给等待方
+ *      等待方创建后交给执行方，执行方调用run，等待方调用get挂起直到run结束，再取出结果或重新抛出异常
+ */
+template<class R>
+class CallResult : public noncopyable
+{
+public:
+    typedef std::shared_ptr<CallResult> _ptr;
+
+    template<class F>
+    void run(F& fn)
+    {
+        try {
+            m_result.reset(new R(fn()));
+        }
+        catch(...) {
+            m_error = std::current_exception();
+        }
+        m_parker.unpark();
+    }
+
+    R get()
+    {
+        m_parker.park();
+        if(m_error) {
+            std::rethrow_exception(m_error);
+        }
+        return std::move(*m_result);
+    }
+
+private:
+    FiberParker m_parker;
+    std::unique_ptr<R> m_result;
+    std::exception_ptr m_error;
+};
+
+template<>
+class CallResult<void> : public noncopyable
+{
+public:
+    typedef std::shared_ptr<CallResult> _ptr;
+
+    template<class F>
+    void run(F& fn)
+    {
+        try {
+            fn();
+        }
+        catch(...) {
+            m_error = std::current_exception();
+        }
+        m_parker.unpark();
+    }
+
+    void get()
+    {
+        m_parker.park();
+        if(m_error) {
+            std::rethrow_exception(m_error);
+        }
+    }
+
+private:
+    FiberParker m_parker;
+    std::exception_ptr m_error;
+};
+
+}
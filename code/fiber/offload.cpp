@@ -0,0 +1,136 @@
+#include "offload.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+
+namespace hxk
+{
+static Logger::_ptr g_logger = GET_LOGGER("system");
+
+static ConfigVar<uint64_t>::_ptr g_offload_threads =
+    Config::lookUp<uint64_t>("offload.threads", 4, "blocking offload pool thread count");
+
+static ConfigVar<uint64_t>::_ptr g_offload_queue_size =
+    Config::lookUp<uint64_t>("offload.queue_size", 1024, "blocking offload pool queue limit");
+
+OffloadPoolImpl::OffloadPoolImpl():m_job_semaphore(0),
+                                   m_queue_limit(std::max<uint64_t>(g_offload_queue_size->getValue(), 1)),
+                                   m_stopping(false),
+                                   m_running(0),
+                                   m_submitted(0),
+                                   m_completed(0),
+                                   m_full_waits(0),
+                                   m_queue_wait_us(0),
+                                   m_max_queue_wait_us(0),
+                                   m_run_us(0)
+{
+    size_t thread_count = std::max<uint64_t>(g_offload_threads->getValue(), 1);
+    for(size_t i = 0; i < thread_count; i++) {
+        m_threads.push_back(std::make_shared<Thread>(std::bind(&OffloadPoolImpl::run, this),
+                                                     "offload_" + std::to_string(i)));
+    }
+    LOG_FORMAT_INFO(g_logger, "offload pool: %lu threads, queue limit %lu", thread_count, m_queue_limit);
+}
+
+OffloadPoolImpl::~OffloadPoolImpl()
+{
+    {
+        ScopedLock lock(&m_mutex);
+        m_stopping = true;
+    }
+    for(size_t i = 0; i < m_threads.size(); i++) {
+        m_job_semaphore.notify();
+    }
+    for(auto& thread : m_threads) {
+        thread->join();
+    }
+}
+
+void OffloadPoolImpl::submit(Job job)
+{
+    ++m_submitted;
+    while(true) {
+        FiberParker::_ptr parker;
+        {
+            ScopedLock lock(&m_mutex);
+            if(m_jobs.size() < m_queue_limit) {
+                m_jobs.push_back(Entry{std::move(job), GetCurrentUS()});
+                break;
+            }
+            parker = std::make_shared<FiberParker>();
+            m_waiters.push_back(parker);
+        }
+        ++m_full_waits;
+        parker->park();
+    }
+    m_job_semaphore.notify();
+}
+
+void OffloadPoolImpl::run()
+{
+    while(true) {
+        m_job_semaphore.wait();
+        Entry entry;
+        FiberParker::_ptr waiter;
+        {
+            ScopedLock lock(&m_mutex);
+            if(m_jobs.empty()) {
+                if(m_stopping) {
+                    break;
+                }
+                continue;
+            }
+            entry = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            if(!m_waiters.empty()) {
+                waiter = std::move(m_waiters.front());
+                m_waiters.pop_front();
+            }
+        }
+        if(waiter) {
+            waiter->unpark();   //队列有了空位，唤醒一个等待的提交方
+        }
+
+        uint64_t begin_us = GetCurrentUS();
+        uint64_t wait_us = begin_us - entry.m_enqueue_us;
+        m_queue_wait_us += wait_us;
+        uint64_t max_wait = m_max_queue_wait_us;
+        while(wait_us > max_wait && !m_max_queue_wait_us.compare_exchange_weak(max_wait, wait_us));
+
+        ++m_running;
+        try {
+            entry.m_job();
+        }
+        catch(const std::exception& e) {
+            LOG_FORMAT_ERROR(g_logger, "offload job error: %s", e.what());
+        }
+        catch(...) {
+            LOG_ERROR(g_logger, "offload job error");
+        }
+        entry.m_job = nullptr;  //回调持有的资源在计时之内释放
+        --m_running;
+        ++m_completed;
+        m_run_us += GetCurrentUS() - begin_us;
+    }
+}
+
+OffloadStats OffloadPoolImpl::getStats() const
+{
+    OffloadStats stats;
+    stats.m_thread_count = m_threads.size();
+    stats.m_queue_limit = m_queue_limit;
+    {
+        ScopedLock lock(&m_mutex);
+        stats.m_queued = m_jobs.size();
+    }
+    stats.m_running = m_running;
+    stats.m_submitted = m_submitted;
+    stats.m_completed = m_completed;
+    stats.m_full_waits = m_full_waits;
+    stats.m_queue_wait_us = m_queue_wait_us;
+    stats.m_max_queue_wait_us = m_max_queue_wait_us;
+    stats.m_run_us = m_run_us;
+    return stats;
+}
+
+}
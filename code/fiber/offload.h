@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "noncopyable.h"
+#include "lock.h"
+#include "thread.h"
+#include "fiber_lock.h"
+#include "singleInstance.h"
+#include "unique_function.h"
+
+namespace hxk
+{
+
+/**
+ * @Author: hxk
+ * @brief: 阻塞任务线程池的统计信息，时间单位为微秒
+ */
+struct OffloadStats
+{
+    size_t m_thread_count = 0;      //线程数量
+    size_t m_queue_limit = 0;       //队列容量
+    uint64_t m_queued = 0;          //当前排队的任务数
+    uint64_t m_running = 0;         //当前正在执行的任务数
+    uint64_t m_submitted = 0;       //提交的任务总数
+    uint64_t m_completed = 0;       //执行完成的任务总数
+    uint64_t m_full_waits = 0;      //因为队列已满而等待的次数
+    uint64_t m_queue_wait_us = 0;   //所有任务的排队时间之和
+    uint64_t m_max_queue_wait_us = 0;   //最长的排队时间
+    uint64_t m_run_us = 0;          //所有任务的执行时间之和
+};
+
+/**
+ * @Author: hxk
+ * @brief: 执行阻塞调用（普通文件读写、CPU密集的计算等）的独立线程池，避免阻塞IOManager的调度线程
+ *      offload在调度器的任务协程中调用时挂起协程，任务完成后协程回到原调度器继续执行；
+ *      在普通线程中调用时阻塞线程
+ *      队列容量为offload.queue_size，队列已满时提交方同样被挂起，直到有空位
+ *      线程数量为offload.threads，在第一次使用时创建，之后修改配置不再生效
+ *      线程池中的线程不开启hook，任务中的系统调用直接阻塞线程
+ */
+class OffloadPoolImpl : public noncopyable
+{
+public:
+    typedef unique_function<void()> Job;
+
+    OffloadPoolImpl();
+    ~OffloadPoolImpl();
+
+    /**
+     * @Author: hxk
+     * @brief: 在线程池中执行fn，挂起当前执行流直到完成，返回fn的结果，fn抛出的异常在调用方重新抛出
+     * @return {*}
+     */
+    template<class F>
+    typename std::invoke_result<F&>::type offload(F fn)
+    {
+        typedef typename std::invoke_result<F&>::type R;
+        auto result = std::make_shared<CallResult<R>>();
+        //fn移入任务：调用方是共享栈协程时，挂起期间它的栈会被其他协程复用
+        submit([result, fn = std::move(fn)]() mutable {
+            result->run(fn);
+        });
+        return result->get();
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 放入任务队列后立即返回，不等待执行结果；队列已满时挂起当前执行流直到有空位
+     * @return {*}
+     */
+    void submit(Job job);
+
+    OffloadStats getStats() const;
+
+private:
+    struct Entry
+    {
+        Job m_job;
+        uint64_t m_enqueue_us;
+    };
+
+    void run();     //线程池中线程的执行函数
+
+private:
+    mutable Mutex m_mutex;                      //保护m_jobs和m_waiters
+    std::deque<Entry> m_jobs;
+    std::deque<FiberParker::_ptr> m_waiters;    //队列已满时等待的提交方
+    Semaphore m_job_semaphore;                  //队列中的任务数
+    size_t m_queue_limit;
+    bool m_stopping;
+    std::vector<Thread::_ptr> m_threads;
+
+    std::atomic_uint64_t m_running;
+    std::atomic_uint64_t m_submitted;
+    std::atomic_uint64_t m_completed;
+    std::atomic_uint64_t m_full_waits;
+    std::atomic_uint64_t m_queue_wait_us;
+    std::atomic_uint64_t m_max_queue_wait_us;
+    std::atomic_uint64_t m_run_us;
+};
+
+using OffloadPool = SingleInstance<OffloadPoolImpl>;
+
+/**
+ * @Author: hxk
+ * @brief: 在阻塞任务线程池中执行fn并等待结果，见OffloadPoolImpl::offload
+ * @return {*}
+ */
+template<class F>
+typename std::invoke_result<F&>::type offload(F fn)
+{
+    return OffloadPool::GetInstance()->offload(std::move(fn));
+}
+
+}
@@ -0,0 +1,71 @@
+#include "parallel.h"
+
+namespace hxk
+{
+
+TaskGroup::TaskGroup(Scheduler* scheduler):m_scheduler(scheduler), m_pending(0)
+{
+    assert(m_scheduler && "TaskGroup需要一个调度器");
+}
+
+TaskGroup::~TaskGroup()
+{
+    try {
+        wait();
+    }
+    catch(...) {
+        //析构时忽略任务的异常
+    }
+}
+
+void TaskGroup::wait()
+{
+    auto parker = std::make_shared<FiberParker>();
+    bool need_park = false;
+    std::exception_ptr error;
+    {
+        //即使m_pending已经为0也要加锁，保证最后一个任务的done已经不再访问this，之后才能析构
+        ScopedSpinLock lock(&m_lock);
+        if(m_pending > 0) {
+            m_waiter = parker;
+            need_park = true;
+        }
+    }
+    if(need_park) {
+        parker->park();
+    }
+    {
+        ScopedSpinLock lock(&m_lock);
+        error = std::move(m_error);
+        m_error = nullptr;
+    }
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void TaskGroup::setError(std::exception_ptr error)
+{
+    ScopedSpinLock lock(&m_lock);
+    if(!m_error) {
+        m_error = std::move(error);
+    }
+}
+
+void TaskGroup::done()
+{
+    FiberParker::_ptr waiter;
+    {
+        //在锁内减少计数，wait看到0时这里已经不会再访问this
+        ScopedSpinLock lock(&m_lock);
+        if(--m_pending != 0) {
+            return;
+        }
+        waiter = std::move(m_waiter);
+    }
+    if(waiter) {
+        waiter->unpark();
+    }
+}
+
+}
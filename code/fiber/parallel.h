@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <vector>
+
+#include "noncopyable.h"
+#include "lock.h"
+#include "scheduler.h"
+#include "fiber_lock.h"
+
+namespace hxk
+{
+
+/**
+ * @Author: hxk
+ * @brief: 一组在调度器上并发执行的任务，wait等待它们全部结束
+ *      wait在任务协程中调用时挂起协程，调度线程可以继续执行组内的任务；在普通线程中调用时阻塞线程
+ *      任务抛出的第一个异常由wait重新抛出，其余的被忽略
+ *      析构时等待所有任务结束，但不抛出异常
+ */
+class TaskGroup : public noncopyable
+{
+public:
+    explicit TaskGroup(Scheduler* scheduler = Scheduler::getThis());
+    ~TaskGroup();
+
+    template<class F>
+    void run(F&& fn)
+    {
+        ++m_pending;
+        m_scheduler->schedule([this, fn = std::forward<F>(fn)]() mutable {
+            try {
+                fn();
+            }
+            catch(...) {
+                setError(std::current_exception());
+            }
+            done();
+        });
+    }
+
+    void wait();
+
+    Scheduler* getScheduler() const { return m_scheduler; }
+
+private:
+    void setError(std::exception_ptr error);
+    void done();
+
+private:
+    Scheduler* m_scheduler;
+    std::atomic_long m_pending;     //还没有结束的任务数
+    SpinLock m_lock;                //保护m_waiter和m_error
+    FiberParker::_ptr m_waiter;
+    std::exception_ptr m_error;
+};
+
+/**
+ * @Author: hxk
+ * @brief: 把[begin, end)切分为不超过grain的块，在scheduler上并发执行fn(chunk_begin, chunk_end)
+ *      按二分递归切分，每一层把右半部分交给其他线程，当前执行流处理左半部分，空闲线程通过窃取分担
+ *      返回时所有块都已执行完，fn抛出的第一个异常会被重新抛出
+ * @return {*}
+ */
+template<class F>
+void parallel_for(Scheduler* scheduler, size_t begin, size_t end, size_t grain, const F& fn)
+{
+    if(begin >= end) {
+        return;
+    }
+    grain = grain ? grain : 1;
+    TaskGroup group(scheduler);
+    struct Splitter
+    {
+        static void split(TaskGroup& group, size_t begin, size_t end, size_t grain, const F& fn)
+        {
+            while(end - begin > grain) {
+                size_t mid = begin + (end - begin) / 2;
+                group.run([&group, mid, end, grain, &fn](){
+                    split(group, mid, end, grain, fn);
+                });
+                end = mid;
+            }
+            fn(begin, end);
+        }
+    };
+    try {
+        Splitter::split(group, begin, end, grain, fn);
+    }
+    catch(...) {
+        group.wait();   //已经提交的块仍然引用fn和group，必须等它们结束
+        throw;
+    }
+    group.wait();
+}
+
+template<class F>
+void parallel_for(size_t begin, size_t end, size_t grain, const F& fn)
+{
+    parallel_for(Scheduler::getThis(), begin, end, grain, fn);
+}
+
+/**
+ * @Author: hxk
+ * @brief: 把[begin, end)切分为不超过grain的块并发计算map(chunk_begin, chunk_end)，
+ *      再从identity开始按块的顺序用combine合并，合并顺序固定，结果与串行计算一致（只要combine满足结合律）
+ * @return {T}
+ */
+template<class T, class Map, class Combine>
+T parallel_reduce(Scheduler* scheduler, size_t begin, size_t end, size_t grain,
+                  T identity, const Map& map, const Combine& combine)
+{
+    if(begin >= end) {
+        return identity;
+    }
+    grain = grain ? grain : 1;
+    size_t chunks = (end - begin + grain - 1) / grain;
+    std::vector<T> partials(chunks, identity);
+    parallel_for(scheduler, 0, chunks, 1, [&](size_t first, size_t last){
+        for(size_t i = first; i < last; i++) {
+            size_t chunk_begin = begin + i * grain;
+            partials[i] = map(chunk_begin, std::min(chunk_begin + grain, end));
+        }
+    });
+    T result = std::move(identity);
+    for(auto& partial : partials) {
+        result = combine(std::move(result), std::move(partial));
+    }
+    return result;
+}
+
+template<class T, class Map, class Combine>
+T parallel_reduce(size_t begin, size_t end, size_t grain, T identity, const Map& map, const Combine& combine)
+{
+    return parallel_reduce(Scheduler::getThis(), begin, end, grain, std::move(identity), map, combine);
+}
+
+}
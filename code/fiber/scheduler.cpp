@@ -1,4 +1,7 @@
 #include "scheduler.h"
+#include "cpu_topology.h"
+
+#include <algorithm>
 
 namespace hxk
 {
@@ -8,18 +11,175 @@ static Logger::_ptr g_logger = GET_LOGGER("system");
 static thread_local Scheduler* t_scheduler = nullptr;
 //协程调度器的调度工作协程
 static thread_local Fiber* t_scheduler_fiber = nullptr;
+//当前调度线程的本地任务队列
+static thread_local SchedulerWorker* t_worker = nullptr;
+
+//每取这么多次任务，优先检查一次全局队列
+static const uint64_t GLOBAL_QUEUE_CHECK_INTERVAL = 61;
+
+//空闲线程阻塞的最长时间（ms），超时后重新检查停止状态
+static const uint64_t MAX_IDLE_TIMEOUT = 1000;
+
+static ConfigVar<uint64_t>::_ptr g_scheduler_fiber_cache_size =
+    Config::lookUp<uint64_t>("scheduler.fiber_cache_size", 16, "max finished fibers cached per worker for reuse");
+
+static ConfigVar<uint64_t>::_ptr g_scheduler_normal_share =
+    Config::lookUp<uint64_t>("scheduler.normal_share", 8, "every N dequeues a worker checks normal priority before high");
+
+static ConfigVar<uint64_t>::_ptr g_scheduler_background_share =
+    Config::lookUp<uint64_t>("scheduler.background_share", 64, "every N dequeues a worker checks background priority first");
+
+static ConfigVar<uint64_t>::_ptr g_scheduler_queue_wait_sample =
+    Config::lookUp<uint64_t>("scheduler.queue_wait_sample", 16, "record queue wait time of every N-th task per thread, 0 disables");
+
+static ConfigVar<uint64_t>::_ptr g_scheduler_idle_spin =
+    Config::lookUp<uint64_t>("scheduler.idle_spin", 128, "spin iterations an idle worker polls for tasks before parking, 0 disables");
+
+static ConfigVar<uint64_t>::_ptr g_scheduler_grow_wait_us =
+    Config::lookUp<uint64_t>("scheduler.grow_wait_us", 2000, "queue wait that makes an elastic scheduler add a thread");
+
+static ConfigVar<uint64_t>::_ptr g_scheduler_idle_retire_ms =
+    Config::lookUp<uint64_t>("scheduler.idle_retire_ms", 5000, "idle time after which an elastic scheduler retires a thread");
+
+static ConfigVar<std::string>::_ptr g_scheduler_placement =
+    Config::lookUp<std::string>("scheduler.placement", "none", "scheduler thread placement, none, compact, spread, numa or explicit");
+
+static ConfigVar<std::string>::_ptr g_scheduler_placement_cpus =
+    Config::lookUp<std::string>("scheduler.placement_cpus", "", "cpu list for explicit placement, e.g. 0-3,8");
+
+static ConfigVar<uint64_t>::_ptr g_scheduler_time_slice_ms =
+    Config::lookUp<uint64_t>("scheduler.time_slice_ms", 0, "run time after which a task fiber is asked to yield at the next safe point, 0 disables the watchdog");
+
+static ConfigVar<uint64_t>::_ptr g_scheduler_task_pool_size =
+    Config::lookUp<uint64_t>("scheduler.task_pool_size", 1024, "max freed task nodes cached per thread for reuse");
+
+static ConfigVar<bool>::_ptr g_scheduler_edf =
+    Config::lookUp<bool>("scheduler.edf", false, "run tasks with a deadline earliest-deadline-first");
+
+static ConfigVar<int64_t>::_ptr g_scheduler_deadline_slack_ms =
+    Config::lookUp<int64_t>("scheduler.deadline_slack_ms", 0, "drop callback tasks not started within this time after their deadline, negative never drops");
+
+static uint64_t s_queue_wait_sample = 16;
+static uint64_t s_task_pool_size = 1024;
+static uint64_t s_idle_spin = 128;
+static uint64_t s_grow_wait_us = 2000;
+static uint64_t s_idle_retire_ms = 5000;
+static uint64_t s_time_slice_ms = 0;
+static int64_t s_deadline_slack_ms = 0;
+struct _SchedulerIniter
+{
+    _SchedulerIniter()
+    {
+        s_queue_wait_sample = g_scheduler_queue_wait_sample->getValue();
+        g_scheduler_queue_wait_sample->addListener([](const uint64_t& old_value, const uint64_t& new_value){
+            s_queue_wait_sample = new_value;
+        });
+        s_task_pool_size = g_scheduler_task_pool_size->getValue();
+        g_scheduler_task_pool_size->addListener([](const uint64_t& old_value, const uint64_t& new_value){
+            s_task_pool_size = new_value;
+        });
+        s_grow_wait_us = g_scheduler_grow_wait_us->getValue();
+        g_scheduler_grow_wait_us->addListener([](const uint64_t& old_value, const uint64_t& new_value){
+            s_grow_wait_us = new_value;
+        });
+        s_idle_retire_ms = g_scheduler_idle_retire_ms->getValue();
+        g_scheduler_idle_retire_ms->addListener([](const uint64_t& old_value, const uint64_t& new_value){
+            s_idle_retire_ms = new_value;
+        });
+        s_time_slice_ms = g_scheduler_time_slice_ms->getValue();
+        g_scheduler_time_slice_ms->addListener([](const uint64_t& old_value, const uint64_t& new_value){
+            s_time_slice_ms = new_value;
+        });
+        s_deadline_slack_ms = g_scheduler_deadline_slack_ms->getValue();
+        g_scheduler_deadline_slack_ms->addListener([](const int64_t& old_value, const int64_t& new_value){
+            s_deadline_slack_ms = new_value;
+        });
+        s_idle_spin = g_scheduler_idle_spin->getValue();
+        g_scheduler_idle_spin->addListener([](const uint64_t& old_value, const uint64_t& new_value){
+            s_idle_spin = new_value;
+        });
+    }
+};
+
+static _SchedulerIniter s_scheduler_initer;
+
+//截止时间堆的比较函数，截止时间晚的排在后面，堆顶为截止时间最早的任务
+struct DeadlineLater
+{
+    bool operator()(const Task* lhs, const Task* rhs) const
+    {
+        return lhs->m_deadline_us > rhs->m_deadline_us;
+    }
+};
 
-Scheduler::Scheduler(size_t thread_size, bool use_caller, std::string name):m_name(name),
+//每个线程缓存已经释放的Task节点，节点的前8个字节用作链表指针
+//链表本身是平凡类型，线程退出时由TaskFreeListGuard释放，此后释放的节点直接归还给系统
+static thread_local void* t_task_free_list = nullptr;
+static thread_local size_t t_task_free_size = 0;
+static thread_local bool t_task_free_closed = false;
+
+struct TaskFreeListGuard
+{
+    ~TaskFreeListGuard()
+    {
+        while(t_task_free_list) {
+            void* next = *static_cast<void**>(t_task_free_list);
+            ::operator delete(t_task_free_list);
+            t_task_free_list = next;
+        }
+        t_task_free_size = 0;
+        t_task_free_closed = true;
+    }
+};
+static thread_local TaskFreeListGuard t_task_free_guard;
+
+Scheduler::Scheduler(size_t thread_size, bool use_caller, std::string name, size_t max_thread_size):m_name(name),
+                                                                        m_root_thread_id(0),
                                                                         m_active_thread_count(0),
                                                                         m_free_thread_count(0),
                                                                         m_stopped(true),
                                                                         m_auto_stopped(false),
-                                                                        m_root_thread_id(0)
+                                                                        m_fiber_cache_hit(0),
+                                                                        m_fiber_cache_miss(0),
+                                                                        m_queued_count(0),
+                                                                        m_pinned_count(0),
+                                                                        m_class_count(),
+                                                                        m_spinning_count(0),
+                                                                        m_root_worker(nullptr),
+                                                                        m_last_grow_ms(0),
+                                                                        m_placement(PLACEMENT_NONE),
+                                                                        m_watchdog_semaphore(0),
+                                                                        m_watchdog_stop(false),
+                                                                        m_preempt_count(0),
+                                                                        m_deadline_mode(g_scheduler_edf->getValue()),
+                                                                        m_deadline_count(0),
+                                                                        m_dropped_count(0),
+                                                                        m_late_count(0)
 {
+    std::string placement = g_scheduler_placement->getValue();
+    if(placement == "compact") {
+        m_placement = PLACEMENT_COMPACT;
+    }
+    else if(placement == "spread") {
+        m_placement = PLACEMENT_SPREAD;
+    }
+    else if(placement == "numa") {
+        m_placement = PLACEMENT_NUMA;
+    }
+    else if(placement == "explicit") {
+        m_placement = PLACEMENT_EXPLICIT;
+        m_placement_cpus = CpuTopologyImpl::parseCpuList(g_scheduler_placement_cpus->getValue());
+    }
     assert(thread_size > 0);
+    max_thread_size = std::max(thread_size, max_thread_size);
+    //按最大线程数量创建本地队列，扩容时只需要创建线程，其他线程遍历m_workers时不需要加锁
+    for(size_t i = 0; i < max_thread_size; i++) {
+        m_workers.emplace_back(new SchedulerWorker(this));
+    }
     if(use_caller) {
         Fiber::getThis();   //实例化此类的线程作为master fiber
         --thread_size;      //线程池需要的线程数减1
+        --max_thread_size;
 
         assert(getThis() == nullptr);   //确保该线程下只有一个调度器
         t_scheduler = this;
@@ -31,13 +191,18 @@ Scheduler::Scheduler(size_t thread_size, bool use_caller, std::string name):m_na
 
         t_scheduler_fiber = m_root_fiber.get();
         m_root_thread_id = GetThreadID();
-        m_thread_id_list.push_back(m_root_thread_id);
+        m_root_worker = m_workers.back().get();
+        m_root_worker->m_thread_id = m_root_thread_id;
+        m_root_worker->m_idle_state = SchedulerWorker::RUNNING;
     }
     else
     {
         m_root_thread_id = -1;
     }
     m_thread_count = thread_size;
+    m_max_thread_count = max_thread_size;
+    m_min_thread_count = thread_size;
+    m_auto_max_thread_count = max_thread_size;
 }
 
 Scheduler::~Scheduler()
@@ -47,6 +212,18 @@ Scheduler::~Scheduler()
     if(getThis() ==  this) {
         t_scheduler = nullptr;
     }
+    for(auto& worker : m_workers) {
+        for(int i = 0; i < PRIORITY_COUNT; i++) {
+            Task* task = nullptr;
+            while(worker->m_queues[i].take(task)) {
+                delete task;
+            }
+            worker->m_mailbox[i].clear();
+        }
+    }
+    for(Task* task : m_deadline_heap) {
+        delete task;
+    }
 }
 
 void Scheduler::start() //创建线程池
@@ -58,12 +235,18 @@ void Scheduler::start() //创建线程池
             return;     //调度器已经开始工作
         }
         m_stopped = false;
-        assert(m_thread_list.empty());
-        m_thread_list.resize(m_thread_count);
-        for(size_t i = 0; i < m_thread_count; i++) {
-            m_thread_list[i] = std::make_shared<Thread>(std::bind(&Scheduler::run, this), m_name + "_" + std::to_string(i));
-            m_thread_id_list.push_back(m_thread_list[i]->getID());
-        }
+    }
+    ScopedLock lock(&m_resize_mutex);
+    assert(m_thread_list.empty());
+    m_thread_list.resize(m_max_thread_count);
+    size_t thread_count = m_thread_count;
+    m_thread_count = 0;     //由spawnWorker计数
+    for(size_t i = 0; i < thread_count; i++) {
+        spawnWorker(m_workers[i].get());
+    }
+    if(s_time_slice_ms > 0 && !m_watchdog) {
+        m_watchdog_stop = false;
+        m_watchdog = std::make_shared<Thread>(std::bind(&Scheduler::watchdog, this), m_name + "_watchdog");
     }
 }
 
@@ -75,12 +258,20 @@ void Scheduler::stop()
     //use_caller为true，并且指定线程数量为1时，说明只有一条主线程在运行，简单等待执行结束即可
     if(m_root_fiber && m_thread_count == 0 && (m_root_fiber->finish() || m_root_fiber->getState() == Fiber::INIT)) {
         m_stopped = true;
+        stopWatchdog();
         if(onStop()) {      //用户自定义的回调函数来结束停止过程
             return;
         }
     }
 
-    m_stopped = true;
+    {
+        //持有m_resize_mutex设置停止状态，之后不会再有线程被创建
+        ScopedLock lock(&m_resize_mutex);
+        m_stopped = true;
+    }
+    for(auto& worker : m_workers) {
+        tickle(worker.get());
+    }
     for(size_t i=0; i< m_thread_count; i++) {
         tickle();
     }
@@ -92,10 +283,13 @@ void Scheduler::stop()
     }
     {
         for(auto &t : m_thread_list) {
-            t->join();
+            if(t) {
+                t->join();
+            }
         }
         m_thread_list.clear();
     }
+    stopWatchdog();
     if(onStop()) {
         return;
     }
@@ -107,10 +301,343 @@ bool Scheduler::hasFreeThread()
     return m_free_thread_count > 0;
 }
 
+uint64_t Scheduler::getFiberCacheHits() const
+{
+    return m_fiber_cache_hit;
+}
+
+uint64_t Scheduler::getFiberCacheMisses() const
+{
+    return m_fiber_cache_miss;
+}
+
+size_t Scheduler::getGlobalQueueDepth() const
+{
+    ScopedLock lock(&m_mutex);
+    size_t depth = 0;
+    for(auto& task_list : m_task_lists) {
+        depth += task_list.size();
+    }
+    return depth;
+}
+
+size_t Scheduler::getQueueDepth(TaskPriority priority) const
+{
+    return m_class_count[priority];
+}
+
+std::vector<uint64_t> Scheduler::getQueueWaitHistogram(TaskPriority priority) const
+{
+    std::vector<uint64_t> histogram(SchedulerWorker::QUEUE_WAIT_BUCKETS, 0);
+    for(auto& worker : m_workers) {
+        for(size_t i = 0; i < SchedulerWorker::QUEUE_WAIT_BUCKETS; i++) {
+            histogram[i] += worker->m_wait_histogram[priority][i].load(std::memory_order_relaxed);
+        }
+    }
+    return histogram;
+}
+
+std::vector<size_t> Scheduler::getLocalQueueDepths() const
+{
+    std::vector<size_t> depths;
+    depths.reserve(m_workers.size());
+    for(auto& worker : m_workers) {
+        size_t depth = 0;
+        for(auto& queue : worker->m_queues) {
+            depth += queue.size();
+        }
+        depths.push_back(depth);
+    }
+    return depths;
+}
+
+uint64_t Scheduler::getStealCount() const
+{
+    uint64_t count = 0;
+    for(auto& worker : m_workers) {
+        count += worker->m_steal_count;
+    }
+    return count;
+}
+
+uint64_t Scheduler::getPreemptCount() const
+{
+    return m_preempt_count;
+}
+
+void Scheduler::setDeadlineMode(bool enable)
+{
+    //关闭后堆中剩余的任务仍会被取出，新任务不再放入
+    m_deadline_mode = enable;
+}
+
+bool Scheduler::isDeadlineMode() const
+{
+    return m_deadline_mode;
+}
+
+uint64_t Scheduler::getDroppedCount() const
+{
+    return m_dropped_count;
+}
+
+uint64_t Scheduler::getLateCount() const
+{
+    return m_late_count;
+}
+
+void Scheduler::setThreadRange(size_t min_thread_size, size_t max_thread_size)
+{
+    size_t root = m_root_worker ? 1 : 0;
+    max_thread_size = std::min(std::max(max_thread_size, root + 1) - root, m_max_thread_count);
+    min_thread_size = std::min(std::max(min_thread_size, root + 1) - root, max_thread_size);
+    m_min_thread_count = min_thread_size;
+    m_auto_max_thread_count = max_thread_size;
+}
+
+void Scheduler::resize(size_t thread_size)
+{
+    size_t root = m_root_worker ? 1 : 0;
+    size_t target = std::min(std::max(thread_size, root + 1) - root, m_max_thread_count);
+    ScopedLock lock(&m_resize_mutex);
+    if(m_stopped) {
+        return;
+    }
+    for(size_t i = 0; i < m_max_thread_count && m_thread_count < target; i++) {
+        SchedulerWorker* worker = m_workers[i].get();
+        if(worker->m_idle_state == SchedulerWorker::RETIRED) {
+            spawnWorker(worker);
+        }
+        else if(worker->m_retiring.exchange(false)) {
+            ++m_thread_count;   //还没有退出的线程，取消退出
+        }
+    }
+    //从后往前选择要退出的线程，扩容时优先复用前面的槽位
+    for(size_t i = m_max_thread_count; i > 0 && m_thread_count > target; i--) {
+        SchedulerWorker* worker = m_workers[i - 1].get();
+        if(worker->m_idle_state == SchedulerWorker::RETIRED || worker->m_retiring) {
+            continue;
+        }
+        worker->m_retiring = true;
+        --m_thread_count;
+        tickle(worker);
+    }
+}
+
+size_t Scheduler::getThreadCount() const
+{
+    return m_thread_count + (m_root_worker ? 1 : 0);
+}
+
+std::vector<long> Scheduler::getThreadIds() const
+{
+    std::vector<long> ids;
+    for(auto& worker : m_workers) {
+        if(worker->m_idle_state != SchedulerWorker::RETIRED && !worker->m_retiring && worker->m_thread_id != -1) {
+            ids.push_back(worker->m_thread_id);
+        }
+    }
+    return ids;
+}
+
+void Scheduler::spawnWorker(SchedulerWorker* worker)
+{
+    size_t index = 0;
+    while(m_workers[index].get() != worker) {
+        ++index;
+    }
+    if(m_thread_list[index]) {
+        m_thread_list[index]->join();   //该槽位之前的线程已经退出
+    }
+    worker->m_retiring = false;
+    worker->m_idle_since = 0;
+    worker->m_idle_state = SchedulerWorker::RUNNING;
+    m_thread_list[index] = std::make_shared<Thread>([this, worker](){
+        if(Thread::getThisNode() >= 0) {
+            //本地队列由构造函数所在的线程分配，迁移到调度线程所在的节点
+            CpuTopologyImpl::bindMemory(worker, sizeof(SchedulerWorker), Thread::getThisNode());
+        }
+        t_worker = worker;
+        run();
+    }, m_name + "_" + std::to_string(index), getWorkerAttr(index));
+    long thread_id = m_thread_list[index]->getID();
+    worker->m_thread_id = thread_id;
+    {
+        ScopedLock lock(&m_mutex);
+        m_retired_thread_ids.erase(thread_id);  //线程id可能被系统复用
+    }
+    ++m_thread_count;
+}
+
+ThreadAttr Scheduler::getWorkerAttr(size_t index) const
+{
+    ThreadAttr attr = m_thread_attr;
+    if(m_placement == PLACEMENT_NONE) {
+        return attr;
+    }
+    CpuTopologyImpl* topology = CpuTopology::GetInstance();
+    const std::vector<int>* cpus = nullptr;
+    switch(m_placement) {
+        case PLACEMENT_COMPACT:
+            cpus = &topology->getCompactOrder();
+            break;
+        case PLACEMENT_SPREAD:
+            cpus = &topology->getSpreadOrder();
+            break;
+        case PLACEMENT_NUMA:
+            if(topology->getNodeCount() > 0) {
+                attr.m_cpus = topology->getNodeCpus(topology->getNodes()[index % topology->getNodeCount()]);
+            }
+            return attr;
+        default:
+            cpus = &m_placement_cpus;
+            break;
+    }
+    attr.m_cpus.clear();
+    if(!cpus->empty()) {
+        attr.m_cpus.push_back((*cpus)[index % cpus->size()]);
+    }
+    return attr;
+}
+
+void Scheduler::setPlacement(PlacementPolicy policy, const std::vector<int>& cpus)
+{
+    ScopedLock lock(&m_resize_mutex);
+    m_placement = policy;
+    m_placement_cpus = cpus;
+}
+
+void Scheduler::setThreadAttr(const ThreadAttr& attr)
+{
+    ScopedLock lock(&m_resize_mutex);
+    m_thread_attr = attr;
+}
+
+void* SchedulerWorker::operator new(size_t size)
+{
+    static const size_t s_page_size = sysconf(_SC_PAGESIZE);
+    void* ptr = nullptr;
+    if(posix_memalign(&ptr, s_page_size, (size + s_page_size - 1) / s_page_size * s_page_size)) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void SchedulerWorker::operator delete(void* ptr)
+{
+    free(ptr);
+}
+
+void Scheduler::maybeGrow(uint64_t wait_us)
+{
+    static const uint64_t GROW_INTERVAL_MS = 100;   //两次自动扩容的最小间隔
+    if(m_thread_count >= m_auto_max_thread_count || m_free_thread_count > 0 || wait_us < s_grow_wait_us) {
+        return;
+    }
+    uint64_t now = GetCurrentMS();
+    uint64_t last = m_last_grow_ms;
+    if(now - last < GROW_INTERVAL_MS || !m_last_grow_ms.compare_exchange_strong(last, now)) {
+        return;
+    }
+    ScopedLock lock(&m_resize_mutex);
+    if(m_stopped || m_thread_count >= m_auto_max_thread_count) {
+        return;
+    }
+    for(auto& worker : m_workers) {
+        if(worker->m_idle_state == SchedulerWorker::RETIRED && worker.get() != m_root_worker) {
+            LOG_FORMAT_INFO(g_logger, "scheduler %s grows to %lu threads, queue wait = %lu us",
+                            m_name.c_str(), m_thread_count + 1, wait_us);
+            spawnWorker(worker.get());
+            return;
+        }
+    }
+}
+
+bool Scheduler::checkRetire(SchedulerWorker* worker)
+{
+    if(worker == m_root_worker || m_stopped) {
+        return false;
+    }
+    if(!worker->m_retiring) {
+        //自动缩容：连续空闲足够久，并且线程数多于最小值
+        if(m_min_thread_count >= m_auto_max_thread_count || worker->m_idle_since == 0 ||
+                GetCurrentMS() - worker->m_idle_since < s_idle_retire_ms) {
+            return false;
+        }
+        if(Fiber::hasBoundFibers()) {
+            return false;
+        }
+        size_t count = m_thread_count;
+        do {
+            if(count <= m_min_thread_count) {
+                return false;
+            }
+        } while(!m_thread_count.compare_exchange_weak(count, count - 1));
+        worker->m_retiring = true;
+        LOG_FORMAT_INFO(g_logger, "scheduler %s shrinks to %lu threads", m_name.c_str(), count - 1);
+    }
+    //共享栈协程只能在当前线程恢复，等它们全部结束后才能退出
+    if(Fiber::hasBoundFibers()) {
+        return false;
+    }
+    ScopedLock lock(&m_resize_mutex);
+    if(!worker->m_retiring) {
+        return false;   //已经被resize取消
+    }
+    retireWorker(worker);
+    return true;
+}
+
+void Scheduler::retireWorker(SchedulerWorker* worker)
+{
+    long thread_id = worker->m_thread_id;
+    std::vector<Task::_uptr> tasks;
+    {
+        //设置为RETIRED之后不会再有任务放入mailbox
+        ScopedSpinLock lock(&worker->m_mailbox_lock);
+        worker->m_idle_state = SchedulerWorker::RETIRED;
+        for(auto& mailbox : worker->m_mailbox) {
+            while(!mailbox.empty()) {
+                tasks.push_back(mailbox.remove(nullptr, mailbox.front()));
+                --worker->m_mailbox_size;
+            }
+        }
+    }
+    for(auto& queue : worker->m_queues) {
+        Task* local = nullptr;
+        while(queue.pop(local)) {
+            tasks.emplace_back(local);
+        }
+    }
+    {
+        ScopedLock lock(&m_mutex);
+        m_retired_thread_ids.insert(thread_id);
+        //绑定到该线程的任务改为可以在任意线程执行
+        for(auto& task_list : m_task_lists) {
+            for(Task* node = task_list.front(); node; node = node->m_next) {
+                if(node->m_thread_id == thread_id) {
+                    node->m_thread_id = -1;
+                    --m_pinned_count;
+                }
+            }
+        }
+        for(auto& task : tasks) {
+            if(task->m_thread_id == thread_id) {
+                task->m_thread_id = -1;
+                --m_pinned_count;
+            }
+            m_task_lists[task->m_priority].push_back(std::move(task));  //仍然计入m_queued_count
+        }
+    }
+    if(!tasks.empty()) {
+        tickle();
+    }
+}
+
 bool Scheduler::isStop()
 {
-    //任务列表没有新任务，也没有正在执行的任务，说明调度器已经停止工作
-    return m_auto_stopped && m_task_list.empty() && m_active_thread_count == 0;
+    //任务队列没有新任务，也没有正在执行的任务，说明调度器已经停止工作
+    return m_auto_stopped && m_queued_count == 0 && m_active_thread_count == 0;
 }
 
 Scheduler* Scheduler::getThis()
@@ -123,6 +650,76 @@ Fiber* Scheduler::getMainFiber()
     return t_scheduler_fiber;
 }
 
+bool Scheduler::maybeYield()
+{
+    SchedulerWorker* worker = t_worker;
+    if(!worker) {
+        return false;
+    }
+    uint64_t tick = worker->m_run_tick.load(std::memory_order_relaxed);
+    //tick为奇数说明当前执行的是任务协程，而不是调度协程或空闲协程
+    if(!(tick & 1) || worker->m_preempt_tick.load(std::memory_order_relaxed) != tick) {
+        return false;
+    }
+    //先清除让出请求，日志输出经过hook的系统调用时不会再次进入这里
+    worker->m_preempt_tick.store(~0ull, std::memory_order_relaxed);
+    Fiber* fiber = Fiber::getThis().get();
+    LOG_FORMAT_WARN(g_logger, "fiber %lu exceeded time slice %lu ms, yield at:\n%s",
+                    fiber->getId(), s_time_slice_ms, BackTraceToString(16, 3).c_str());
+    //以READY状态回到调度协程，由run重新放入队列
+    worker->m_preempted = true;
+    fiber->m_state = Fiber::READY;
+    fiber->swapOut();
+    return true;
+}
+
+void Scheduler::watchdog()
+{
+    while(true) {
+        uint64_t slice = s_time_slice_ms;
+        //检查间隔为时间片的1/4，协程最多执行1.25个时间片才会被要求让出
+        uint64_t interval = slice ? std::max<uint64_t>(slice / 4, 1) : MAX_IDLE_TIMEOUT;
+        m_watchdog_semaphore.waitFor(interval);
+        if(m_watchdog_stop) {
+            break;
+        }
+        if(slice == 0) {
+            continue;   //运行时关闭了时间片
+        }
+        uint64_t now = GetCurrentMS();
+        for(auto& worker : m_workers) {
+            uint64_t tick = worker->m_run_tick.load(std::memory_order_relaxed);
+            if(tick != worker->m_watch_tick) {
+                worker->m_watch_tick = tick;
+                worker->m_watch_since_ms = now;
+                continue;
+            }
+            if((tick & 1) && now - worker->m_watch_since_ms >= slice &&
+                    worker->m_preempt_tick.load(std::memory_order_relaxed) != tick) {
+                worker->m_preempt_tick.store(tick, std::memory_order_relaxed);
+                ++m_preempt_count;
+                LOG_FORMAT_WARN(g_logger, "scheduler %s: thread %ld has run one fiber for %lu ms, asking it to yield",
+                                m_name.c_str(), worker->m_thread_id.load(), now - worker->m_watch_since_ms);
+            }
+        }
+    }
+}
+
+void Scheduler::stopWatchdog()
+{
+    if(m_watchdog) {
+        m_watchdog_stop = true;
+        m_watchdog_semaphore.notify();
+        m_watchdog->join();
+        m_watchdog.reset();
+    }
+}
+
+SchedulerWorker* Scheduler::getThisWorker()
+{
+    return t_worker;
+}
+
 
 void Scheduler::run()
 {
@@ -135,66 +732,104 @@ void Scheduler::run()
         t_scheduler_fiber = Fiber::getThis().get(); //当前线程不存在master fiber，创建一个,与fiber类中的master fiber共享一个fiber
     }
 
+    //线程池中的线程在启动时已经设置了本地队列，use_caller的主线程使用最后一个
+    if(!t_worker || t_worker->m_scheduler != this) {
+        t_worker = m_root_worker;
+    }
+    SchedulerWorker* worker = t_worker;
+    worker->m_thread_id = GetThreadID();
+    worker->m_normal_share = g_scheduler_normal_share->getValue();
+    worker->m_background_share = g_scheduler_background_share->getValue();
+
     //线程空闲时执行的协程
     auto free_fiber = std::make_shared<Fiber>(std::bind(&Scheduler::onFree,this));
 
+    //已经执行结束的callback协程，callback任务优先复用其中的协程
+    std::vector<Fiber::_ptr> fiber_cache;
+    const size_t fiber_cache_size = g_scheduler_fiber_cache_size->getValue();
+    fiber_cache.reserve(fiber_cache_size);
+
     Task task;  //开始调度
     while(true) {
         task.reset();
+        if(worker->m_idle_state == SchedulerWorker::RETIRED) {
+            break;  //缩容退出，剩余的任务已经转入全局队列
+        }
 
-        bool tickle_me = false;
-        //查找等待调度的task
-        {
-            ScopedLock lock(&m_mutex);
-            auto iter = m_task_list.begin();
-            while(iter != m_task_list.end()) {
-
-                //任务需要在指定线程运行，但是不是当前线程
-                if((*iter)->m_thread_id != -1 && (*iter)->m_thread_id != GetThreadID()) {
-                    ++iter;
-                    tickle_me = true;
-                    continue;
-                }
-                assert((*iter)->m_fiber || (*iter)->m_callback);
-                //任务为fiber，但是正在执行
-                if((*iter)->m_fiber && (*iter)->m_fiber->getState() == Fiber::EXEC) {
-                    ++iter;
-                    continue;
-                }
-
-                task = **iter;  //找到可执行的任务，拷贝一份
-                ++m_active_thread_count;
-                m_task_list.erase(iter);
-                break;
+        if(takeTask(worker, task)) {
+            worker->m_idle_since = 0;
+            if(task.m_enqueue_us) {
+                maybeGrow(GetCurrentUS() - task.m_enqueue_us);
             }
         }
-        if(tickle_me) {//存在需要唤醒的任务
-            tickle();
+        else if(worker->m_idle_since == 0) {
+            worker->m_idle_since = GetCurrentMS();
         }
-        if(task.m_callback) {   //为callback任务，为其创建task
-            task.m_fiber = std::make_shared<Fiber>(std::move(task.m_callback));
+        if(task.m_callback && task.m_shared_stack) {
+            //共享栈协程不需要分配栈，直接创建
+            task.m_fiber = std::make_shared<Fiber>(std::move(task.m_callback), 0, false, true);
             task.m_callback = nullptr;
         }
+        else if(task.m_callback) {   //为callback任务，为其创建task
+            if(!fiber_cache.empty()) {
+                task.m_fiber = std::move(fiber_cache.back());
+                fiber_cache.pop_back();
+                task.m_fiber->reset(std::move(task.m_callback));
+                ++m_fiber_cache_hit;
+            }
+            else {
+                task.m_fiber = std::make_shared<Fiber>(std::move(task.m_callback));
+                task.m_fiber->m_recyclable = true;
+                ++m_fiber_cache_miss;
+            }
+            task.m_callback = nullptr;
+        }
+        if(task.m_fiber && task.m_deadline_us) {
+            task.m_fiber->m_deadline_us = task.m_deadline_us;  //之后创建的定时器、注册的事件和唤醒都带有该截止时间
+        }
         if(task.m_fiber && !task.m_fiber->finish()) {
             //m_root_thread_id等于当前线程id，说明use_caller为true
             //使用m_root_fiber作为master fiber
+            worker->m_run_tick.store(worker->m_run_tick.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
             if(GetThreadID() == m_root_thread_id) {
                 task.m_fiber->swapIn();
             }
             else {
                 task.m_fiber->swapIn();
             }
-
-            --m_active_thread_count;
+            worker->m_run_tick.store(worker->m_run_tick.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
 
             Fiber::STATE fiber_status = task.m_fiber->getState();
-            if(fiber_status == Fiber::READY) {
-                schedule(std::move(task.m_fiber), task.m_thread_id);
+            if(fiber_status == Fiber::READY && worker->m_preempted) {
+                //放入全局队列，本地队列优先于全局队列，放回本地队列会马上被再次取出
+                worker->m_preempted = false;
+                Task::_uptr preempted = makeTask(std::move(task.m_fiber), task.m_thread_id, false, task.m_priority);
+                bool need_tickle = false;
+                {
+                    ScopedLock lock(&m_mutex);
+                    need_tickle = scheduleNonBlock(std::move(preempted));
+                }
+                if(need_tickle) {
+                    tickle();
+                }
+            }
+            else if(fiber_status == Fiber::READY) {
+                schedule(std::move(task.m_fiber), task.m_thread_id, task.m_priority);
             }
             else if(fiber_status != Fiber::EXCEPTION && fiber_status != Fiber::TERM) {
                 task.m_fiber->m_state = Fiber::HOLD;
             }
+            else if(task.m_fiber->m_recyclable && task.m_fiber.use_count() == 1 &&
+                    fiber_cache.size() < fiber_cache_size) {
+                //没有其他地方持有该协程，可以安全地复用
+                fiber_cache.push_back(std::move(task.m_fiber));
+            }
             task.reset();
+            //重新放入队列之后才减少活跃数，避免isStop在两者之间误判为空闲
+            --m_active_thread_count;
+        }
+        else if(task.m_fiber) {
+            --m_active_thread_count;    //已经执行结束的协程被重复调度，直接丢弃
         }
         else {
             if(free_fiber->finish()) {
@@ -208,12 +843,366 @@ void Scheduler::run()
             }
         }
     }   
+    t_worker = nullptr;
     LOG_DEBUG(g_logger, "Scheduler::run() end");
 }
 
+void* Task::operator new(size_t size)
+{
+    assert(size == sizeof(Task));
+    if(t_task_free_list) {
+        void* ptr = t_task_free_list;
+        t_task_free_list = *static_cast<void**>(ptr);
+        --t_task_free_size;
+        return ptr;
+    }
+    return ::operator new(size);
+}
+
+void Task::operator delete(void* ptr) noexcept
+{
+    if(!ptr) {
+        return;
+    }
+    if(t_task_free_closed || t_task_free_size >= s_task_pool_size) {
+        ::operator delete(ptr);
+        return;
+    }
+    (void)&t_task_free_guard;   //第一次放入时构造，线程退出时释放链表
+    *static_cast<void**>(ptr) = t_task_free_list;
+    t_task_free_list = ptr;
+    ++t_task_free_size;
+}
+
+uint64_t Scheduler::stampEnqueueTime()
+{
+    //取时间的开销和调度一个任务相当，只采样一部分任务
+    static thread_local uint64_t t_enqueue_count = 0;
+    uint64_t sample = s_queue_wait_sample;
+    if(sample == 0 || ++t_enqueue_count % sample != 0) {
+        return 0;
+    }
+    return GetCurrentUS();
+}
+
+SchedulerWorker* Scheduler::findWorker(long thread_id) const
+{
+    for(auto& worker : m_workers) {
+        if(worker->m_thread_id == thread_id) {
+            return worker.get();
+        }
+    }
+    return nullptr;
+}
+
+bool Scheduler::scheduleToWorker(SchedulerWorker* worker, Task::_uptr& task)
+{
+    {
+        ScopedSpinLock lock(&worker->m_mailbox_lock);
+        if(worker->m_idle_state == SchedulerWorker::RETIRED) {
+            return false;   //线程已经退出，mailbox不会再被检查
+        }
+        ++m_pinned_count;
+        ++m_queued_count;
+        ++m_class_count[task->m_priority];
+        worker->m_mailbox[task->m_priority].push_back(std::move(task));
+        ++worker->m_mailbox_size;
+    }
+    //目标线程正在运行时，会在下一次取任务时检查mailbox
+    if(worker != t_worker) {
+        tickle(worker);
+    }
+    return true;
+}
+
+void Scheduler::scheduleDeadline(Task::_uptr task)
+{
+    bool need_tickle = false;
+    {
+        ScopedSpinLock lock(&m_deadline_lock);
+        need_tickle = m_deadline_heap.empty();
+        ++m_queued_count;
+        ++m_class_count[task->m_priority];
+        ++m_deadline_count;
+        m_deadline_heap.push_back(task.release());
+        std::push_heap(m_deadline_heap.begin(), m_deadline_heap.end(), DeadlineLater());
+    }
+    if(need_tickle) {
+        tickle();
+    }
+}
+
+bool Scheduler::hasTask(SchedulerWorker* worker) const
+{
+    return worker->m_mailbox_size > 0 || m_queued_count > m_pinned_count;
+}
+
+bool Scheduler::takeTask(SchedulerWorker* worker, Task& task)
+{
+    //默认高优先级优先，定期让低优先级先被检查，保证它们至少能分到一定比例的执行机会
+    uint64_t tick = ++worker->m_tick;
+    TaskPriority order[PRIORITY_COUNT] = {PRIORITY_HIGH, PRIORITY_NORMAL, PRIORITY_BACKGROUND};
+    if(worker->m_background_share && tick % worker->m_background_share == 0) {
+        order[0] = PRIORITY_BACKGROUND;
+        order[1] = PRIORITY_NORMAL;
+        order[2] = PRIORITY_HIGH;
+    }
+    else if(worker->m_normal_share && tick % worker->m_normal_share == 0) {
+        order[0] = PRIORITY_NORMAL;
+        order[1] = PRIORITY_HIGH;
+    }
+    //本地队列不断产生新任务时，定期优先检查全局队列，避免其中的任务饿死
+    bool global_first = (tick % GLOBAL_QUEUE_CHECK_INTERVAL) == 0;
+    //截止时间堆先于所有优先级，但在定期检查低优先级和全局队列时放到最后，没有截止时间的任务同样不会饿死
+    bool deadline_first = !global_first && order[0] == PRIORITY_HIGH;
+    if(deadline_first && m_deadline_count > 0 && takeDeadlineTask(worker, task)) {
+        return true;
+    }
+
+    for(TaskPriority priority : order) {
+        if(m_class_count[priority] == 0) {
+            continue;
+        }
+        //绑定到当前线程的任务只能由当前线程执行，优先检查
+        if(worker->m_mailbox_size > 0 && takeMailboxTask(worker, priority, task)) {
+            return true;
+        }
+        if(global_first && takeGlobalTask(worker, priority, task)) {
+            return true;
+        }
+        //本地队列同样按先进先出取出，保证让出执行权的协程不会一直被优先调度
+        Task* local = nullptr;
+        if(worker->m_queues[priority].take(local) && acceptLocalTask(worker, local, task)) {
+            return true;
+        }
+        if(!global_first && takeGlobalTask(worker, priority, task)) {
+            return true;
+        }
+        if(stealTask(worker, priority, task)) {
+            return true;
+        }
+    }
+    if(!deadline_first && m_deadline_count > 0 && takeDeadlineTask(worker, task)) {
+        return true;
+    }
+    return false;
+}
+
+bool Scheduler::takeMailboxTask(SchedulerWorker* worker, TaskPriority priority, Task& task)
+{
+    ScopedSpinLock lock(&worker->m_mailbox_lock);
+    auto& mailbox = worker->m_mailbox[priority];
+    for(Task *prev = nullptr, *node = mailbox.front(); node; prev = node, node = node->m_next) {
+        //协程被唤醒时可能还没有完成切换
+        if(node->m_fiber && node->m_fiber->getState() == Fiber::EXEC) {
+            continue;
+        }
+        task = std::move(*mailbox.remove(prev, node));
+        --worker->m_mailbox_size;
+        --m_pinned_count;
+        onTaskTaken(worker, task);
+        return true;
+    }
+    return false;
+}
+
+bool Scheduler::takeGlobalTask(SchedulerWorker* worker, TaskPriority priority, Task& task)
+{
+    ScopedLock lock(&m_mutex);
+    auto& task_list = m_task_lists[priority];
+    for(Task *prev = nullptr, *node = task_list.front(); node; prev = node, node = node->m_next) {
+
+        //任务需要在指定线程运行，但是不是当前线程
+        if(node->m_thread_id != -1 && node->m_thread_id != GetThreadID()) {
+            continue;
+        }
+        assert(node->m_fiber || node->m_callback);
+        //任务为fiber，但是正在执行
+        if(node->m_fiber && node->m_fiber->getState() == Fiber::EXEC) {
+            continue;
+        }
+
+        if(node->m_thread_id != -1) {
+            --m_pinned_count;
+        }
+        task = std::move(*task_list.remove(prev, node));   //找到可执行的任务
+        onTaskTaken(worker, task);
+        return true;
+    }
+    return false;
+}
+
+bool Scheduler::takeDeadlineTask(SchedulerWorker* worker, Task& task)
+{
+    TaskQueue dropped;      //在锁外释放，回调持有的资源可能需要较长时间析构
+    bool found = false;
+    {
+        ScopedSpinLock lock(&m_deadline_lock);
+        Task* busy = nullptr;   //还没有完成切换的协程，取完之后放回堆中
+        int64_t slack_ms = s_deadline_slack_ms;
+        uint64_t now = m_deadline_heap.empty() ? 0 : GetCurrentUS();
+        while(!m_deadline_heap.empty()) {
+            std::pop_heap(m_deadline_heap.begin(), m_deadline_heap.end(), DeadlineLater());
+            Task* node = m_deadline_heap.back();
+            m_deadline_heap.pop_back();
+            if(node->m_fiber && node->m_fiber->getState() == Fiber::EXEC) {
+                node->m_next = busy;
+                busy = node;
+                continue;
+            }
+            --m_deadline_count;
+            if(now > node->m_deadline_us) {
+                if(node->m_callback && slack_ms >= 0 && now - node->m_deadline_us > (uint64_t)slack_ms * 1000) {
+                    dropped.push_back(Task::_uptr(node));
+                    continue;
+                }
+                ++m_late_count;
+            }
+            task = std::move(*node);
+            delete node;
+            found = true;
+            break;
+        }
+        while(busy) {
+            Task* next = busy->m_next;
+            busy->m_next = nullptr;
+            m_deadline_heap.push_back(busy);
+            std::push_heap(m_deadline_heap.begin(), m_deadline_heap.end(), DeadlineLater());
+            busy = next;
+        }
+    }
+    for(Task* node = dropped.front(); node; node = node->m_next) {
+        --m_queued_count;
+        --m_class_count[node->m_priority];
+        ++m_dropped_count;
+    }
+    if(!dropped.empty()) {
+        LOG_FORMAT_DEBUG(g_logger, "scheduler %s: dropped %lu tasks past deadline", m_name.c_str(), dropped.size());
+    }
+    if(found) {
+        onTaskTaken(worker, task);
+    }
+    return found;
+}
+
+bool Scheduler::stealTask(SchedulerWorker* worker, TaskPriority priority, Task& task)
+{
+    //从不同的位置开始窃取，避免所有空闲线程都去窃取同一个线程
+    size_t count = m_workers.size();
+    size_t start = worker->m_tick % count;
+    for(size_t i = 0; i < count; i++) {
+        SchedulerWorker* victim = m_workers[(start + i) % count].get();
+        Task* local = nullptr;
+        if(victim == worker || !victim->m_queues[priority].take(local)) {
+            continue;
+        }
+        ++worker->m_steal_count;
+        if(acceptLocalTask(worker, local, task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Scheduler::acceptLocalTask(SchedulerWorker* worker, Task* local, Task& task)
+{
+    Task::_uptr owned(local);
+    if(owned->m_fiber && owned->m_fiber->getState() == Fiber::EXEC) {
+        //协程还没有完成切换，转入全局队列，切换完成后再由扫描全局队列的线程执行
+        ScopedLock lock(&m_mutex);
+        m_task_lists[owned->m_priority].push_back(std::move(owned));
+        return false;
+    }
+    task = std::move(*owned);
+    onTaskTaken(worker, task);
+    return true;
+}
+
+void Scheduler::onTaskTaken(SchedulerWorker* worker, const Task& task)
+{
+    ++m_active_thread_count;
+    --m_queued_count;
+    --m_class_count[task.m_priority];
+    if(task.m_enqueue_us == 0) {
+        return;
+    }
+
+    uint64_t wait_us = GetCurrentUS() - task.m_enqueue_us;
+    size_t bucket = wait_us == 0 ? 0 : 64 - __builtin_clzll(wait_us);
+    if(bucket >= SchedulerWorker::QUEUE_WAIT_BUCKETS) {
+        bucket = SchedulerWorker::QUEUE_WAIT_BUCKETS - 1;
+    }
+    //只有所属线程修改，不需要原子的读改写
+    auto& counter = worker->m_wait_histogram[task.m_priority][bucket];
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
 void Scheduler::tickle()
 {
-    LOG_DEBUG(g_logger, "tickle");
+    wakeParkedWorker();
+}
+
+void Scheduler::tickle(SchedulerWorker* worker)
+{
+    int state = SchedulerWorker::PARKED;
+    //只有把状态改回RUNNING的一方发出唤醒
+    if(worker->m_idle_state.compare_exchange_strong(state, SchedulerWorker::RUNNING)) {
+        Futex::wake(worker->m_idle_state);
+    }
+}
+
+bool Scheduler::wakeParkedWorker()
+{
+    if(m_spinning_count > 0) {
+        return true;    //自旋的线程马上就会发现新任务
+    }
+    for(auto& worker : m_workers) {
+        int state = SchedulerWorker::PARKED;
+        if(worker->m_idle_state.compare_exchange_strong(state, SchedulerWorker::RUNNING)) {
+            Futex::wake(worker->m_idle_state);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Scheduler::spinForTask(SchedulerWorker* worker)
+{
+    uint64_t spin = s_idle_spin;
+    if(spin == 0) {
+        return false;
+    }
+    ++m_spinning_count;
+    bool found = false;
+    for(uint64_t i = 0; i < spin && !found; i++) {
+        found = hasTask(worker);
+        CpuRelax();
+    }
+    --m_spinning_count;
+    //自旋期间提交的任务没有唤醒其他线程，不止一个任务时补发一次唤醒
+    if(found && m_queued_count > m_pinned_count + 1) {
+        tickle();
+    }
+    return found;
+}
+
+void Scheduler::parkWorker(SchedulerWorker* worker, uint64_t timeout_ms)
+{
+    worker->m_idle_state = SchedulerWorker::PARKED;
+    //先设置状态再检查任务，提交任务的线程先放入任务再检查状态，两者至少有一方能看到对方
+    if(hasTask(worker)) {
+        int state = SchedulerWorker::PARKED;
+        worker->m_idle_state.compare_exchange_strong(state, SchedulerWorker::RUNNING);
+        return;
+    }
+    //唤醒方先把状态改回RUNNING再唤醒，状态不是PARKED时futex不会阻塞
+    while(worker->m_idle_state == SchedulerWorker::PARKED) {
+        if(!Futex::wait(worker->m_idle_state, SchedulerWorker::PARKED, timeout_ms)) {
+            int state = SchedulerWorker::PARKED;
+            worker->m_idle_state.compare_exchange_strong(state, SchedulerWorker::RUNNING);
+            return;
+        }
+    }
 }
 
 bool Scheduler::onStop()
@@ -223,8 +1212,13 @@ bool Scheduler::onStop()
 
 void Scheduler::onFree()
 {
-    while (!isStop())
+    SchedulerWorker* worker = getThisWorker();
+    while (!isStop() && !checkRetire(worker))
     {
+        //先短暂自旋，仍然没有任务时阻塞，不再空转占用CPU
+        if(!spinForTask(worker)) {
+            parkWorker(worker, MAX_IDLE_TIMEOUT);
+        }
         Fiber::yieldToHold();
     }
     return;
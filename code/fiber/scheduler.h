@@ -3,38 +3,213 @@
 #include <memory>
 #include <functional>
 #include <vector>
+#include <set>
 
 #include "noncopyable.h"
 #include "fiber.h"
 #include "lock.h"
 #include "thread.h"
 #include "hook.h"
+#include "work_stealing_queue.h"
 
 namespace hxk
 {
+/**
+ * @Author: hxk
+ * @brief: 任务的优先级，每个优先级有独立的队列，数值越小越优先
+ */
+enum TaskPriority
+{
+    PRIORITY_HIGH = 0,      // 延迟敏感的任务，如instant任务、超时处理
+    PRIORITY_NORMAL,        // 默认优先级
+    PRIORITY_BACKGROUND,    // 后台任务，只保证不会饿死
+    PRIORITY_COUNT
+};
+
+/**
+ * @Author: hxk
+ * @brief: 调度线程的CPU放置策略，use_caller的主线程不受影响
+ */
+enum PlacementPolicy
+{
+    PLACEMENT_NONE = 0,     // 不设置亲和性，由内核决定
+    PLACEMENT_COMPACT,      // 每个线程绑定一个CPU，按节点、物理核依次填满
+    PLACEMENT_SPREAD,       // 每个线程绑定一个CPU，轮流分布到各个节点和物理核
+    PLACEMENT_NUMA,         // 每个线程绑定一个NUMA节点的所有CPU，线程轮流分配到各个节点
+    PLACEMENT_EXPLICIT      // 按指定的CPU列表依次绑定
+};
+
+/**
+ * @Author: hxk
+ * @brief: 调度的任务，同时作为侵入式队列的节点
+ *      回调函数使用只能移动的unique_function，捕获较少的lambda不需要分配内存；
+ *      Task自身从线程本地的空闲链表中分配，稳定运行时调度一个任务不需要调用malloc
+ */
 struct Task
 {
     typedef std::shared_ptr<Task> _ptr;
     typedef std::unique_ptr<Task> _uptr;
-    typedef std::function<void()> TaskFunc;
+    typedef Fiber::FiberFunc TaskFunc;
 
     Fiber::_ptr m_fiber;
     TaskFunc m_callback;
     long m_thread_id; // 任务要绑定执行线程的id
+    bool m_shared_stack;    // callback任务是否运行在线程共享栈上
+    TaskPriority m_priority;    // 任务所在的优先级队列
+    uint64_t m_enqueue_us;      // 放入队列的时间，用于统计排队时间，为0时不统计该任务
+    uint64_t m_deadline_us;     // 截止时间（us，与GetCurrentUS相同的时钟），0表示没有截止时间
+    Task* m_next;               // 所在TaskQueue中的下一个任务
 
-    Task() : m_thread_id(-1) {}
-    Task(const Task &lhs) = default;
-    Task(Fiber::_ptr f, long id) : m_fiber(std::move(f)), m_thread_id(id) {}
-    Task(const TaskFunc &cb, long id) : m_callback(cb), m_thread_id(id) {}
-    Task(TaskFunc &&cb, long id) : m_callback(std::move(cb)), m_thread_id(id) {}
-    Task &operator=(const Task &lhs) = default;
+    Task() : m_thread_id(-1), m_shared_stack(false), m_priority(PRIORITY_NORMAL), m_enqueue_us(0),
+             m_deadline_us(0), m_next(nullptr) {}
+    Task(const Task &lhs) = delete;
+    Task(Task &&lhs) = default;
+    Task(Fiber::_ptr f, long id) : m_fiber(std::move(f)), m_thread_id(id), m_shared_stack(false),
+                                   m_priority(PRIORITY_NORMAL), m_enqueue_us(0), m_deadline_us(0), m_next(nullptr) {}
+    Task(TaskFunc &&cb, long id) : m_callback(std::move(cb)), m_thread_id(id), m_shared_stack(false),
+                                   m_priority(PRIORITY_NORMAL), m_enqueue_us(0), m_deadline_us(0), m_next(nullptr) {}
+    Task &operator=(const Task &lhs) = delete;
+    Task &operator=(Task &&lhs) = default;
 
     void reset()
     {
         m_fiber = nullptr;
         m_callback = nullptr;
         m_thread_id = -1;
+        m_shared_stack = false;
+        m_priority = PRIORITY_NORMAL;
+        m_enqueue_us = 0;
+        m_deadline_us = 0;
+        m_next = nullptr;
+    }
+
+    static void* operator new(size_t size);         //优先从当前线程的空闲链表中取出
+    static void operator delete(void* ptr) noexcept;//放回当前线程的空闲链表，超过scheduler.task_pool_size时释放
+};
+
+/**
+ * @Author: hxk
+ * @brief: Task的侵入式先进先出队列，通过Task::m_next连接，不需要额外分配节点，不是线程安全的
+ *      队列持有其中任务的所有权
+ */
+class TaskQueue : public noncopyable
+{
+public:
+    TaskQueue() : m_head(nullptr), m_tail(nullptr), m_size(0) {}
+    ~TaskQueue()
+    {
+        clear();
+    }
+
+    void push_back(Task::_uptr task)
+    {
+        Task* node = task.release();
+        node->m_next = nullptr;
+        if(m_tail) {
+            m_tail->m_next = node;
+        }
+        else {
+            m_head = node;
+        }
+        m_tail = node;
+        ++m_size;
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 移除指定的任务
+     * @param {Task*} prev  node的前一个任务，node为队头时为nullptr
+     * @param {Task*} node  要移除的任务
+     * @return {_uptr}
+     */
+    Task::_uptr remove(Task* prev, Task* node)
+    {
+        Task* next = node->m_next;
+        if(prev) {
+            prev->m_next = next;
+        }
+        else {
+            m_head = next;
+        }
+        if(m_tail == node) {
+            m_tail = prev;
+        }
+        node->m_next = nullptr;
+        --m_size;
+        return Task::_uptr(node);
+    }
+
+    void clear()
+    {
+        while(m_head) {
+            remove(nullptr, m_head);
+        }
     }
+
+    Task* front() const { return m_head; }
+    bool empty() const { return m_head == nullptr; }
+    size_t size() const { return m_size; }
+
+private:
+    Task* m_head;
+    Task* m_tail;
+    size_t m_size;
+};
+
+class Scheduler;
+
+/**
+ * @Author: hxk
+ * @brief: 调度线程的本地任务队列，线程内部提交的任务放入本地队列，空闲时从其他线程窃取
+ *      绑定到该线程的任务放入mailbox，只有该线程会取出
+ *      本地队列和mailbox都按优先级分开存放
+ */
+struct SchedulerWorker
+{
+    enum IdleState
+    {
+        RUNNING = 0,    // 正在调度任务
+        PARKED,         // 空闲，阻塞在m_idle_state的futex上
+        POLLING,        // 空闲，由派生类阻塞在自己的等待机制上（如epoll_wait）
+        RETIRED         // 没有运行的线程（还未启动或已经退出），可以用于扩容
+    };
+
+    static const size_t QUEUE_WAIT_BUCKETS = 32;   // 排队时间直方图的桶数，第i个桶为[2^(i-1), 2^i)微秒
+
+    explicit SchedulerWorker(Scheduler* scheduler) : m_scheduler(scheduler), m_thread_id(-1), m_steal_count(0),
+                                                     m_tick(0), m_normal_share(0), m_background_share(0),
+                                                     m_wait_histogram(), m_mailbox_size(0), m_idle_state(RETIRED),
+                                                     m_retiring(false), m_idle_since(0),
+                                                     m_run_tick(0), m_preempt_tick(~0ull), m_preempted(false),
+                                                     m_watch_tick(0), m_watch_since_ms(0) {}
+
+    Scheduler* m_scheduler;
+    std::atomic_long m_thread_id;       // 所属线程的id
+    WorkStealingQueue<Task*> m_queues[PRIORITY_COUNT];  // 本地任务队列，只有所属线程放入，持有Task的所有权
+    std::atomic_uint64_t m_steal_count; // 从其他线程窃取成功的次数
+    uint64_t m_tick;                    // 取任务的次数，用于定期检查全局队列和低优先级队列
+    uint64_t m_normal_share;            // 每取这么多次任务，普通优先级先于高优先级
+    uint64_t m_background_share;        // 每取这么多次任务，后台优先级先于其他优先级
+    std::atomic_uint64_t m_wait_histogram[PRIORITY_COUNT][QUEUE_WAIT_BUCKETS];  // 该线程取出的被采样任务的排队时间，只有所属线程修改
+
+    SpinLock m_mailbox_lock;
+    TaskQueue m_mailbox[PRIORITY_COUNT];    // 绑定到该线程的任务
+    std::atomic_size_t m_mailbox_size;  // 不加锁判断mailbox是否为空
+
+    std::atomic_int m_idle_state;       // 空闲状态，提交任务的线程据此决定如何唤醒，PARKED时同时作为futex等待
+
+    std::atomic_bool m_retiring;        // 缩容时被选中，下一次空闲时退出
+    uint64_t m_idle_since;              // 开始空闲的时间（ms），正在执行任务时为0，只有所属线程访问
+
+    std::atomic_uint64_t m_run_tick;    // 换入任务协程前和换出后各加1，为奇数时正在执行任务，只有所属线程修改
+    std::atomic_uint64_t m_preempt_tick;// 看门狗要求让出的m_run_tick，与当前值相等时maybeYield让出
+    bool m_preempted;                   // 当前协程因为时间片用完而让出，由run放入全局队列的队尾
+    uint64_t m_watch_tick;              // 看门狗上一次看到的m_run_tick，只有看门狗线程访问
+    uint64_t m_watch_since_ms;          // m_watch_tick第一次被看到的时间
+
+    //按页对齐分配，线程绑定到NUMA节点后可以把整个对象迁移到该节点，不影响相邻的对象
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr);
 };
 
 class Scheduler : public noncopyable
@@ -51,9 +226,11 @@ public:
      * @param {size_t} thread_size  线程池线程数量
      * @param {bool} use_caller     是否将Scheduler实例化的线程作为master fiber
      * @param {string} name         调度器的名称
+     * @param {size_t} max_thread_size  最多可以扩容到的线程数量（与thread_size含义相同），
+     *                                  小于thread_size时等于thread_size，即不能扩容
      * @return {*}
      */
-    explicit Scheduler(size_t thread_size, bool use_caller = true, std::string name="");
+    explicit Scheduler(size_t thread_size, bool use_caller = true, std::string name="", size_t max_thread_size = 0);
     virtual ~Scheduler();
 
     void start();           //启动协程调度器
@@ -61,14 +238,118 @@ public:
     bool hasFreeThread();
     virtual bool isStop();
 
+    uint64_t getFiberCacheHits() const;     //callback任务复用已结束协程的次数
+    uint64_t getFiberCacheMisses() const;   //callback任务需要新建协程的次数
+
+    size_t getGlobalQueueDepth() const;             //全局队列中等待的任务数
+    size_t getQueueDepth(TaskPriority priority) const;  //指定优先级在所有队列中等待的任务数
+    /**
+     * @Author: hxk
+     * @brief: 指定优先级任务的排队时间直方图（所有调度线程之和），
+     *      每个提交线程按scheduler.queue_wait_sample的间隔采样任务，
+     *      第0个桶为不足1微秒，第i个桶为[2^(i-1), 2^i)微秒，最后一个桶包含更长的时间
+     * @return {vector<uint64_t>} 每个桶的任务数
+     */
+    std::vector<uint64_t> getQueueWaitHistogram(TaskPriority priority) const;
+    std::vector<size_t> getLocalQueueDepths() const;//每个调度线程本地队列中等待的任务数（近似值）
+    uint64_t getStealCount() const;                 //所有调度线程窃取任务成功的次数
+    uint64_t getPreemptCount() const;               //看门狗要求协程让出的次数
+
+    /**
+     * @Author: hxk
+     * @brief: 开启或关闭截止时间调度（EDF），默认值来自scheduler.edf
+     *      开启后不绑定线程、带有截止时间的任务放入按截止时间排序的全局堆，调度线程优先取出截止时间最早的任务，
+     *      只在定期检查低优先级和全局队列时让其他任务先执行；没有截止时间的任务仍按优先级和先进先出调度
+     *      超过截止时间scheduler.deadline_slack_ms仍未开始执行的函数任务被丢弃，协程任务不能丢弃，照常执行并计为迟到
+     * @return {*}
+     */
+    void setDeadlineMode(bool enable);
+    bool isDeadlineMode() const;
+    uint64_t getDroppedCount() const;   //超过截止时间被丢弃的任务数
+    uint64_t getLateCount() const;      //超过截止时间才开始执行的任务数
+
+    /**
+     * @Author: hxk
+     * @brief: 设置自动伸缩的线程数量范围（含use_caller的主线程），max不能超过构造时的max_thread_size
+     *      任务排队时间超过scheduler.grow_wait_us且没有空闲线程时增加一个线程，
+     *      线程连续空闲scheduler.idle_retire_ms后退出，min等于max时不自动伸缩
+     * @return {*}
+     */
+    void setThreadRange(size_t min_thread_size, size_t max_thread_size);
+
+    /**
+     * @Author: hxk
+     * @brief: 立即调整线程数量（含use_caller的主线程），不受setThreadRange的限制，但不能超过max_thread_size
+     *      多出的线程在下一次空闲时退出，退出前把本地队列和mailbox中的任务转入全局队列，
+     *      绑定到该线程的任务改为可以在任意线程执行；仍有共享栈协程的线程会等它们全部结束后才退出
+     * @return {*}
+     */
+    void resize(size_t thread_size);
+
+    size_t getThreadCount() const;          //当前的线程数量（含use_caller的主线程），不包括正在退出的线程
+    std::vector<long> getThreadIds() const; //当前所有调度线程的id
+
+    /**
+     * @Author: hxk
+     * @brief: 设置调度线程的CPU放置策略，只影响之后创建的线程，默认值来自scheduler.placement
+     *      绑定到单个NUMA节点的线程，其本地队列和协程栈在该节点上分配
+     * @param {vector<int>&} cpus  PLACEMENT_EXPLICIT时使用的CPU列表，线程i绑定cpus[i % cpus.size()]
+     * @return {*}
+     */
+    void setPlacement(PlacementPolicy policy, const std::vector<int>& cpus = {});
+
+    /**
+     * @Author: hxk
+     * @brief: 设置之后创建的调度线程的栈大小和调度策略，设置了放置策略时attr.m_cpus被忽略
+     * @return {*}
+     */
+    void setThreadAttr(const ThreadAttr& attr);
+
 public:
     static Scheduler* getThis();    //获取当前协程调度器
     static Fiber* getMainFiber();   //获取当前协程调度器的调度工作协程
 
+    /**
+     * @Author: hxk
+     * @brief: 让出点：当前任务协程连续执行超过scheduler.time_slice_ms时，看门狗线程会设置让出标记，
+     *      此时记录协程的调用栈，并以READY状态让出，放到队尾等待再次调度
+     *      hook的系统调用会检查，长时间计算的循环中也可以主动调用；不在任务协程中时什么都不做
+     * @return {bool} 是否让出过
+     */
+    static bool maybeYield();
+    static SchedulerWorker* getThisWorker();    //获取当前调度线程的本地队列，不是调度线程时返回nullptr
+
 
 protected:
     void run();
-    virtual void tickle();
+    virtual void tickle();                          //有新任务，唤醒一个阻塞的空闲线程
+    virtual void tickle(SchedulerWorker* worker);   //只唤醒指定的调度线程
+    bool hasTask(SchedulerWorker* worker) const;    //是否有指定线程可以执行的任务（近似值）
+    bool wakeParkedWorker();    //唤醒一个阻塞的空闲线程，已经有线程在自旋等待时不需要唤醒，返回false表示没有可以唤醒的线程
+
+    /**
+     * @Author: hxk
+     * @brief: 空闲线程在阻塞之前先自旋等待scheduler.idle_spin次，任务很快到达时避免一次futex阻塞和唤醒
+     *      自旋期间提交任务的线程不会唤醒其他空闲线程
+     * @return {bool} 自旋期间是否有了可以执行的任务
+     */
+    bool spinForTask(SchedulerWorker* worker);
+
+    /**
+     * @Author: hxk
+     * @brief: 空闲线程阻塞在自己的futex上，直到被tickle唤醒或超时
+     * @param {uint64_t} timeout_ms 超时后返回，调用方重新检查停止状态和定时器
+     * @return {*}
+     */
+    void parkWorker(SchedulerWorker* worker, uint64_t timeout_ms);
+
+    /**
+     * @Author: hxk
+     * @brief: 空闲线程是否应该退出，由onFree在每次等待结束后调用，返回true时onFree应该返回
+     *      被resize选中，或者自动伸缩时连续空闲超过scheduler.idle_retire_ms且线程数多于最小值
+     * @return {bool}
+     */
+    bool checkRetire(SchedulerWorker* worker);
     virtual bool onStop();  //调度器停止时的回调函数，返回调度器当前是否处于停止工作的状态
     virtual void onFree();  //调度器空闲时的回调函数
 
@@ -77,32 +358,68 @@ public:
     /**
      * @Author: hxk
      * @brief: 添加任务
-     * @param {Executable&&} exec 模板类型必须是std::unique_ptr<Fiber> 或 std::function
+     *      调度线程内部提交的非绑定任务放入该线程的本地队列，其他情况放入全局队列
+     * @param {Executable&&} exec 模板类型必须是Fiber::_ptr 或可以转换为Task::TaskFunc的可调用对象
      * @param {long} thread_id  任务要绑定执行线程的id
-     * @param {bool} instant    是否优先调度
+     * @param {bool} instant    是否优先调度，为true时放入高优先级队列
+     * @param {bool} shared_stack   callback任务是否运行在线程共享栈上，适用于大量长时间挂起的协程，
+     *                              协程挂起期间不能有其他协程访问其栈上的数据，且只会在第一次运行的线程上执行
      * @return {*}
      */
     template<typename Executable>
-    void schedule(Executable&& exec, long thread_id = -1, bool instant = false)
+    void schedule(Executable&& exec, long thread_id = -1, bool instant = false, bool shared_stack = false)
     {
-        bool need_tickle = false;
-        {
-            ScopedLock lock(&m_mutex);
-            need_tickle = scheduleNonBlock(std::forward<Executable>(exec), thread_id);
+        schedule(std::forward<Executable>(exec), thread_id, instant ? PRIORITY_HIGH : PRIORITY_NORMAL, shared_stack);
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 按指定优先级添加任务
+     *      取任务时高优先级优先，但普通和后台优先级按m_normal_share、m_background_share定期先被检查，不会饿死
+     * @param {TaskPriority} priority   任务的优先级
+     * @return {*}
+     */
+    template<typename Executable>
+    void schedule(Executable&& exec, long thread_id, TaskPriority priority, bool shared_stack = false)
+    {
+        Task::_uptr task = makeTask(std::forward<Executable>(exec), thread_id, shared_stack, priority);
+        if(task) {
+            dispatchTask(std::move(task));
         }
-        if(need_tickle) {
-            tickle();
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 添加带有截止时间的任务，截止时间会被设置到执行任务的协程上，见setDeadlineMode
+     *      只有截止时间调度开启时按截止时间排序，否则与schedule相同
+     * @param {uint64_t} deadline_us    绝对截止时间（us，与GetCurrentUS相同的时钟），为0时使用协程任务自己的截止时间
+     * @return {*}
+     */
+    template<typename Executable>
+    void scheduleWithDeadline(Executable&& exec, uint64_t deadline_us, long thread_id = -1,
+                              TaskPriority priority = PRIORITY_NORMAL)
+    {
+        Task::_uptr task = makeTask(std::forward<Executable>(exec), thread_id, false, priority);
+        if(!task) {
+            return;
+        }
+        if(deadline_us) {
+            task->m_deadline_us = deadline_us;
         }
+        dispatchTask(std::move(task));
     }
 
     template<typename InputIterator>
-    void schedule(InputIterator begin, InputIterator end)
+    void schedule(InputIterator begin, InputIterator end, TaskPriority priority = PRIORITY_NORMAL)
     {
         bool need_tickle = false;
         {
             ScopedLock lock(&m_mutex);
             while(begin != end) {
-                need_tickle = scheduleNonBlock(*begin) || need_tickle;
+                Task::_uptr task = makeTask(*begin, -1, false, priority);
+                if(task) {
+                    need_tickle = scheduleNonBlock(std::move(task)) || need_tickle;
+                }
                 ++begin;
             }
         }
@@ -115,43 +432,180 @@ public:
 private:
     /**
      * @Author: hxk
-     * @brief: 添加任务
-     * @param {Executable&&} exec 模板类为std::unique_ptr<Fiber> 或 std::function
+     * @brief: 创建任务
+     * @param {Executable&&} exec 模板类为Fiber::_ptr 或可以转换为Task::TaskFunc的可调用对象
      * @param {long} thread_id  任务要绑定的线程id
-     * @param {bool} instant    任务是否要优先调度
-     * @return {*}  是否是空闲状态下的第一个新任务
+     * @param {bool} shared_stack   callback任务是否运行在线程共享栈上
+     * @param {TaskPriority} priority   任务的优先级
+     * @return {*}  exec为空时返回nullptr
      */
     template<typename Executable>
-    bool scheduleNonBlock(Executable&& exec, long thread_id = -1, bool instant = false)
+    static Task::_uptr makeTask(Executable&& exec, long thread_id, bool shared_stack, TaskPriority priority)
     {
-        bool need_tickle = m_task_list.empty();
         auto task = std::make_unique<Task>(std::forward<Executable>(exec), thread_id);
-        if(task->m_fiber || task->m_callback) {
-            if(instant) {
-                m_task_list.push_front(std::move(task));
+        if(!task->m_fiber && !task->m_callback) {
+            return nullptr;
+        }
+        task->m_shared_stack = shared_stack;
+        task->m_priority = priority;
+        task->m_enqueue_us = stampEnqueueTime();
+        if(task->m_fiber) {
+            //被唤醒的协程继续使用自己的截止时间
+            task->m_deadline_us = task->m_fiber->getDeadline();
+            if(task->m_fiber->getBoundThread() != -1) {
+                //共享栈协程的栈数据只能恢复到所在线程的共享栈上
+                task->m_thread_id = task->m_fiber->getBoundThread();
             }
-            else {
-                m_task_list.push_back(std::move(task));
+        }
+        return task;
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 按任务的属性放入队列
+     *      绑定线程的任务放入目标线程的mailbox；截止时间调度开启时，带有截止时间的任务放入截止时间堆；
+     *      调度线程内部提交的其他任务放入该线程的本地队列，其他情况放入全局队列
+     * @return {*}
+     */
+    void dispatchTask(Task::_uptr task)
+    {
+        if(task->m_thread_id != -1) {
+            //绑定线程的任务直接放入目标线程的mailbox，只唤醒目标线程
+            SchedulerWorker* target = findWorker(task->m_thread_id);
+            if(target && scheduleToWorker(target, task)) {
+                return;
+            }
+        }
+        if(task->m_deadline_us && task->m_thread_id == -1 && m_deadline_mode.load(std::memory_order_relaxed)) {
+            scheduleDeadline(std::move(task));
+            return;
+        }
+        SchedulerWorker* worker = getThisWorker();
+        if(worker && worker->m_scheduler == this && task->m_thread_id == -1) {
+            //本地队列只有当前线程放入，不需要加锁
+            TaskPriority priority = task->m_priority;
+            auto& queue = worker->m_queues[priority];
+            bool need_tickle = queue.empty();
+            ++m_queued_count;
+            ++m_class_count[priority];
+            queue.push(task.release());
+            if(need_tickle) {
+                tickle();   //唤醒空闲线程来窃取
             }
+            return;
+        }
+        bool need_tickle = false;
+        {
+            ScopedLock lock(&m_mutex);
+            need_tickle = scheduleNonBlock(std::move(task));
         }
+        if(need_tickle) {
+            tickle();
+        }
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 将任务放入对应优先级的全局队列，调用时必须持有m_mutex
+     * @param {_uptr} task
+     * @return {*}  是否是空闲状态下的第一个新任务
+     */
+    bool scheduleNonBlock(Task::_uptr task)
+    {
+        auto& task_list = m_task_lists[task->m_priority];
+        bool need_tickle = task_list.empty();
+        if(task->m_thread_id != -1 && m_retired_thread_ids.count(task->m_thread_id)) {
+            task->m_thread_id = -1;     //绑定的线程已经因为缩容退出，改为可以在任意线程执行
+        }
+        if(task->m_thread_id != -1) {
+            ++m_pinned_count;   //绑定到未知线程的任务，不计入空闲线程可以执行的任务
+        }
+        ++m_queued_count;
+        ++m_class_count[task->m_priority];
+        task_list.push_back(std::move(task));
         return need_tickle;
     }
 
+    static uint64_t stampEnqueueTime();     //需要采样排队时间时返回当前时间，否则返回0
+    SchedulerWorker* findWorker(long thread_id) const;  //查找线程对应的本地队列，不存在时返回nullptr
+    bool scheduleToWorker(SchedulerWorker* worker, Task::_uptr& task);  //放入指定线程的mailbox，线程已经退出时返回false
+    void scheduleDeadline(Task::_uptr task);    //放入截止时间堆
+
+    void spawnWorker(SchedulerWorker* worker);  //为空闲的槽位创建线程，调用时必须持有m_resize_mutex
+    void retireWorker(SchedulerWorker* worker); //线程退出前把剩余的任务转入全局队列
+    void maybeGrow(uint64_t wait_us);           //任务排队过久且没有空闲线程时扩容
+    void watchdog();                            //看门狗线程，检查执行超过时间片的任务协程
+    void stopWatchdog();
+    ThreadAttr getWorkerAttr(size_t index) const;   //按放置策略计算第index个槽位的线程属性
+
+    /**
+     * @Author: hxk
+     * @brief: 按优先级依次检查各个队列，同一优先级内按mailbox、本地、全局、窃取的顺序获取任务
+     *      每m_background_share次先检查后台优先级，每m_normal_share次先检查普通优先级，避免低优先级饿死
+     * @return {bool} 没有可以执行的任务时返回false
+     */
+    bool takeTask(SchedulerWorker* worker, Task& task);
+    bool takeMailboxTask(SchedulerWorker* worker, TaskPriority priority, Task& task);
+    bool takeGlobalTask(SchedulerWorker* worker, TaskPriority priority, Task& task);
+    bool stealTask(SchedulerWorker* worker, TaskPriority priority, Task& task);
+
+    /**
+     * @Author: hxk
+     * @brief: 取出截止时间最早的任务，同时丢弃已经超过截止时间scheduler.deadline_slack_ms的函数任务
+     * @return {bool} 堆中没有可以执行的任务时返回false
+     */
+    bool takeDeadlineTask(SchedulerWorker* worker, Task& task);
+    bool acceptLocalTask(SchedulerWorker* worker, Task* local, Task& task);  //接管从本地队列取出的任务
+    void onTaskTaken(SchedulerWorker* worker, const Task& task);    //更新计数和排队时间直方图
+
 protected:
     const std::string m_name;   //调度器名称
     long m_root_thread_id;  //主线程id
-    std::vector<long> m_thread_id_list; //线程id列表
-    size_t m_thread_count;  //线程数量
+    std::atomic_size_t m_thread_count;  //线程池中的线程数量，不包括use_caller的主线程和正在退出的线程
     std::atomic_uint64_t m_active_thread_count; //活跃线程数量
     std::atomic_uint64_t m_free_thread_count;   //空闲线程数量
     bool m_stopped;         //执行停止状态
     bool m_auto_stopped;    //是否自动停止
+    std::atomic_uint64_t m_fiber_cache_hit;     //协程缓存命中次数
+    std::atomic_uint64_t m_fiber_cache_miss;    //协程缓存未命中次数
+    std::atomic_uint64_t m_queued_count;        //全局队列、所有本地队列和mailbox中等待的任务数
+    std::atomic_uint64_t m_pinned_count;        //其中绑定线程的任务数
+    std::atomic_uint64_t m_class_count[PRIORITY_COUNT]; //每个优先级等待的任务数，为0时跳过该优先级的所有队列
+    std::atomic_uint64_t m_spinning_count;      //正在自旋等待任务的空闲线程数
+    std::vector<std::unique_ptr<SchedulerWorker>> m_workers;    //每个调度线程一个本地队列，use_caller时主线程使用最后一个，
+                                                                //按最大线程数量预先创建，没有线程的为RETIRED状态
+    SchedulerWorker* m_root_worker;     //use_caller时主线程的本地队列
+    size_t m_max_thread_count;          //线程池最多的线程数量，即线程池可用的槽位数
+    std::atomic_size_t m_min_thread_count;  //自动缩容的下限（线程池线程数）
+    std::atomic_size_t m_auto_max_thread_count; //自动扩容的上限（线程池线程数）
 
 private:
     mutable Mutex m_mutex;
     Fiber::_ptr m_root_fiber;   //负责调度的协程，仅在类实例化参数中use_call为true有效
-    std::vector<Thread::_ptr> m_thread_list;    //线程列表
-    std::list<Task::_ptr>   m_task_list;    //任务集合
+    std::vector<Thread::_ptr> m_thread_list;    //线程列表，与m_workers的槽位一一对应
+    Mutex m_resize_mutex;                       //保护线程的创建和m_thread_list
+    std::atomic_uint64_t m_last_grow_ms;        //上一次自动扩容的时间，用于限制扩容频率
+    std::set<long> m_retired_thread_ids;        //因缩容退出的线程id，绑定到它们的任务改为不绑定，持有m_mutex时访问
+    PlacementPolicy m_placement;                //调度线程的CPU放置策略，持有m_resize_mutex时访问
+    std::vector<int> m_placement_cpus;          //PLACEMENT_EXPLICIT的CPU列表
+    ThreadAttr m_thread_attr;                   //创建调度线程使用的属性
+    Thread::_ptr m_watchdog;                    //看门狗线程，scheduler.time_slice_ms为0时不创建
+    Semaphore m_watchdog_semaphore;             //通知看门狗线程退出
+    bool m_watchdog_stop;
+    std::atomic_uint64_t m_preempt_count;       //要求协程让出的次数
+    std::atomic_bool m_deadline_mode;           //是否开启截止时间调度
+    SpinLock m_deadline_lock;                   //保护m_deadline_heap
+    std::vector<Task*> m_deadline_heap;         //按截止时间排序的小顶堆，持有Task的所有权
+    std::atomic_uint64_t m_deadline_count;      //堆中的任务数，不加锁判断堆是否为空
+    std::atomic_uint64_t m_dropped_count;       //超过截止时间被丢弃的任务数
+    std::atomic_uint64_t m_late_count;          //超过截止时间才开始执行的任务数
+    TaskQueue m_task_lists[PRIORITY_COUNT];     //全局队列：外部线程提交的任务，每个优先级一个
 
 };
+
+//长时间计算的协程中的主动让出点，见Scheduler::maybeYield
+inline bool maybeYield()
+{
+    return Scheduler::maybeYield();
+}
 }
\ No newline at end of file
@@ -5,7 +5,10 @@
 #include "fiber.h"
 #include "io_manager.h"
 #include "fd_manager.h"
+#include "offload.h"
 #include <dlfcn.h>
+#include <linux/io_uring.h>
+#include <sys/stat.h>
 namespace hxk
 {
 static Logger::_ptr g_logger  = GET_LOGGER("system");
@@ -14,6 +17,9 @@ static thread_local bool t_hook_enabled = false;
 
 static hxk::ConfigVar<int>::_ptr g_tcp_connect_timeout = hxk::Config::lookUp("tcp.connect.timeout", 5000);
 
+static hxk::ConfigVar<bool>::_ptr g_offload_file_io =
+    hxk::Config::lookUp("offload.file_io", false, "run hooked read/write on regular files in the offload pool");
+
 
 bool isHookEnabled()
 {
@@ -61,6 +67,7 @@ void hook_init()
 }
 
 static uint64_t s_connect_timeout = -1;
+static bool s_offload_file_io = false;
 struct _HookIniter
 {
     _HookIniter()
@@ -71,6 +78,10 @@ struct _HookIniter
             LOG_FORMAT_INFO(g_logger, "tcp connect timeout change from %d to %d", old_value, new_val);
             s_connect_timeout = new_val;
         });
+        s_offload_file_io = g_offload_file_io->getValue();
+        g_offload_file_io->addListener([](const bool& old_value, const bool& new_val){
+            s_offload_file_io = new_val;
+        });
     }
 };
 
@@ -85,6 +96,12 @@ struct TimerInfo
     int cancelled  = 0;
 };
 
+static bool isRegularFile(int fd)
+{
+    struct stat fd_stat;
+    return fstat(fd, &fd_stat) == 0 && S_ISREG(fd_stat.st_mode);
+}
+
 template<typename OriginFunc, typename ...Args>
 static ssize_t doIO(int fd, OriginFunc func, const char* hook_func_name, uint32_t event, int fd_timeout_type, Args&& ...args)
 {
@@ -94,6 +111,20 @@ static ssize_t doIO(int fd, OriginFunc func, const char* hook_func_name, uint32_
     // LOG_FMT_DEBUG(zjl::system_logger, "doIO 代理执行系统函数 %s", hook_func_name);
 
     hxk::FileDescriptor::_ptr fdp = hxk::FileDescriptorManager::GetInstance()->get(fd);
+    // 普通文件的读写总是阻塞的，开启offload.file_io时交给阻塞任务线程池执行，只挂起当前协程；
+    // 持有线程锁时（如日志文件的flush）不能挂起，直接阻塞调用；
+    // 任务引用了调用方栈上的参数和缓冲区，共享栈协程挂起后栈会被复用，同样直接阻塞调用
+    if ((!fdp || !fdp->isSocket()) && hxk::s_offload_file_io && hxk::getHeldThreadLocks() == 0
+        && !hxk::Fiber::getThis()->isSharedStack() && isRegularFile(fd))
+    {
+        // errno是线程私有的，需要从线程池的线程带回来
+        auto result = hxk::offload([&](){
+            ssize_t n = func(fd, std::forward<Args>(args)...);
+            return std::make_pair(n, errno);
+        });
+        errno = result.second;
+        return result.first;
+    }
     if (!fdp)
     {
         return func(fd, std::forward<Args>(args)...);
@@ -107,6 +138,9 @@ static ssize_t doIO(int fd, OriginFunc func, const char* hook_func_name, uint32_
     {
         return func(fd, std::forward<Args>(args)...);
     }
+    // 让出点：只在可能挂起协程的socket调用上让出，调用方本来就要允许在这里切换协程；
+    // 框架内部的eventfd、日志文件等调用可能持有锁，不能在那里让出
+    hxk::Scheduler::maybeYield();
 
     uint64_t timeout = fdp->getTimeout(fd_timeout_type);
     auto timer_info = std::make_shared<TimerInfo>();
@@ -171,6 +205,52 @@ RETRY:
     return n;
 }
 
+// io_uring后端：fd未就绪时由内核在就绪后直接执行prep准备的操作，省去唤醒之后再调用一次系统函数
+// 只处理没有设置超时时间的socket，其他情况以及操作被取消时交给doIO
+template<typename OriginFunc, typename Prep, typename ...Args>
+static ssize_t doUringIO(int fd, OriginFunc func, const char* hook_func_name, uint32_t event, int fd_timeout_type,
+                         const Prep& prep, Args ...args)
+{
+    auto iom = hxk::IOManager::getThis();
+    if (!hxk::isHookEnabled() || !iom || !iom->isSubmitIOSupported())
+    {
+        return doIO(fd, func, hook_func_name, event, fd_timeout_type, args...);
+    }
+    // 共享栈协程的栈在切换出去时会被换出，缓冲区常常在栈上，不能交给内核异步读写
+    if (hxk::Fiber::getThis()->isSharedStack())
+    {
+        return doIO(fd, func, hook_func_name, event, fd_timeout_type, args...);
+    }
+    hxk::FileDescriptor::_ptr fdp = hxk::FileDescriptorManager::GetInstance()->get(fd);
+    if (!fdp || fdp->isClosed() || !fdp->isSocket() || fdp->getUserNonBlock()
+        || fdp->getTimeout(fd_timeout_type) != static_cast<uint64_t>(-1))
+    {
+        return doIO(fd, func, hook_func_name, event, fd_timeout_type, args...);
+    }
+    hxk::Scheduler::maybeYield();
+    // 先直接尝试一次，数据已经就绪时不需要经过io_uring
+    ssize_t n = func(fd, args...);
+    while(n == -1 && errno == EINTR)
+    {
+        n = func(fd, args...);
+    }
+    if (n != -1 || errno != EAGAIN)
+    {
+        return n;
+    }
+    int rt = iom->submitIO(fd, static_cast<hxk::FDEventType>(event), prep);
+    if (rt >= 0)
+    {
+        return rt;
+    }
+    if (rt == -ECANCELED || rt == -EAGAIN || rt == -EINTR)
+    {
+        return doIO(fd, func, hook_func_name, event, fd_timeout_type, args...);
+    }
+    errno = -rt;
+    return -1;
+}
+
 extern "C"
 {
 #define DEF_FUNC_NAME(name) name##_func name##_f = nullptr;
@@ -179,7 +259,8 @@ extern "C"
 
 unsigned int sleep(unsigned int seconds)
 {
-    if(!hxk::t_hook_enabled) {
+    //不在IOManager中时没有定时器可用，直接阻塞线程
+    if(!hxk::t_hook_enabled || !hxk::IOManager::getThis()) {
         return sleep_f(seconds);
     }
     hxk::Fiber::_ptr fiber = hxk::Fiber::getThis();
@@ -194,7 +275,8 @@ unsigned int sleep(unsigned int seconds)
 
 int usleep(useconds_t usec)
 {
-    if(!hxk::t_hook_enabled) {
+    //不在IOManager中时没有定时器可用，直接阻塞线程
+    if(!hxk::t_hook_enabled || !hxk::IOManager::getThis()) {
         return usleep_f(usec);
     }
     hxk::Fiber::_ptr fiber = hxk::Fiber::getThis();
@@ -209,7 +291,8 @@ int usleep(useconds_t usec)
 
 int nanoslepp(const struct timespec* req, struct timespec* rem)
 {
-    if(!hxk::t_hook_enabled) {
+    //不在IOManager中时没有定时器可用，直接阻塞线程
+    if(!hxk::t_hook_enabled || !hxk::IOManager::getThis()) {
         return nanosleep_f(req,rem);
     }
     int timeout_ms = req->tv_sec * 1000 + req->tv_nsec / 1000 /1000;
@@ -233,6 +316,9 @@ int socket(int domain, int type, int protocol)
         return fd;
     }
     hxk::FileDescriptorManager::GetInstance()->get(fd, true);
+    if(auto iom = hxk::IOManager::getThis()) {
+        iom->setSocketBusyPoll(fd);
+    }
     return fd;
 }
 
@@ -256,7 +342,7 @@ int connectWithTimeout(int sockfd, const struct sockaddr* addr, socklen_t addrle
     if(n == 0) {
         return 0;
     }
-    else if(n == -1 || errno != EINPROGRESS) {
+    else if(n != -1 || errno != EINPROGRESS) {
         return n;
     }
     auto io_manager = hxk::IOManager::getThis();
@@ -314,16 +400,34 @@ int connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen)
 
 int accept(int sockfd, struct sockaddr* addr, socklen_t* addrlen)
 {
-    int fd = doIO(sockfd, accept_f, "accept", hxk::FDEventType::READ, SO_RCVTIMEO, addr, addrlen);
+    int fd = doUringIO(sockfd, accept_f, "accept", hxk::FDEventType::READ, SO_RCVTIMEO,
+                       [=](io_uring_sqe* sqe){
+                           sqe->opcode = IORING_OP_ACCEPT;
+                           sqe->fd = sockfd;
+                           sqe->addr = reinterpret_cast<uint64_t>(addr);
+                           sqe->addr2 = reinterpret_cast<uint64_t>(addrlen);
+                       },
+                       addr, addrlen);
     if(fd >= 0) {
         hxk::FileDescriptorManager::GetInstance()->get(fd, true);
+        if(auto iom = hxk::IOManager::getThis()) {
+            iom->setSocketBusyPoll(fd);
+        }
     }
     return fd;
 }
 
 ssize_t read(int fd, void* buf, size_t count)
 {
-    return doIO(fd, read_f, "read", hxk::FDEventType::READ, SO_RCVTIMEO, buf, count);
+    return doUringIO(fd, read_f, "read", hxk::FDEventType::READ, SO_RCVTIMEO,
+                     [=](io_uring_sqe* sqe){
+                         sqe->opcode = IORING_OP_READ;
+                         sqe->fd = fd;
+                         sqe->off = static_cast<uint64_t>(-1);  //使用文件当前的偏移
+                         sqe->addr = reinterpret_cast<uint64_t>(buf);
+                         sqe->len = count;
+                     },
+                     buf, count);
 }
 
 ssize_t readv(int fd, const iovec* iov, int iov_count)
@@ -333,7 +437,15 @@ ssize_t readv(int fd, const iovec* iov, int iov_count)
 
 ssize_t recv(int fd, void* buf, size_t len, int flags)
 {
-    return doIO(fd, recv_f, "recv", hxk::FDEventType::READ, SO_RCVTIMEO, buf, len, flags);
+    return doUringIO(fd, recv_f, "recv", hxk::FDEventType::READ, SO_RCVTIMEO,
+                     [=](io_uring_sqe* sqe){
+                         sqe->opcode = IORING_OP_RECV;
+                         sqe->fd = fd;
+                         sqe->addr = reinterpret_cast<uint64_t>(buf);
+                         sqe->len = len;
+                         sqe->msg_flags = flags;
+                     },
+                     buf, len, flags);
 }
 
 ssize_t recvfrom(int sockfd, void* buf, size_t len, int flags, struct sockaddr* src_addr, socklen_t* addrlen)
@@ -349,7 +461,15 @@ ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags)
 
 ssize_t write(int fd, const void* buf, size_t count)
 {
-    return doIO(fd, write_f, "write", hxk::FDEventType::WRITE, SO_SNDTIMEO, buf, count);
+    return doUringIO(fd, write_f, "write", hxk::FDEventType::WRITE, SO_SNDTIMEO,
+                     [=](io_uring_sqe* sqe){
+                         sqe->opcode = IORING_OP_WRITE;
+                         sqe->fd = fd;
+                         sqe->off = static_cast<uint64_t>(-1);
+                         sqe->addr = reinterpret_cast<uint64_t>(buf);
+                         sqe->len = count;
+                     },
+                     buf, count);
 }
 
 ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
@@ -359,7 +479,15 @@ ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
 
 ssize_t send(int fd, const void* buf, size_t len, int flags)
 {
-    return doIO(fd, send_f, "send", hxk::FDEventType::WRITE, SO_SNDTIMEO, buf, len, flags);
+    return doUringIO(fd, send_f, "send", hxk::FDEventType::WRITE, SO_SNDTIMEO,
+                     [=](io_uring_sqe* sqe){
+                         sqe->opcode = IORING_OP_SEND;
+                         sqe->fd = fd;
+                         sqe->addr = reinterpret_cast<uint64_t>(buf);
+                         sqe->len = len;
+                         sqe->msg_flags = flags;
+                     },
+                     buf, len, flags);
 }
 
 ssize_t sendto(int fd, const void* buf, size_t len, int flags, const struct sockaddr* dest_addr, socklen_t addrlen)
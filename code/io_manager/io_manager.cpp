@@ -1,34 +1,119 @@
 #include "io_manager.h"
+#include "io_uring.h"
 #include "exception.h"
+#include "fiber_lock.h"
 
+#include <deque>
+#include <poll.h>
+#include <string.h>
 #include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69  //Linux 5.11
+#endif
 
 namespace hxk
 {
 
 static Logger::_ptr g_logger = GET_LOGGER("system");
 
+//空闲线程最长的等待时间（ms），超时后重新检查定时器和停止状态
+static const int MAX_IDLE_TIMEOUT = 1000;
+
+//epoll_wait批量大小的下限
+static const size_t MIN_EPOLL_EVENTS = 64;
+
+//RLIMIT_NOFILE没有上限时fd表覆盖的fd数量
+static const size_t MAX_FD_TABLE_SIZE = 1 << 24;
+
+static ConfigVar<std::string>::_ptr g_iomanager_backend =
+    Config::lookUp<std::string>("iomanager.backend", "epoll", "io readiness backend, epoll or io_uring (falls back to epoll when unsupported)");
+
+static ConfigVar<bool>::_ptr g_iomanager_persistent =
+    Config::lookUp<bool>("iomanager.persistent", false, "register each fd with epoll once, edge-triggered for both directions");
+
+static ConfigVar<bool>::_ptr g_iomanager_per_thread_epoll =
+    Config::lookUp<bool>("iomanager.per_thread_epoll", false, "one epoll per worker thread, fds stay on the thread that first listened on them");
+
+static ConfigVar<uint64_t>::_ptr g_iomanager_max_events =
+    Config::lookUp<uint64_t>("iomanager.max_events", 1024, "upper bound of the adaptive epoll_wait batch size");
+
+static ConfigVar<uint64_t>::_ptr g_iomanager_loop_budget =
+    Config::lookUp<uint64_t>("iomanager.loop_budget", 256, "ready events and expired timers dispatched per event loop iteration before running queued tasks");
+
+static ConfigVar<uint64_t>::_ptr g_iomanager_busy_poll_us =
+    Config::lookUp<uint64_t>("iomanager.busy_poll_us", 0, "microseconds an idle worker busy-polls before blocking, 0 disables");
+
+static ConfigVar<uint64_t>::_ptr g_iomanager_busy_poll_threads =
+    Config::lookUp<uint64_t>("iomanager.busy_poll_threads", 1, "number of worker slots that busy-poll when busy_poll_us is set");
+
+static ConfigVar<uint64_t>::_ptr g_iomanager_socket_busy_poll_us =
+    Config::lookUp<uint64_t>("iomanager.socket_busy_poll_us", 0, "SO_BUSY_POLL value set on hooked sockets, 0 leaves sockets unchanged");
+
+static ConfigVar<uint64_t>::_ptr g_iomanager_uring_entries =
+    Config::lookUp<uint64_t>("iomanager.uring_entries", 1024, "io_uring submission queue size");
+
+//io_uring完成项的user_data：低2位为类型，poll请求的高16位为注册的代数，其余为对象地址
+static const uint64_t URING_TAG_READ = 0;       //FDContent上读方向的poll
+static const uint64_t URING_TAG_WRITE = 1;      //FDContent上写方向的poll
+static const uint64_t URING_TAG_REQUEST = 2;    //submitIO的请求
+static const uint64_t URING_TAG_IGNORE = 3;     //不需要处理的完成项：取消请求、链接在操作之前的poll
+static const uint64_t URING_TAG_MASK = 3;
+static const uint64_t URING_GEN_SHIFT = 48;
+static const uint64_t URING_PTR_MASK = ((1ull << URING_GEN_SHIFT) - 1) & ~URING_TAG_MASK;
+
+//唤醒器eventfd上的poll，地址部分为1，不会和真正的对象冲突
+static const uint64_t URING_TICKLE = (1ull << 2) | URING_TAG_IGNORE;
+
+static uint64_t uringPollData(FDContent* fd_ctx, FDEventType event_type, uint16_t gen)
+{
+    uint64_t ptr = reinterpret_cast<uint64_t>(fd_ctx);
+    assert((ptr & ~URING_PTR_MASK) == 0);
+    return ptr | (event_type == FDEventType::READ ? URING_TAG_READ : URING_TAG_WRITE)
+               | (static_cast<uint64_t>(gen) << URING_GEN_SHIFT);
+}
+
+//submitIO的请求，分配在堆上：共享栈协程切换时栈内容会被换出，内核和完成线程不能写协程栈
+struct UringRequest
+{
+    FiberParker m_parker;
+    int m_result = -ECANCELED;
+};
+
+//提交队列满时暂存的提交项，每一组是一次queueSqes的链接请求，按顺序放入提交队列
+struct IOManager::SqeBacklog
+{
+    std::deque<std::vector<io_uring_sqe>> m_groups;
+};
+
 void FDContent::resetEventHandler(EventHandler& handler)
 {
     handler.m_fiber.reset();
     handler.m_callback = nullptr;
     handler.m_scheduler = nullptr;
+    handler.m_priority = PRIORITY_NORMAL;
+    handler.m_deadline_us = 0;
 }
 
 
-void FDContent::triggerEvent(FDEventType type)
+void FDContent::triggerEvent(FDEventType type, long thread_id)
 {
     assert(m_event_type & type);
     m_event_type = static_cast<FDEventType>(m_event_type & ~type);
     auto &handler = getEventHandler(type);
     assert(handler.m_scheduler);
     if(handler.m_fiber) {
-        handler.m_scheduler->schedule(std::move(handler.m_fiber));
+        handler.m_scheduler->schedule(std::move(handler.m_fiber), thread_id, handler.m_priority);
     }
     else if(handler.m_callback) {
-        handler.m_scheduler->schedule(std::move(handler.m_callback));
+        handler.m_scheduler->scheduleWithDeadline(std::move(handler.m_callback), handler.m_deadline_us,
+                                                  thread_id, handler.m_priority);
     }
     handler.m_scheduler = nullptr;
+    handler.m_priority = PRIORITY_NORMAL;
+    handler.m_deadline_us = 0;
 }
 
 EventHandler& FDContent::getEventHandler(FDEventType type)
@@ -44,28 +129,75 @@ EventHandler& FDContent::getEventHandler(FDEventType type)
     }
 }
 
-IOManager::IOManager(size_t thread_size, bool use_caller, std::string name):Scheduler(thread_size, use_caller, name)
+IOManager::IOManager(size_t thread_size, bool use_caller, std::string name, size_t max_thread_size)
+    :Scheduler(thread_size, use_caller, name, max_thread_size)
 {
     LOG_DEBUG(g_logger, "调用IOManager::IOManager()");
-    
-    m_epoll_fd = epoll_create(0xffff);
-    if(m_epoll_fd == -1) {
-        THROW_EXCEPTION_WITH_ERRNO;
+
+    if(g_iomanager_backend->getValue() == "io_uring") {
+        m_uring = IoUring::create(g_iomanager_uring_entries->getValue());
+        if(!m_uring) {
+            LOG_FORMAT_WARN(g_logger, "IOManager %s: io_uring unsupported, falling back to epoll", m_name.c_str());
+        }
     }
-    if(pipe(m_tickle_fds) == -1) {  //创建管道
-        THROW_EXCEPTION_WITH_ERRNO;
+    if(m_uring) {
+        m_epoll_fd = -1;
+        m_sqe_backlog = std::make_unique<SqeBacklog>();
+        ScopedLock lock(&m_uring_mutex);
+        io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_POLL_ADD;
+        sqe.fd = m_waker.fd();
+        sqe.poll32_events = POLLIN;
+        sqe.user_data = URING_TICKLE;
+        queueSqes(&sqe, 1);
+        m_uring->publish();
     }
-    epoll_event event;
-    event.data.fd = m_tickle_fds[0];
-    event.events = EPOLLIN | EPOLLET;   //监听读事件|开启边缘触发
-
-    if(fcntl(m_tickle_fds[0], F_SETFL, O_NONBLOCK)){//将管道读端设置为非阻塞模式
-        THROW_EXCEPTION_WITH_ERRNO;
+    else {
+        m_epoll_fd = epoll_create(0xffff);
+        if(m_epoll_fd == -1) {
+            THROW_EXCEPTION_WITH_ERRNO;
+        }
+        epoll_event event;
+        event.data.fd = m_waker.fd();
+        event.events = EPOLLIN | EPOLLET;   //监听读事件|开启边缘触发
+        if(epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_waker.fd(), &event) == -1) {
+            THROW_EXCEPTION_WITH_ERRNO;
+        }
+        m_persistent = g_iomanager_persistent->getValue();
+        m_per_thread = g_iomanager_per_thread_epoll->getValue();
+    }
+    if(m_per_thread) {
+        for(size_t i = 0; i < m_workers.size(); i++) {
+            auto poller = std::make_unique<Poller>();
+            poller->m_epoll_fd = epoll_create(0xffff);
+            if(poller->m_epoll_fd == -1) {
+                THROW_EXCEPTION_WITH_ERRNO;
+            }
+            epoll_event event;
+            event.data.fd = poller->m_waker.fd();
+            event.events = EPOLLIN | EPOLLET;
+            if(epoll_ctl(poller->m_epoll_fd, EPOLL_CTL_ADD, poller->m_waker.fd(), &event) == -1) {
+                THROW_EXCEPTION_WITH_ERRNO;
+            }
+            m_pollers.push_back(std::move(poller));
+        }
     }
-    if(epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_tickle_fds[0], &event) == -1) {
-        THROW_EXCEPTION_WITH_ERRNO;
+    rlimit limit;
+    size_t max_fds = MAX_FD_TABLE_SIZE;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_max != RLIM_INFINITY) {
+        //软限制可以在运行时提高到硬限制，按硬限制分配第一级
+        max_fds = std::min<size_t>(std::max(limit.rlim_cur, limit.rlim_max), MAX_FD_TABLE_SIZE);
     }
-    contentListResize(64);
+    m_fd_chunk_count = (max_fds + FD_CHUNK_SIZE - 1) / FD_CHUNK_SIZE;
+    m_fd_chunks = std::make_unique<std::atomic<FDContent*>[]>(m_fd_chunk_count);
+    getFdContent(0, true);  //预先分配第一块，常用的小fd不需要在事件路径上分配
+    m_max_events = std::max<size_t>(g_iomanager_max_events->getValue(), MIN_EPOLL_EVENTS);
+    m_loop_budget = std::max<size_t>(g_iomanager_loop_budget->getValue(), 1);
+    m_loop_max_batch = MIN_EPOLL_EVENTS;
+    m_busy_poll_us = g_iomanager_busy_poll_us->getValue();
+    m_busy_poll_threads = g_iomanager_busy_poll_threads->getValue();
+    m_socket_busy_poll_us = static_cast<int>(g_iomanager_socket_busy_poll_us->getValue());
     start();    //启动调度器
 }
 
@@ -73,9 +205,16 @@ IOManager::~IOManager()
 {
     stop(); 
 
-    close(m_epoll_fd);
-    close(m_tickle_fds[0]);
-    close(m_tickle_fds[1]);
+    m_uring.reset();
+    if(m_epoll_fd >= 0) {
+        close(m_epoll_fd);
+    }
+    for(auto& poller : m_pollers) {
+        close(poller->m_epoll_fd);
+    }
+    for(size_t i = 0; i < m_fd_chunk_count; i++) {
+        delete[] m_fd_chunks[i].load();
+    }
 }
 
 IOManager* IOManager::getThis()
@@ -83,46 +222,78 @@ IOManager* IOManager::getThis()
     return dynamic_cast<IOManager*>(Scheduler::getThis());
 }
 
-void IOManager::contentListResize(size_t size)
+FDContent* IOManager::getFdContent(int fd, bool auto_create)
 {
-    m_fd_content_list.resize(size);
-    for(size_t i = 0; i<m_fd_content_list.size(); i++) {
-        if(!m_fd_content_list[i]) {
-            m_fd_content_list[i] = std::make_unique<FDContent>();
-            m_fd_content_list[i]->m_fd = i;
+    if(fd < 0 || static_cast<size_t>(fd) / FD_CHUNK_SIZE >= m_fd_chunk_count) {
+        return nullptr;
+    }
+    size_t index = fd / FD_CHUNK_SIZE;
+    FDContent* chunk = m_fd_chunks[index].load(std::memory_order_acquire);
+    if(!chunk) {
+        if(!auto_create) {
+            return nullptr;
+        }
+        auto new_chunk = std::make_unique<FDContent[]>(FD_CHUNK_SIZE);
+        for(size_t i = 0; i < FD_CHUNK_SIZE; i++) {
+            new_chunk[i].m_fd = static_cast<int>(index * FD_CHUNK_SIZE + i);
+        }
+        //多个线程同时分配同一块时只有一个发布成功，其余的使用已经发布的块
+        if(m_fd_chunks[index].compare_exchange_strong(chunk, new_chunk.get(),
+                                                      std::memory_order_acq_rel, std::memory_order_acquire)) {
+            chunk = new_chunk.release();
         }
     }
+    return &chunk[fd % FD_CHUNK_SIZE];
 }
 
-int IOManager::addEventListener(int fd, FDEventType event_type, std::function<void()> cb)
+int IOManager::addEventListener(int fd, FDEventType event_type, Fiber::FiberFunc cb, TaskPriority priority)
 {
-    FDContent* fd_ctx = nullptr;
-    ReadScopedLock lock(&m_lock);
     //取对应fd的文件描述符对象
-    if(m_fd_content_list.size() > static_cast<size_t>(fd)) {
-        fd_ctx = m_fd_content_list[fd].get();
-        lock.unlock();
-    }
-    else {
-        lock.unlock();  
-        WriteScopedLock lock2(&m_lock);     //扩容，取对应的对象
-        contentListResize(m_fd_content_list.size()*2);
-        fd_ctx = m_fd_content_list[fd].get();
+    FDContent* fd_ctx = getFdContent(fd, true);
+    if(!fd_ctx) {
+        LOG_FORMAT_ERROR(g_logger, "IOManager::addEventListener fd超出RLIMIT_NOFILE，fd = %d", fd);
+        return -1;
     }
-    ScopedLock lock3(&fd_ctx->m_mutex);
+    ScopedSpinLock lock3(&fd_ctx->m_lock);
     if(fd_ctx->m_event_type & event_type) { //检查要监听的事件是否存在
         LOG_FORMAT_ERROR(g_logger, "IOManager::addEventListener 重复添加相同的事件，fd = %d, event_type = %d", fd, event_type);
         assert(!(fd_ctx->m_event_type & event_type));
     }
-    int op = fd_ctx->m_event_type == FDEventType::NONE ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    if(m_per_thread && fd_ctx->m_owner < 0) {
+        fd_ctx->m_owner = static_cast<int>(pickOwner());
+        ++m_pollers[fd_ctx->m_owner]->m_fd_count;
+    }
+    if(m_uring) {
+        ++fd_ctx->getEventHandler(event_type).m_uring_gen;
+        ScopedLock lock4(&m_uring_mutex);
+        armPoll(fd_ctx, event_type);
+    }
+    else if(m_persistent) {
+        if(!fd_ctx->m_registered) {
+            //第一次监听时注册两个方向，之后只在cancelAll时移除
+            epoll_event epevent;
+            epevent.events = EPOLLET | EPOLLIN | EPOLLOUT;
+            epevent.data.ptr = fd_ctx;
+            ++m_epoll_ctl_count;
+            if(epoll_ctl(getEpollFd(fd_ctx), EPOLL_CTL_ADD, fd, &epevent) == -1) {
+                LOG_FORMAT_ERROR(g_logger, "epoll_ctl 调用失败，fd = %d", m_epoll_fd);
+                return -1;
+            }
+            fd_ctx->m_registered = true;
+        }
+    }
+    else {
+        int op = fd_ctx->m_event_type == FDEventType::NONE ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
 
-    epoll_event epevent;
-    epevent.events = EPOLLET | fd_ctx->m_event_type | event_type;
-    epevent.data.ptr = fd_ctx;
+        epoll_event epevent;
+        epevent.events = EPOLLET | fd_ctx->m_event_type | event_type;
+        epevent.data.ptr = fd_ctx;
 
-    if(epoll_ctl(m_epoll_fd, op, fd, &epevent) == -1) {
-        LOG_FORMAT_ERROR(g_logger, "epoll_ctl 调用失败，fd = %d", m_epoll_fd);
-        return -1;
+        ++m_epoll_ctl_count;
+        if(epoll_ctl(getEpollFd(fd_ctx), op, fd, &epevent) == -1) {
+            LOG_FORMAT_ERROR(g_logger, "epoll_ctl 调用失败，fd = %d", m_epoll_fd);
+            return -1;
+        }
     }
 
     ++m_pending_event_count;
@@ -132,40 +303,51 @@ int IOManager::addEventListener(int fd, FDEventType event_type, std::function<vo
     assert(event_handler.m_scheduler == nullptr && !event_handler.m_fiber && !event_handler.m_callback);
 
     event_handler.m_scheduler = this;
+    event_handler.m_priority = priority;
     if(cb) {
-        event_handler.m_callback.swap(cb);
+        event_handler.m_callback = std::move(cb);
+        event_handler.m_deadline_us = Fiber::getThisDeadline();
     }
     else{
         //当callback时nullptr时，将当前上下文转换为协程，并作为时间回调使用
         event_handler.m_fiber = Fiber::getThis();
     }
+    if(fd_ctx->m_ready & event_type) {
+        //边沿在没有监听者时已经到达，不会再通知，立即触发；可能是已经被消费的旧边沿，调用方重试时会重新监听
+        fd_ctx->m_ready = static_cast<FDEventType>(fd_ctx->m_ready & ~event_type);
+        fd_ctx->triggerEvent(event_type, getOwnerThreadId(fd_ctx));
+        --m_pending_event_count;
+    }
     return 0;
 }
 
 int IOManager::removeEventListener(int fd, FDEventType event_type)
 {
-    FDContent* fd_ctx = nullptr;
-    {
-        ReadScopedLock lock(&m_lock);
-        if(m_fd_content_list.size() <= static_cast<size_t>(fd)) {
-            return false;
-        }
-        fd_ctx = m_fd_content_list[fd].get();
+    FDContent* fd_ctx = getFdContent(fd, false);
+    if(!fd_ctx) {
+        return false;
     }
-    ScopedLock lock2(&(fd_ctx->m_mutex));
+    ScopedSpinLock lock2(&fd_ctx->m_lock);
     if(!(fd_ctx->m_event_type & event_type)) {  //要移除的事件不存在
         return false;       
     }
     //从epoll上移除该事件的监听
     auto new_event_type = static_cast<FDEventType>(fd_ctx->m_event_type & ~event_type);
-    //如果new_event为0，从epoll中移除对该fd的监听，否则修改监听事件
-    int op = new_event_type == FDEventType::NONE ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
-    epoll_event epevent;
-    epevent.events = EPOLLET | new_event_type;
-    epevent.data.ptr = fd_ctx;
-    if(epoll_ctl(m_epoll_fd, op, fd, &epevent) == -1) {
-        LOG_FORMAT_ERROR(g_logger, "removeEventListener epoll_ctl error, epfd = %d", m_epoll_fd);
-        THROW_EXCEPTION_WITH_ERRNO;
+    if(m_uring) {
+        ScopedLock lock3(&m_uring_mutex);
+        removePoll(fd_ctx, event_type);
+    }
+    else if(!m_persistent) {
+        //如果new_event为0，从epoll中移除对该fd的监听，否则修改监听事件
+        ++m_epoll_ctl_count;
+        int op = new_event_type == FDEventType::NONE ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+        epoll_event epevent;
+        epevent.events = EPOLLET | new_event_type;
+        epevent.data.ptr = fd_ctx;
+        if(epoll_ctl(getEpollFd(fd_ctx), op, fd, &epevent) == -1) {
+            LOG_FORMAT_ERROR(g_logger, "removeEventListener epoll_ctl error, epfd = %d", m_epoll_fd);
+            THROW_EXCEPTION_WITH_ERRNO;
+        }
     }
     fd_ctx->m_event_type = new_event_type;
     auto& event_handler = fd_ctx->getEventHandler(event_type);
@@ -176,72 +358,479 @@ int IOManager::removeEventListener(int fd, FDEventType event_type)
 
 bool IOManager::cancelEventListener(int fd, FDEventType event_type)
 {
-    FDContent* fd_ctx = nullptr;
-    {
-        ReadScopedLock lock(&m_lock);
-        if(m_fd_content_list.size() <=  static_cast<size_t>(fd)) {
-            return false;
-        }
-        fd_ctx = m_fd_content_list[fd].get();
+    FDContent* fd_ctx = getFdContent(fd, false);
+    if(!fd_ctx) {
+        return false;
     }
-    ScopedLock lock2(&(fd_ctx->m_mutex));
+    ScopedSpinLock lock2(&fd_ctx->m_lock);
     if(!(fd_ctx->m_event_type & event_type)) {
         return false;
     }
 
     auto new_event_type = static_cast<FDEventType>(fd_ctx->m_event_type & ~event_type);
-    int op = new_event_type == FDEventType::NONE ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
-    epoll_event epevent;
-    epevent.events = EPOLLET | new_event_type;
-    epevent.data.ptr = fd_ctx;
-    if(epoll_ctl(m_epoll_fd, op, fd, &epevent) == -1) {
-        LOG_FORMAT_ERROR(g_logger, "cancelEventListener epoll_ctl error, epfd = %d", m_epoll_fd);
-        THROW_EXCEPTION_WITH_ERRNO;
+    if(m_uring) {
+        ScopedLock lock3(&m_uring_mutex);
+        removePoll(fd_ctx, event_type);
+    }
+    else if(!m_persistent) {
+        int op = new_event_type == FDEventType::NONE ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+        epoll_event epevent;
+        epevent.events = EPOLLET | new_event_type;
+        epevent.data.ptr = fd_ctx;
+        ++m_epoll_ctl_count;
+        if(epoll_ctl(getEpollFd(fd_ctx), op, fd, &epevent) == -1) {
+            LOG_FORMAT_ERROR(g_logger, "cancelEventListener epoll_ctl error, epfd = %d", m_epoll_fd);
+            THROW_EXCEPTION_WITH_ERRNO;
+        }
     }
     fd_ctx->m_event_type = new_event_type;
-    fd_ctx->triggerEvent(event_type);
+    fd_ctx->triggerEvent(event_type, getOwnerThreadId(fd_ctx));
     --m_pending_event_count;
     return true;
 }
 
 bool IOManager::cancelAll(int fd)
 {
-    FDContent* fd_ctx = nullptr;
-    {
-        ReadScopedLock lock(&m_lock);
-        if(m_fd_content_list.size() <= static_cast<size_t>(fd)) {
-            return false;
+    if(m_uring && m_uring_inflight > 0) {
+        //submitIO的操作不在fd表中，按fd取消，完成项为-ECANCELED
+        //内核按fd查找文件，必须在close之前立即提交，不能放入积压队列等下一次等待时再提交
+        io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_ASYNC_CANCEL;
+        sqe.fd = fd;
+        sqe.cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        sqe.user_data = URING_TAG_IGNORE;
+        while(true) {
+            {
+                ScopedLock lock(&m_uring_mutex);
+                if(queueSqes(&sqe, 1, false)) {
+                    m_uring->publish();
+                    m_uring->submit();
+                    break;
+                }
+            }
+            //队列已满，不持有任何锁等待：没有线程在处理完成项时由当前线程处理
+            bool polling = false;
+            if(m_polling.compare_exchange_strong(polling, true)) {
+                reapUring();
+                m_polling = false;
+            }
+            else {
+                sched_yield();
+            }
         }
-        fd_ctx = m_fd_content_list[fd].get();
     }
-    ScopedLock lock2(&(fd_ctx->m_mutex));
+    FDContent* fd_ctx = getFdContent(fd, false);
+    if(!fd_ctx) {
+        return false;
+    }
+    ScopedSpinLock lock2(&fd_ctx->m_lock);
+    if(m_persistent && fd_ctx->m_registered) {
+        //fd即将关闭，移除注册并清除记录的边沿，复用该fd时重新注册
+        ++m_epoll_ctl_count;
+        if(epoll_ctl(getEpollFd(fd_ctx), EPOLL_CTL_DEL, fd, nullptr) == -1) {
+            LOG_FORMAT_ERROR(g_logger, "cancelAll epoll_ctl error, epfd = %d", m_epoll_fd);
+        }
+        fd_ctx->m_registered = false;
+        fd_ctx->m_ready = FDEventType::NONE;
+    }
+    int owner = fd_ctx->m_owner;
+    if(owner >= 0 && !fd_ctx->m_event_type) {
+        //fd即将关闭，解除绑定，复用该fd时重新选择线程
+        --m_pollers[owner]->m_fd_count;
+        fd_ctx->m_owner = -1;
+    }
     if(!(fd_ctx->m_event_type)) {
         return false;
     }
-    if(epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr) == -1) {
-        LOG_FORMAT_ERROR(g_logger, "cancelAll epoll_ctl error, epfd = %d", m_epoll_fd);
-        THROW_EXCEPTION_WITH_ERRNO;
+    if(m_uring) {
+        ScopedLock lock3(&m_uring_mutex);
+        if(fd_ctx->m_event_type & FDEventType::READ) {
+            removePoll(fd_ctx, FDEventType::READ);
+        }
+        if(fd_ctx->m_event_type & FDEventType::WRITE) {
+            removePoll(fd_ctx, FDEventType::WRITE);
+        }
+    }
+    else if(!m_persistent) {
+        ++m_epoll_ctl_count;
+        if(epoll_ctl(getEpollFd(fd_ctx), EPOLL_CTL_DEL, fd, nullptr) == -1) {
+            LOG_FORMAT_ERROR(g_logger, "cancelAll epoll_ctl error, epfd = %d", m_epoll_fd);
+            THROW_EXCEPTION_WITH_ERRNO;
+        }
     }
+    long owner_thread = getOwnerThreadId(fd_ctx);
     if(fd_ctx->m_event_type & FDEventType::READ) {
-        fd_ctx->triggerEvent(FDEventType::READ);
+        fd_ctx->triggerEvent(FDEventType::READ, owner_thread);
         --m_pending_event_count;
     }
     if(fd_ctx->m_event_type & FDEventType::WRITE) {
-        fd_ctx->triggerEvent(FDEventType::WRITE);
+        fd_ctx->triggerEvent(FDEventType::WRITE, owner_thread);
         --m_pending_event_count;
     }
     fd_ctx->m_event_type = FDEventType::NONE;
+    if(owner >= 0) {
+        --m_pollers[owner]->m_fd_count;
+        fd_ctx->m_owner = -1;
+    }
     return true;
 }
 
 void IOManager::tickle()
 {
-    if(hasFreeThread()) {
+    //优先唤醒一个阻塞在futex上的空闲线程，没有时唤醒正在epoll_wait的线程
+    if(!wakeParkedWorker()) {
+        ticklePoller();
+    }
+}
+
+void IOManager::tickle(SchedulerWorker* worker)
+{
+    if(worker->m_idle_state == SchedulerWorker::POLLING) {
+        if(m_per_thread) {
+            m_pollers[getWorkerIndex(worker)]->m_waker.wake();
+            return;
+        }
+        //只有一个线程阻塞在epoll_wait上，唤醒器只会唤醒它
+        ticklePoller();
+    }
+    else {
+        Scheduler::tickle(worker);
+    }
+}
+
+void IOManager::ticklePoller()
+{
+    if(m_per_thread) {
+        //每个空闲线程都在等待自己的epoll，唤醒一个正在睡眠、还没有被唤醒的线程
+        for(auto& poller : m_pollers) {
+            if(poller->m_waker.wake()) {
+                return;
+            }
+        }
+        return;
+    }
+    //等待线程没有睡眠或已经有未消费的唤醒时不写eventfd
+    m_waker.wake();
+}
+
+uint64_t IOManager::getTickleCount() const
+{
+    uint64_t count = m_waker.getWriteCount();
+    for(auto& poller : m_pollers) {
+        count += poller->m_waker.getWriteCount();
+    }
+    return count;
+}
+
+IOManager::Backend IOManager::getBackend() const
+{
+    return m_uring ? BACKEND_IO_URING : BACKEND_EPOLL;
+}
+
+int IOManager::getWorkerIndex(SchedulerWorker* worker) const
+{
+    for(size_t i = 0; i < m_workers.size(); i++) {
+        if(m_workers[i].get() == worker) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+bool IOManager::isOwnerAlive(size_t index) const
+{
+    const auto& worker = m_workers[index];
+    return worker->m_idle_state != SchedulerWorker::RETIRED && !worker->m_retiring;
+}
+
+size_t IOManager::pickOwner()
+{
+    int index = getWorkerIndex(getThisWorker());
+    if(index >= 0 && isOwnerAlive(index)) {
+        return index;
+    }
+    //不在调度线程中注册（如accept之前在主线程创建的fd），轮流分配到有线程运行的槽位
+    size_t count = m_workers.size();
+    size_t start = m_next_owner.fetch_add(1, std::memory_order_relaxed);
+    for(size_t i = 0; i < count; i++) {
+        size_t candidate = (start + i) % count;
+        if(isOwnerAlive(candidate)) {
+            return candidate;
+        }
+    }
+    return start % count;
+}
+
+int IOManager::getEpollFd(FDContent* fd_ctx) const
+{
+    if(m_per_thread && fd_ctx->m_owner >= 0) {
+        return m_pollers[fd_ctx->m_owner]->m_epoll_fd;
+    }
+    return m_epoll_fd;
+}
+
+long IOManager::getOwnerThreadId(FDContent* fd_ctx) const
+{
+    if(!m_per_thread || fd_ctx->m_owner < 0) {
+        return -1;
+    }
+    return m_workers[fd_ctx->m_owner]->m_thread_id;
+}
+
+int IOManager::getFdOwner(int fd)
+{
+    FDContent* fd_ctx = getFdContent(fd, false);
+    return fd_ctx ? fd_ctx->m_owner : -1;
+}
+
+size_t IOManager::getOwnedFdCount(size_t index) const
+{
+    return index < m_pollers.size() ? m_pollers[index]->m_fd_count.load() : 0;
+}
+
+bool IOManager::migrate(int fd, size_t index)
+{
+    //没有线程或正在退出的槽位不会再等待它的epoll，迁移过去的fd永远不会就绪
+    if(!m_per_thread || index >= m_pollers.size() || !isOwnerAlive(index)) {
+        return false;
+    }
+    FDContent* fd_ctx = getFdContent(fd, false);
+    if(!fd_ctx) {
+        return false;
+    }
+    ScopedSpinLock lock2(&fd_ctx->m_lock);
+    int owner = fd_ctx->m_owner;
+    if(owner == static_cast<int>(index)) {
+        return true;
+    }
+    bool in_epoll = m_persistent ? fd_ctx->m_registered : fd_ctx->m_event_type != FDEventType::NONE;
+    if(owner >= 0 && in_epoll) {
+        //新的epoll以边沿触发加入时会报告当前已经就绪的方向，迁移期间的边沿不会丢失
+        epoll_event epevent;
+        epevent.events = EPOLLET | (m_persistent ? static_cast<uint32_t>(EPOLLIN | EPOLLOUT)
+                                                 : static_cast<uint32_t>(fd_ctx->m_event_type));
+        epevent.data.ptr = fd_ctx;
+        m_epoll_ctl_count += 2;
+        if(epoll_ctl(m_pollers[owner]->m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr) == -1) {
+            LOG_FORMAT_ERROR(g_logger, "migrate fd %d from %d to %lu error: %s", fd, owner, index, strerror(errno));
+            return false;
+        }
+        if(epoll_ctl(m_pollers[index]->m_epoll_fd, EPOLL_CTL_ADD, fd, &epevent) == -1) {
+            LOG_FORMAT_ERROR(g_logger, "migrate fd %d from %d to %lu error: %s", fd, owner, index, strerror(errno));
+            //放回原来的epoll，否则fd不在任何epoll中，m_owner却仍指向原线程
+            ++m_epoll_ctl_count;
+            if(epoll_ctl(m_pollers[owner]->m_epoll_fd, EPOLL_CTL_ADD, fd, &epevent) == -1) {
+                LOG_FORMAT_ERROR(g_logger, "migrate fd %d restore to %d error: %s", fd, owner, strerror(errno));
+            }
+            return false;
+        }
+    }
+    if(owner >= 0) {
+        --m_pollers[owner]->m_fd_count;
+    }
+    ++m_pollers[index]->m_fd_count;
+    fd_ctx->m_owner = static_cast<int>(index);
+    return true;
+}
+
+void IOManager::migrateOwned(size_t index)
+{
+    std::vector<int> fds;
+    for(size_t i = 0; i < m_fd_chunk_count; i++) {
+        FDContent* chunk = m_fd_chunks[i].load(std::memory_order_acquire);
+        if(!chunk) {
+            continue;
+        }
+        for(size_t j = 0; j < FD_CHUNK_SIZE; j++) {
+            if(chunk[j].m_owner == static_cast<int>(index)) {
+                fds.push_back(chunk[j].m_fd);
+            }
+        }
+    }
+    for(int fd : fds) {
+        size_t target = pickOwner();
+        if(target != index) {
+            migrate(fd, target);
+        }
+    }
+}
+
+bool IOManager::queueSqes(const io_uring_sqe* sqes, size_t count, bool allow_backlog)
+{
+    auto& groups = m_sqe_backlog->m_groups;
+    if(groups.empty() && m_uring->getSpace() < count) {
+        m_uring->publish();
+        m_uring->submit();  //完成队列溢出时返回EBUSY，不在这里等待
+    }
+    //有积压时新的提交项也进入积压队列，保持提交顺序
+    if(!groups.empty() || m_uring->getSpace() < count) {
+        if(!allow_backlog) {
+            return false;
+        }
+        groups.emplace_back(sqes, sqes + count);
+        ++m_sqe_backlog_count;
+        return true;
+    }
+    for(size_t i = 0; i < count; i++) {
+        *m_uring->getSqe() = sqes[i];
+    }
+    return true;
+}
+
+void IOManager::armPoll(FDContent* fd_ctx, FDEventType event_type)
+{
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_POLL_ADD;
+    sqe.fd = fd_ctx->m_fd;
+    sqe.poll32_events = event_type == FDEventType::READ ? POLLIN : POLLOUT;
+    sqe.user_data = uringPollData(fd_ctx, event_type, fd_ctx->getEventHandler(event_type).m_uring_gen);
+    queueSqes(&sqe, 1);
+    publishSqes();
+}
+
+void IOManager::removePoll(FDContent* fd_ctx, FDEventType event_type)
+{
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_POLL_REMOVE;
+    sqe.addr = uringPollData(fd_ctx, event_type, fd_ctx->getEventHandler(event_type).m_uring_gen);
+    sqe.user_data = URING_TAG_IGNORE;
+    queueSqes(&sqe, 1);
+    publishSqes();
+}
+
+void IOManager::publishSqes()
+{
+    m_uring->publish();
+    //发布之后再检查是否有线程正在等待，与等待线程先设置m_polling再提交的顺序配合，至少一方会提交这些请求
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_polling) {
+        m_uring->submit();
+    }
+}
+
+bool IOManager::isSubmitIOSupported() const
+{
+    //cancelAll依赖按fd取消，否则关闭fd时挂起在submitIO上的协程不会被唤醒
+    return m_uring && m_uring->supportsCancelFd();
+}
+
+int IOManager::submitIO(int fd, FDEventType event_type, const std::function<void(io_uring_sqe*)>& prep)
+{
+    assert(isSubmitIOSupported());
+    assert(!Fiber::getThis()->isSharedStack());
+    auto request = std::make_unique<UringRequest>();
+    ++m_pending_event_count;
+    ++m_uring_inflight;
+    {
+        ScopedLock lock(&m_uring_mutex);
+        //先等待fd就绪，再执行操作，poll失败时操作以-ECANCELED结束
+        io_uring_sqe sqes[2];
+        memset(sqes, 0, sizeof(sqes));
+        sqes[0].opcode = IORING_OP_POLL_ADD;
+        sqes[0].fd = fd;
+        sqes[0].poll32_events = event_type == FDEventType::READ ? POLLIN : POLLOUT;
+        sqes[0].flags = IOSQE_IO_LINK;
+        sqes[0].user_data = URING_TAG_IGNORE;
+        prep(&sqes[1]);
+        sqes[1].user_data = reinterpret_cast<uint64_t>(request.get()) | URING_TAG_REQUEST;
+        queueSqes(sqes, 2);
+        publishSqes();
+    }
+    request->m_parker.park();
+    return request->m_result;
+}
+
+void IOManager::pollUring(SchedulerWorker* worker, uint64_t timeout_ms)
+{
+    //一次提交本轮调度中积累的所有请求，再等待完成项；积压的提交项先放入，否则可能一直等到超时
+    flushSqeBacklog();
+    while(!hasTask(worker)) {
+        int result = m_uring->submit(true, timeout_ms);
+        if(result >= 0 || errno != EINTR) {
+            break;
+        }
+    }
+    m_uring->submit();
+    reapUring();
+}
+
+void IOManager::reapUring()
+{
+    m_uring->reap([this](const io_uring_cqe* cqe){
+        onCompletion(cqe->user_data, cqe->res);
+    });
+    flushSqeBacklog();
+}
+
+void IOManager::flushSqeBacklog()
+{
+    if(m_sqe_backlog_count == 0) {
         return;
     }
-    if(write(m_tickle_fds[1], "T", 1) == -1) {
-        throw SystemException("send message to child thread error");
+    //按顺序放入积压的提交项，链接的一组不拆开
+    ScopedLock lock(&m_uring_mutex);
+    auto& groups = m_sqe_backlog->m_groups;
+    while(!groups.empty()) {
+        if(m_uring->getSpace() < groups.front().size()) {
+            //先提交已经放入的部分，内核取走之后才有空间，提交不了时留给下一轮
+            m_uring->publish();
+            if(m_uring->submit() <= 0) {
+                break;
+            }
+            continue;
+        }
+        for(auto& sqe : groups.front()) {
+            *m_uring->getSqe() = sqe;
+        }
+        groups.pop_front();
+        --m_sqe_backlog_count;
     }
+    m_uring->publish();
+    m_uring->submit();
+}
+
+void IOManager::onCompletion(uint64_t user_data, int result)
+{
+    uint64_t tag = user_data & URING_TAG_MASK;
+    if(tag == URING_TAG_IGNORE) {
+        if(user_data == URING_TICKLE) {
+            m_waker.consume();
+            ScopedLock lock(&m_uring_mutex);
+            io_uring_sqe sqe;
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_POLL_ADD;
+            sqe.fd = m_waker.fd();
+            sqe.poll32_events = POLLIN;
+            sqe.user_data = URING_TICKLE;
+            queueSqes(&sqe, 1);
+            m_uring->publish();     //由当前线程下一次等待时提交
+        }
+        return;
+    }
+    if(tag == URING_TAG_REQUEST) {
+        auto request = reinterpret_cast<UringRequest*>(user_data & ~URING_TAG_MASK);
+        request->m_result = result;
+        --m_uring_inflight;
+        --m_pending_event_count;
+        request->m_parker.unpark();
+        return;
+    }
+    if(result == -ECANCELED) {
+        return;     //已经被removePoll移除
+    }
+    auto fd_ctx = reinterpret_cast<FDContent*>(user_data & URING_PTR_MASK);
+    FDEventType event_type = tag == URING_TAG_READ ? FDEventType::READ : FDEventType::WRITE;
+    uint16_t gen = user_data >> URING_GEN_SHIFT;
+    ScopedSpinLock lock(&fd_ctx->m_lock);
+    //事件已经被移除或重新注册，这是之前的poll迟到的完成项
+    if(!(fd_ctx->m_event_type & event_type) || fd_ctx->getEventHandler(event_type).m_uring_gen != gen) {
+        return;
+    }
+    fd_ctx->triggerEvent(event_type);
+    --m_pending_event_count;
 }
 
 bool IOManager::isStop()
@@ -259,10 +848,31 @@ bool IOManager::isStop(uint64_t& timeout)
 void IOManager::onFree()
 {
     LOG_DEBUG(g_logger, "调用 IOManager::onFree()");
-    auto event_list = std::make_unique<epoll_event[]>(64);
+    size_t batch_size = MIN_EPOLL_EVENTS;
+    std::vector<epoll_event> event_list(batch_size);
+    int ready = 0;  //上一次epoll_wait返回的事件数
+    int next = 0;   //下一个要分发的事件，小于ready时说明上一轮超出了预算
+    SchedulerWorker* worker = getThisWorker();
+    bool busy_poll = m_busy_poll_us > 0 && static_cast<size_t>(getWorkerIndex(worker)) < m_busy_poll_threads;
+    int epoll_fd = m_epoll_fd;
+    EventFdWaker* waker = &m_waker;
+    if(m_per_thread) {
+        Poller* poller = m_pollers[getWorkerIndex(worker)].get();
+        epoll_fd = poller->m_epoll_fd;
+        waker = &poller->m_waker;
+    }
 
     while(true)
     {
+        if(next < ready) {
+            //上一轮剩下的事件已经从epoll取出，不会再报告，先分发完再检查停止、缩容和等待
+            dispatchIteration(waker, event_list.data(), next, ready);
+            Fiber::_ptr current_fiber = Fiber::getThis();
+            auto raw_ptr = current_fiber.get();
+            current_fiber.reset();
+            raw_ptr->swapOut();
+            continue;
+        }
         uint64_t next_timeout = 0;
         if(isStop(next_timeout)) {
             if(next_timeout == ~0ull) {
@@ -270,77 +880,77 @@ void IOManager::onFree()
                 break;
             }
         }
+        if(checkRetire(worker)) {
+            if(m_per_thread) {
+                migrateOwned(getWorkerIndex(worker));   //退出后没有线程等待它的epoll
+            }
+            break;  //缩容时退出的线程
+        }
+        if(spinForTask(worker)) {
+            Fiber::_ptr current_fiber = Fiber::getThis();
+            auto raw_ptr = current_fiber.get();
+            current_fiber.reset();
+            raw_ptr->swapOut();
+            continue;
+        }
+        //同一时间只有一个空闲线程阻塞在epoll_wait上，其余空闲线程阻塞在各自的futex上，
+        //这样唤醒指定线程时不会惊动其他线程
+        //每线程epoll模式下每个空闲线程等待自己的epoll
+        bool polling = false;
+        if(!m_per_thread && !m_polling.compare_exchange_strong(polling, true)) {
+            parkWorker(worker, MAX_IDLE_TIMEOUT);
+            Fiber::_ptr current_fiber = Fiber::getThis();
+            auto raw_ptr = current_fiber.get();
+            current_fiber.reset();
+            raw_ptr->swapOut();
+            continue;
+        }
+        worker->m_idle_state = SchedulerWorker::POLLING;
+        event_list.resize(batch_size);  //上一批事件已经分发完
         int result = 0;
-        while(true) 
-        {
-            static const int MAX_TIMEOUT = 1000;
+        if(!busy_poll || !busyPoll(worker, epoll_fd, event_list.data(), static_cast<int>(batch_size), result)) {
+            //进入SLEEPING之后重新计算超时时间，之前插入的定时器由唤醒器补上
+            waker->prepareWait();
+            next_timeout = getNextTimer();
             if(next_timeout != ~0ull) {
-                next_timeout = static_cast<int>(next_timeout) > MAX_TIMEOUT ? MAX_TIMEOUT:next_timeout; 
+                next_timeout = static_cast<int>(next_timeout) > MAX_IDLE_TIMEOUT ? MAX_IDLE_TIMEOUT:next_timeout; 
             }
             else {
-                next_timeout = MAX_TIMEOUT;
-            }
-            result = epoll_wait(m_epoll_fd, event_list.get(), 64, static_cast<int>(next_timeout));
-            if(result < 0) {
-
+                next_timeout = MAX_IDLE_TIMEOUT;
             }
-            if(result >= 0) {
-                break;
+            if(m_uring) {
+                //完成队列只能由一个线程消费，处理完所有完成项之后再释放m_polling
+                pollUring(worker, next_timeout);
             }
-        }
-
-        std::vector<std::function<void()>> fns;
-        listExpiredCallback(fns);
-        if(!fns.empty()) {
-            schedule(fns.begin(), fns.end());
-        }
-
-        for(int i = 0; i < result; i++) {
-            epoll_event& ev = event_list[i];
-            if(ev.data.fd == m_tickle_fds[0]) {
-                char dummy;
-                while(true) {
-                    int status = read(ev.data.fd, &dummy, 1);
-                    if(status == 0 || status == -1) {
+            else {
+                while(!hasTask(worker))     //进入POLLING状态之后再检查一次任务，避免错过唤醒
+                {
+                    ++m_epoll_wait_count;
+                    result = epoll_wait(epoll_fd, event_list.data(), static_cast<int>(batch_size), static_cast<int>(next_timeout));
+                    if(result >= 0) {
                         break;
                     }
                 }
-                continue;
-            }
-
-            auto fd_ctx = static_cast<FDContent*>(ev.data.ptr);
-            ScopedLock lock(&(fd_ctx->m_mutex));
-            if(ev.events & (EPOLLERR | EPOLLHUP)) {
-                ev.events |= EPOLLIN | EPOLLOUT;
-            }
-            uint32_t real_event = FDEventType::NONE;
-            if(ev.events & EPOLLIN) {
-                real_event |= FDEventType::READ;
-            }
-            if(ev.events & EPOLLOUT) {
-                real_event != FDEventType::WRITE;
-            }
-
-            if((fd_ctx->m_event_type & real_event) == FDEventType::NONE) {
-                continue;
             }
+            waker->finishWait();
+        }
+        worker->m_idle_state = SchedulerWorker::RUNNING;
+        if(!m_per_thread) {
+            m_polling = false;
+        }
 
-            uint32_t left_events = (fd_ctx->m_event_type & ~real_event);
-            int op = left_events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
-            ev.events = EPOLLET | left_events;
-            if(epoll_ctl(m_epoll_fd, op, fd_ctx->m_fd, &ev) == -1) {
-                LOG_FORMAT_ERROR(g_logger, "epoll_ctl(%d, %d, %d, %ul) :  errno = %d, %s",
-                    m_epoll_fd, op, fd_ctx->m_fd, ev.events, errno, strerror(errno));
-            }
-            if(real_event & FDEventType::READ) {
-                fd_ctx->triggerEvent(FDEventType::READ);
-                --m_pending_event_count;
-            }
-            if(real_event & FDEventType::WRITE) {
-                fd_ctx->triggerEvent(FDEventType::WRITE);
-                --m_pending_event_count;
-            }
+        //批量自适应：取满说明还有事件没有取出，翻倍；明显取不满时减半，下一次等待时生效
+        if(static_cast<size_t>(result) == batch_size && batch_size < m_max_events) {
+            batch_size = std::min(batch_size * 2, m_max_events);
+            uint64_t max_batch = m_loop_max_batch;
+            while(batch_size > max_batch && !m_loop_max_batch.compare_exchange_weak(max_batch, batch_size));
+        }
+        else if(static_cast<size_t>(result) < batch_size / 4 && batch_size > MIN_EPOLL_EVENTS) {
+            batch_size /= 2;
         }
+        ready = std::max(result, 0);
+        next = 0;
+        dispatchIteration(waker, event_list.data(), next, ready);
         Fiber::_ptr current_fiber = Fiber::getThis();
         auto raw_ptr = current_fiber.get();
         current_fiber.reset();
@@ -348,9 +958,141 @@ void IOManager::onFree()
     }
 }
 
+bool IOManager::busyPoll(SchedulerWorker* worker, int epoll_fd, epoll_event* events, int max_events, int& result)
+{
+    if(m_uring) {
+        m_uring->submit();  //先提交本轮积累的请求，否则轮询不到它们的完成项
+    }
+    //唤醒器保持AWAKE，调度任务和插入定时器时不会写eventfd，这里自己检查
+    uint64_t end_us = GetCurrentUS() + m_busy_poll_us;
+    do {
+        if(hasTask(worker) || getNextTimer() == 0) {
+            return true;
+        }
+        ++m_busy_poll_count;
+        if(m_uring) {
+            if(m_uring->hasCompletions()) {
+                reapUring();
+                return true;
+            }
+        }
+        else {
+            ++m_epoll_wait_count;
+            result = epoll_wait(epoll_fd, events, max_events, 0);
+            if(result > 0) {
+                return true;
+            }
+            result = 0;
+        }
+    } while(GetCurrentUS() < end_us);
+    return false;
+}
+
+void IOManager::setSocketBusyPoll(int fd) const
+{
+    if(m_socket_busy_poll_us <= 0) {
+        return;
+    }
+    //超过net.core.busy_read的值需要CAP_NET_ADMIN，设置失败不影响socket的使用
+    int prefer = 1;
+    if(setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &m_socket_busy_poll_us, sizeof(m_socket_busy_poll_us)) == -1
+       || setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) == -1) {
+        LOG_FORMAT_DEBUG(g_logger, "setSocketBusyPoll fd = %d, errno = %d, %s", fd, errno, strerror(errno));
+    }
+}
+
+void IOManager::dispatchIteration(EventFdWaker* waker, epoll_event* events, int& next, int ready)
+{
+    uint64_t start_us = GetCurrentUS();
+    std::vector<std::function<void()>> fns;
+    std::vector<TaskPriority> priorities;
+    std::vector<uint64_t> deadlines;
+    listExpiredCallback(fns, priorities, deadlines, m_loop_budget);
+    for(size_t i = 0; i < fns.size(); i++) {
+        scheduleWithDeadline(std::move(fns[i]), deadlines[i], -1, priorities[i]);
+    }
+
+    int end = static_cast<size_t>(ready - next) > m_loop_budget ? next + static_cast<int>(m_loop_budget) : ready;
+    int dispatched = end - next;
+    for(; next < end; next++) {
+        epoll_event& ev = events[next];
+        if(ev.data.fd == waker->fd()) {
+            waker->consume();
+            continue;
+        }
+        onEpollEvent(ev);
+    }
+
+    ++m_loop_iterations;
+    m_loop_events += dispatched;
+    m_loop_timers += fns.size();
+    if(next < ready) {
+        ++m_loop_deferred;
+    }
+    m_loop_busy_us += GetCurrentUS() - start_us;
+}
+
+void IOManager::onEpollEvent(epoll_event& ev)
+{
+    auto fd_ctx = static_cast<FDContent*>(ev.data.ptr);
+    ScopedSpinLock lock(&fd_ctx->m_lock);
+    if(ev.events & (EPOLLERR | EPOLLHUP)) {
+        ev.events |= EPOLLIN | EPOLLOUT;
+    }
+    uint32_t real_event = FDEventType::NONE;
+    if(ev.events & EPOLLIN) {
+        real_event |= FDEventType::READ;
+    }
+    if(ev.events & EPOLLOUT) {
+        real_event |= FDEventType::WRITE;
+    }
+
+    if(m_persistent) {
+        //没有监听者的方向记录下来，由之后的addEventListener消费
+        fd_ctx->m_ready = static_cast<FDEventType>(fd_ctx->m_ready | (real_event & ~fd_ctx->m_event_type));
+    }
+    real_event &= fd_ctx->m_event_type;
+    if(real_event == FDEventType::NONE) {
+        return;
+    }
+
+    if(!m_persistent) {
+        uint32_t left_events = (fd_ctx->m_event_type & ~real_event);
+        int op = left_events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+        ev.events = EPOLLET | left_events;
+        ++m_epoll_ctl_count;
+        if(epoll_ctl(getEpollFd(fd_ctx), op, fd_ctx->m_fd, &ev) == -1) {
+            LOG_FORMAT_ERROR(g_logger, "epoll_ctl(%d, %d, %d, %ul) :  errno = %d, %s",
+                m_epoll_fd, op, fd_ctx->m_fd, ev.events, errno, strerror(errno));
+        }
+    }
+    //每线程epoll模式下恢复的协程留在fd绑定的线程上，不在线程之间来回迁移
+    long owner_thread = getOwnerThreadId(fd_ctx);
+    if(real_event & FDEventType::READ) {
+        fd_ctx->triggerEvent(FDEventType::READ, owner_thread);
+        --m_pending_event_count;
+    }
+    if(real_event & FDEventType::WRITE) {
+        fd_ctx->triggerEvent(FDEventType::WRITE, owner_thread);
+        --m_pending_event_count;
+    }
+}
+
+IOManager::LoopStats IOManager::getLoopStats() const
+{
+    LoopStats stats;
+    stats.m_iterations = m_loop_iterations;
+    stats.m_events = m_loop_events;
+    stats.m_timers = m_loop_timers;
+    stats.m_deferred = m_loop_deferred;
+    stats.m_busy_us = m_loop_busy_us;
+    stats.m_max_batch = m_loop_max_batch;
+    return stats;
+}
+
 void IOManager::onTimerInsertedAtFirst()
 {
-    tickle();
+    ticklePoller();     //只有epoll_wait的线程需要重新计算超时时间
 }
 
 }
\ No newline at end of file
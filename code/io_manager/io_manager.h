@@ -5,9 +5,17 @@
 #include "lock.h"
 #include "timer.h"
 #include "log.h"
+#include "waker.h"
+
+#include <functional>
+
+struct io_uring_sqe;
+struct epoll_event;
 
 namespace hxk
 {
+class IoUring;
+
 enum FDEventType
 {
     NONE = 0x0,
@@ -20,30 +28,74 @@ enum FDEventType
         Scheduler* m_scheduler;         //指定处理该事件的调度器
         Fiber::_ptr m_fiber;            //要跑的协程
         Fiber::FiberFunc m_callback;    //要跑的函数，协程和函数存在一个即可
+        TaskPriority m_priority = PRIORITY_NORMAL;  //事件触发后协程或函数被调度的优先级
+        uint64_t m_deadline_us = 0;     //函数任务的截止时间，取自注册事件的协程；协程任务使用协程自己的截止时间
+        uint16_t m_uring_gen = 0;       //io_uring后端：每次注册加1，用于忽略已经移除的poll迟到的完成项
     };
 
 struct FDContent
 {
 
-    hxk::Mutex m_mutex;
+    hxk::SpinLock m_lock;       //临界区只有状态修改和一次epoll_ctl，使用自旋锁
     EventHandler m_read_handler;
     EventHandler m_write_handler;
     int m_fd;
     FDEventType m_event_type = FDEventType::NONE;
+    bool m_registered = false;                  //持久注册模式：是否已经加入epoll
+    FDEventType m_ready = FDEventType::NONE;    //持久注册模式：已经到达、还没有被监听者消费的边沿
+    int m_owner = -1;                           //每线程epoll模式：fd绑定的调度线程槽位，-1表示还没有绑定
 
     EventHandler& getEventHandler(FDEventType type);    //获取指定事件的处理器
     void resetEventHandler(EventHandler& handler);      //清除指定的事件处理器
-    void triggerEvent(FDEventType type);                //触发事件，然后删除
+    void triggerEvent(FDEventType type, long thread_id = -1);   //触发事件，然后删除；thread_id不为-1时恢复的协程绑定到该线程
 };
 
 
+/**
+ * @Author: hxk
+ * @brief: 协程IO调度器，默认使用epoll等待fd就绪
+ *      iomanager.backend为io_uring时改用io_uring：就绪事件通过一次性的poll请求获得，
+ *      本轮调度中产生的请求在线程空闲、进入等待时一次提交；内核不支持时退回epoll
+ *      epoll后端下iomanager.persistent为true时，fd第一次监听时以EPOLLIN|EPOLLOUT|EPOLLET注册，直到cancelAll才移除，
+ *      监听和触发事件都不再调用epoll_ctl；没有监听者时到达的边沿记录在FDContent::m_ready中，
+ *      之后的addEventListener发现边沿已经到达时立即触发。fd必须经过hook的close（cancelAll）关闭，否则复用的fd不会重新注册
+ *      epoll后端下iomanager.per_thread_epoll为true时，每个调度线程有自己的epoll和唤醒器，空闲时各自等待；
+ *      fd第一次监听时绑定到当前调度线程（不是调度线程时轮流分配），之后它的事件只由该线程等待，
+ *      恢复的协程也绑定在该线程上执行；负载不均时用migrate把fd移到其他线程，线程缩容退出时它的fd移到其他线程
+ *      epoll_wait的批量大小在64到iomanager.max_events之间自适应：取满时翻倍，不到四分之一时减半；
+ *      每轮最多分发iomanager.loop_budget个就绪事件和同样多的到期定时器，超出的留到运行队列执行完之后的下一轮，
+ *      不重新等待，避免大量就绪事件让定时器和已经排队的任务等待过久
+ *      iomanager.busy_poll_us不为0时进入忙轮询模式：前iomanager.busy_poll_threads个调度线程槽位空闲时先以0超时
+ *      轮询epoll（io_uring后端轮询完成队列）最多busy_poll_us微秒，期间唤醒器保持AWAKE，调度任务不需要写eventfd，
+ *      超时后再阻塞等待；iomanager.socket_busy_poll_us不为0时hook创建和accept的socket设置SO_BUSY_POLL和SO_PREFER_BUSY_POLL
+ */
 class IOManager final : public Scheduler, public TimerManager
 {
 public:
     typedef std::shared_ptr<IOManager> _ptr;
 
+    enum Backend
+    {
+        BACKEND_EPOLL = 0,
+        BACKEND_IO_URING
+    };
+
+    //事件循环的统计，由getLoopStats汇总所有调度线程
+    struct LoopStats
+    {
+        uint64_t m_iterations = 0;      //分发的轮数
+        uint64_t m_events = 0;          //分发的就绪事件数
+        uint64_t m_timers = 0;          //分发的到期定时器数
+        uint64_t m_deferred = 0;        //超出预算、留到下一轮的轮数
+        uint64_t m_busy_us = 0;         //分发消耗的时间，不含等待
+        uint64_t m_max_batch = 0;       //epoll_wait批量大小达到过的最大值
+
+        double eventsPerIteration() const { return m_iterations ? (double)m_events / m_iterations : 0; }
+        double usPerIteration() const { return m_iterations ? (double)m_busy_us / m_iterations : 0; }
+    };
+
 public:
-    explicit IOManager(size_t thread_size, bool use_caller = false, std::string name = "");
+    explicit IOManager(size_t thread_size, bool use_caller = false, std::string name = "", size_t max_thread_size = 0);
     ~IOManager();
 
     /**
@@ -51,31 +103,158 @@ public:
      * @brief: 给指定的fd增加监听事件，当cb为nullptr时，将当前上下文转换为协程，并作为事件回调使用
      * @param {int} fd
      * @param {FDEventType} event_type
-     * @param {function<void()>} cb
+     * @param {FiberFunc} cb
+     * @param {TaskPriority} priority   事件触发后回调被调度的优先级
      * @return {*}
      */
-    int addEventListener(int fd, FDEventType event_type, std::function<void()> cb = nullptr);
+    int addEventListener(int fd, FDEventType event_type, Fiber::FiberFunc cb = nullptr,
+                         TaskPriority priority = PRIORITY_NORMAL);
     int removeEventListener(int fd, FDEventType event_type);
     bool cancelEventListener(int fd, FDEventType event_type);   //立即触发fd指定的事件，然后移除该事件
     bool cancelAll(int fd); //触发fd所有事件，然后移除所有事件
 
+    Backend getBackend() const;
+    bool isSubmitIOSupported() const;   //io_uring后端并且内核能按fd取消请求时才能使用submitIO
+    bool isPersistent() const { return m_persistent; }
+    bool isPerThreadEpoll() const { return m_per_thread; }
+    uint64_t getBusyPollUs() const { return m_busy_poll_us; }
+    void setSocketBusyPoll(int fd) const;   //按iomanager.socket_busy_poll_us设置socket的内核忙轮询，没有开启时什么也不做
+
+    int getFdOwner(int fd);                         //fd绑定的调度线程槽位，没有绑定或不是每线程epoll模式时返回-1
+    size_t getOwnedFdCount(size_t index) const;     //绑定到第index个调度线程槽位的fd数量
+
+    /**
+     * @Author: hxk
+     * @brief: 每线程epoll模式：把fd移到第index个调度线程的epoll上，之后它的事件由该线程等待，恢复的协程在该线程执行
+     *      正在等待的事件不会丢失，已经被原线程取出的事件仍然在原线程恢复
+     * @param {size_t} index    目标调度线程的槽位，与getThreadIds的顺序无关，范围为[0, 最大线程数)
+     * @return {bool} 不是每线程epoll模式、index越界或槽位没有运行中的线程时返回false
+     */
+    bool migrate(int fd, size_t index);
+
+    uint64_t getEpollCtlCount() const { return m_epoll_ctl_count; }     //epoll_ctl的调用次数
+    uint64_t getEpollWaitCount() const { return m_epoll_wait_count; }   //epoll_wait的调用次数
+    uint64_t getTickleCount() const;    //为唤醒等待线程实际写eventfd的次数
+    uint64_t getBusyPollCount() const { return m_busy_poll_count; }     //忙轮询的次数
+    LoopStats getLoopStats() const;
+
+    /**
+     * @Author: hxk
+     * @brief: io_uring后端：等待fd就绪后由内核直接执行prep准备的操作，只需要一次提交和一次唤醒，挂起当前协程直到完成
+     *      prep负责设置opcode、fd、缓冲区等，user_data和flags由调用方设置
+     *      缓冲区在完成之前由内核直接读写，不能位于共享栈协程的栈上
+     *      只能在isSubmitIOSupported为true时调用
+     * @return {int} 操作的结果，失败时为负的errno，-ECANCELED表示等待失败或被cancelAll取消
+     */
+    int submitIO(int fd, FDEventType event_type, const std::function<void(io_uring_sqe*)>& prep);
+
 public:
     static IOManager* getThis();
 
 
 protected:
     void tickle() override;
+    void tickle(SchedulerWorker* worker) override;
     void onFree() override;
     bool isStop() override;
     bool isStop(uint64_t& timeout);
-    void contentListResize(size_t size);
     void onTimerInsertedAtFirst() override;
 
 private:
-    RWLock m_lock;
+    void ticklePoller();                    //唤醒正在epoll_wait的线程
+
+    /**
+     * @Author: hxk
+     * @brief: 不加锁地取fd对应的FDContent
+     * @param {bool} auto_create    所在的块还没有分配时是否分配
+     * @return {FDContent*} fd为负数、超过RLIMIT_NOFILE或块没有分配且auto_create为false时返回nullptr
+     */
+    FDContent* getFdContent(int fd, bool auto_create);
+
+    /**
+     * @Author: hxk
+     * @brief: 分发一轮：最多m_loop_budget个到期定时器和[next, ready)中最多m_loop_budget个就绪事件
+     * @param {int&} next   下一个要分发的事件，返回时指向第一个没有分发的事件
+     */
+    void dispatchIteration(EventFdWaker* waker, epoll_event* events, int& next, int ready);
+    void onEpollEvent(epoll_event& ev);     //把一个就绪事件转换为协程调度
+
+    /**
+     * @Author: hxk
+     * @brief: 忙轮询最多m_busy_poll_us微秒，只能由持有m_polling或每线程epoll模式下的线程调用
+     * @param {int&} result     epoll后端取到的就绪事件数
+     * @return {bool} 有就绪事件、完成项（已经分发）、任务或到期的定时器时返回true，不需要再阻塞等待
+     */
+    bool busyPoll(SchedulerWorker* worker, int epoll_fd, epoll_event* events, int max_events, int& result);
+
+    //每线程epoll模式
+    int getWorkerIndex(SchedulerWorker* worker) const;  //调度线程的槽位，不属于该调度器时返回-1
+    bool isOwnerAlive(size_t index) const;              //槽位有线程运行且没有在退出，可以绑定fd
+    size_t pickOwner();                                 //为新fd选择绑定的线程：当前调度线程，否则轮流分配
+    int getEpollFd(FDContent* fd_ctx) const;            //fd_ctx所在的epoll
+    long getOwnerThreadId(FDContent* fd_ctx) const;     //恢复的协程要绑定的线程，不绑定时返回-1
+    void migrateOwned(size_t index);                    //把绑定到index的fd全部移到其他线程
+
+    //io_uring后端，调用时必须持有m_uring_mutex；都不能等待队列空间，处理完成项的线程也要获取这些锁
+    /**
+     * @Author: hxk
+     * @brief: 把一组连续（可能链接）的提交项复制到提交队列；队列已满并且尝试提交一次仍然没有空间时，
+     *      放入积压队列，由处理完成项的线程之后放入
+     * @param {bool} allow_backlog  为false时不放入积压队列，直接返回false
+     * @return {bool} 是否已经放入提交队列或积压队列
+     */
+    bool queueSqes(const io_uring_sqe* sqes, size_t count, bool allow_backlog = true);
+    void armPoll(FDContent* fd_ctx, FDEventType event_type);    //为fd的一个方向添加一次性的poll
+    void removePoll(FDContent* fd_ctx, FDEventType event_type); //移除fd一个方向上的poll
+    void publishSqes();     //发布提交项，有线程正在等待时立即提交，否则由下一个等待的线程一起提交
+
+    //io_uring后端，只能由持有m_polling的线程调用
+    void pollUring(SchedulerWorker* worker, uint64_t timeout_ms);   //提交请求并等待完成项，然后分发
+    void onCompletion(uint64_t user_data, int result);
+    void reapUring();           //分发所有完成项，再把积压的提交项放入提交队列
+    void flushSqeBacklog();     //队列有空间时按顺序放入积压的提交项并提交
+
+private:
     int m_epoll_fd = 0;
-    int m_tickle_fds[2] = {0};  //主线程给子线程发消息用的管道
+    EventFdWaker m_waker;       //唤醒阻塞在epoll_wait上的线程
     std::atomic_size_t m_pending_event_count = 0;   //等待执行的事件的数量
-    std::vector<std::unique_ptr<FDContent>> m_fd_content_list;
+    std::atomic_bool m_polling{false};      //是否已经有空闲线程阻塞在epoll_wait上
+    //fd表分两级：第一级是固定大小、覆盖RLIMIT_NOFILE的块指针数组，第二级是按需分配的FD_CHUNK_SIZE个FDContent
+    //块指针用CAS发布，查找不需要加锁，已经分配的FDContent不会移动
+    static const size_t FD_CHUNK_SIZE = 1024;
+    std::unique_ptr<std::atomic<FDContent*>[]> m_fd_chunks;
+    size_t m_fd_chunk_count = 0;
+    bool m_persistent = false;              //每个fd只注册一次，读写两个方向都边沿触发
+
+    //每线程epoll模式下每个调度线程槽位的等待机制
+    struct Poller
+    {
+        int m_epoll_fd = -1;
+        EventFdWaker m_waker;
+        std::atomic_size_t m_fd_count{0};   //绑定到该线程的fd数量
+    };
+    bool m_per_thread = false;
+    std::vector<std::unique_ptr<Poller>> m_pollers; //与m_workers的槽位一一对应
+    std::atomic_size_t m_next_owner{0};     //轮流分配的下一个槽位
+    std::atomic_uint64_t m_epoll_ctl_count{0};
+    std::atomic_uint64_t m_epoll_wait_count{0};
+    size_t m_max_events = 1024;             //epoll_wait批量大小的上限
+    size_t m_loop_budget = 256;             //每轮最多分发的就绪事件数和到期定时器数
+    std::atomic_uint64_t m_loop_iterations{0};
+    std::atomic_uint64_t m_loop_events{0};
+    std::atomic_uint64_t m_loop_timers{0};
+    std::atomic_uint64_t m_loop_deferred{0};
+    std::atomic_uint64_t m_loop_busy_us{0};
+    std::atomic_uint64_t m_loop_max_batch{0};
+    uint64_t m_busy_poll_us = 0;            //空闲时忙轮询的时间，0表示不忙轮询
+    size_t m_busy_poll_threads = 0;         //忙轮询的调度线程槽位数
+    int m_socket_busy_poll_us = 0;          //SO_BUSY_POLL的值，0表示不设置
+    std::atomic_uint64_t m_busy_poll_count{0};
+    std::unique_ptr<IoUring> m_uring;       //io_uring后端，为空时使用epoll
+    Mutex m_uring_mutex;                    //保护提交队列和积压队列
+    struct SqeBacklog;
+    std::unique_ptr<SqeBacklog> m_sqe_backlog;  //提交队列满时暂存的提交项
+    std::atomic_size_t m_sqe_backlog_count{0};
+    std::atomic_uint64_t m_uring_inflight{0};   //submitIO提交、还没有完成的操作数
 };
 }
\ No newline at end of file
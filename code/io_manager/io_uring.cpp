@@ -0,0 +1,172 @@
+#include "io_uring.h"
+#include "log.h"
+
+#include <algorithm>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace hxk
+{
+static Logger::_ptr g_logger = GET_LOGGER("system");
+
+IoUring::_uptr IoUring::create(unsigned entries)
+{
+    _uptr ring(new IoUring());
+    if(!ring->init(entries)) {
+        return nullptr;
+    }
+    return ring;
+}
+
+bool IoUring::init(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    m_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if(m_fd < 0) {
+        LOG_FORMAT_WARN(g_logger, "io_uring_setup(%u) error: %s", entries, strerror(errno));
+        return false;
+    }
+    //完成队列溢出时不能丢失完成项，等待时需要超时参数
+    unsigned required = IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if((params.features & required) != required) {
+        LOG_FORMAT_WARN(g_logger, "io_uring features 0x%x lack NODROP/EXT_ARG", params.features);
+        return false;
+    }
+
+    m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap) {
+        m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+    }
+    m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     m_fd, IORING_OFF_SQ_RING);
+    if(m_sq_ring == MAP_FAILED) {
+        m_sq_ring = nullptr;
+        return false;
+    }
+    if(single_mmap) {
+        m_cq_ring = m_sq_ring;
+    }
+    else {
+        m_cq_ring = mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         m_fd, IORING_OFF_CQ_RING);
+        if(m_cq_ring == MAP_FAILED) {
+            m_cq_ring = nullptr;
+            return false;
+        }
+    }
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      m_fd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED) {
+        return false;
+    }
+    m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(m_sq_ring);
+    m_sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sq_entries = params.sq_entries;
+    m_sq_local_tail = *m_sq_tail;
+    //提交项和提交队列的位置一一对应，之后不再修改索引数组
+    unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for(unsigned i = 0; i < m_sq_entries; i++) {
+        array[i] = i;
+    }
+
+    char* cq = static_cast<char*>(m_cq_ring);
+    m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    m_cancel_fd = probeCancelFd();
+    if(!m_cancel_fd) {
+        LOG_WARN(g_logger, "io_uring lacks IORING_ASYNC_CANCEL_FD, linked read/write requests disabled");
+    }
+    return true;
+}
+
+bool IoUring::probeCancelFd()
+{
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = m_fd;     //任意有效的fd，上面没有请求，支持时返回-ENOENT或0
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    publish();
+    int result = syscall(__NR_io_uring_enter, m_fd, 1, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+    if(result < 0) {
+        return false;
+    }
+    int res = -EINVAL;
+    reap([&res](const io_uring_cqe* cqe){
+        res = cqe->res;
+    });
+    return res != -EINVAL;
+}
+
+IoUring::~IoUring()
+{
+    if(m_sqes) {
+        munmap(m_sqes, m_sqes_size);
+    }
+    if(m_cq_ring && m_cq_ring != m_sq_ring) {
+        munmap(m_cq_ring, m_cq_ring_size);
+    }
+    if(m_sq_ring) {
+        munmap(m_sq_ring, m_sq_ring_size);
+    }
+    if(m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+io_uring_sqe* IoUring::getSqe()
+{
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if(m_sq_local_tail - head >= m_sq_entries) {
+        return nullptr;
+    }
+    io_uring_sqe* sqe = &m_sqes[m_sq_local_tail & m_sq_mask];
+    ++m_sq_local_tail;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void IoUring::publish()
+{
+    __atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+}
+
+unsigned IoUring::getPending() const
+{
+    return __atomic_load_n(m_sq_tail, __ATOMIC_ACQUIRE) - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+}
+
+int IoUring::submit(bool wait, uint64_t timeout_ms)
+{
+    //to_submit只是上限，传入队列长度，内核提交进入系统调用时已经发布的所有提交项
+    int submitted = 0;
+    if(getPending() != 0) {
+        submitted = syscall(__NR_io_uring_enter, m_fd, m_sq_entries, 0, 0, nullptr, 0);
+    }
+    if(!wait) {
+        return submitted;
+    }
+    //提交和等待分成两次系统调用：to_submit不为0时等待，其他线程产生的完成项要很久之后才能唤醒等待线程
+    __kernel_timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    int result = syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                         &arg, sizeof(arg));
+    return result < 0 ? result : submitted;
+}
+
+}
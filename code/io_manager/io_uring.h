@@ -0,0 +1,102 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <atomic>
+#include <memory>
+
+#include "noncopyable.h"
+
+namespace hxk
+{
+
+/**
+ * @Author: hxk
+ * @brief: io_uring提交队列和完成队列的简单封装，直接使用系统调用，不依赖liburing
+ *      提交队列不是线程安全的，getSqe和publish由调用方加锁；完成队列只能由一个线程消费
+ *      内核需要支持IORING_FEAT_NODROP和IORING_FEAT_EXT_ARG（5.11以上），否则create返回nullptr
+ */
+class IoUring : public noncopyable
+{
+public:
+    typedef std::unique_ptr<IoUring> _uptr;
+
+    /**
+     * @Author: hxk
+     * @brief: 创建io_uring实例
+     * @param {unsigned} entries    提交队列的长度，完成队列为其两倍
+     * @return {_uptr} 内核不支持时返回nullptr
+     */
+    static _uptr create(unsigned entries);
+    ~IoUring();
+
+    /**
+     * @Author: hxk
+     * @brief: 取一个空闲的提交项并清零，调用publish之后才对内核可见
+     * @return {io_uring_sqe*} 提交队列已满时返回nullptr，此时需要先submit
+     */
+    io_uring_sqe* getSqe();
+    void publish();     //发布getSqe取出的所有提交项，需要和getSqe在同一个锁内
+    unsigned getPending() const;    //已经发布、还没有被内核取走的提交项数量
+
+    /**
+     * @Author: hxk
+     * @brief: 提交所有已发布的提交项，wait为true时等待至少一个完成项或超时，可以和getSqe并发调用
+     * @param {uint64_t} timeout_ms 等待的最长时间
+     * @return {int} 系统调用的返回值，超时或被信号中断时返回-1
+     */
+    int submit(bool wait = false, uint64_t timeout_ms = 0);
+
+    /**
+     * @Author: hxk
+     * @brief: 依次处理所有完成项，只能由一个线程调用
+     *      每个完成项复制出来之后立即归还给内核，fn阻塞或提交新的请求时完成队列仍然可以继续排空
+     * @param {F} fn    void(const io_uring_cqe*)
+     * @return {unsigned} 处理的完成项数量
+     */
+    template<class F>
+    unsigned reap(F&& fn)
+    {
+        unsigned head = *m_cq_head;
+        unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+        unsigned count = tail - head;
+        while(head != tail) {
+            io_uring_cqe cqe = m_cqes[head & m_cq_mask];
+            __atomic_store_n(m_cq_head, ++head, __ATOMIC_RELEASE);
+            fn(&cqe);
+        }
+        return count;
+    }
+
+    unsigned getEntries() const { return m_sq_entries; }
+    unsigned getSpace() const { return m_sq_entries - (m_sq_local_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE)); }  //提交队列的空闲位置
+    bool supportsCancelFd() const { return m_cancel_fd; }  //是否支持按fd取消所有请求（IORING_ASYNC_CANCEL_FD，5.19以上）
+    bool hasCompletions() const { return __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE) != *m_cq_head; }   //完成队列是否有未处理的完成项
+
+private:
+    IoUring() = default;
+    bool init(unsigned entries);
+    bool probeCancelFd();   //在空的队列上同步提交一次按fd取消，旧内核以-EINVAL拒绝不认识的cancel_flags
+
+private:
+    int m_fd = -1;
+    void* m_sq_ring = nullptr;
+    size_t m_sq_ring_size = 0;
+    void* m_cq_ring = nullptr;
+    size_t m_cq_ring_size = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqes_size = 0;
+
+    unsigned* m_sq_head = nullptr;
+    unsigned* m_sq_tail = nullptr;
+    unsigned m_sq_mask = 0;
+    unsigned m_sq_entries = 0;
+    unsigned m_sq_local_tail = 0;   //getSqe取到的位置，publish时写入m_sq_tail
+
+    unsigned* m_cq_head = nullptr;
+    unsigned* m_cq_tail = nullptr;
+    unsigned m_cq_mask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+    bool m_cancel_fd = false;
+};
+
+}
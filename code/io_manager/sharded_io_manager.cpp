@@ -0,0 +1,238 @@
+#include "sharded_io_manager.h"
+#include "cpu_topology.h"
+#include "config.h"
+#include "log.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+namespace hxk
+{
+static Logger::_ptr g_logger = GET_LOGGER("system");
+
+static ConfigVar<std::string>::_ptr g_sharded_assign_policy =
+    Config::lookUp<std::string>("sharded.assign_policy", "round_robin", "new connection assignment, round_robin, least_connection or address_hash");
+
+static ConfigVar<bool>::_ptr g_sharded_pin =
+    Config::lookUp<bool>("sharded.pin", true, "pin each shard thread to one cpu");
+
+//当前线程所属的分片调度器和分片编号
+static thread_local ShardedIOManager* t_sharded = nullptr;
+static thread_local int t_shard = -1;
+
+size_t RoundRobinAssignPolicy::assign(int /*fd*/, const ShardedIOManager& manager)
+{
+    return m_next.fetch_add(1, std::memory_order_relaxed) % manager.getShardCount();
+}
+
+size_t LeastConnectionAssignPolicy::assign(int /*fd*/, const ShardedIOManager& manager)
+{
+    size_t best = 0;
+    size_t best_count = manager.getConnectionCount(0);
+    for(size_t i = 1; i < manager.getShardCount() && best_count > 0; i++) {
+        size_t count = manager.getConnectionCount(i);
+        if(count < best_count) {
+            best = i;
+            best_count = count;
+        }
+    }
+    return best;
+}
+
+size_t AddressHashAssignPolicy::assign(int fd, const ShardedIOManager& manager)
+{
+    sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    if(getpeername(fd, (sockaddr*)&addr, &len) != 0) {
+        return fd % manager.getShardCount();
+    }
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    if(addr.ss_family == AF_INET) {
+        data = (const uint8_t*)&((sockaddr_in*)&addr)->sin_addr;
+        size = sizeof(in_addr);
+    }
+    else if(addr.ss_family == AF_INET6) {
+        data = (const uint8_t*)&((sockaddr_in6*)&addr)->sin6_addr;
+        size = sizeof(in6_addr);
+    }
+    else {
+        return fd % manager.getShardCount();
+    }
+    //FNV-1a，只对地址部分哈希，同一个客户端的不同端口落在同一个分片
+    uint64_t hash = 14695981039346656037ull;
+    for(size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash % manager.getShardCount();
+}
+
+ShardedIOManager::ShardedIOManager(size_t shard_count, const std::string& name)
+{
+    const std::vector<int>& cpus = CpuTopology::GetInstance()->getCompactOrder();
+    if(shard_count == 0) {
+        shard_count = std::max<size_t>(cpus.size(), 1);
+    }
+    std::string policy = g_sharded_assign_policy->getValue();
+    if(policy == "least_connection") {
+        m_policy = std::make_shared<LeastConnectionAssignPolicy>();
+    }
+    else if(policy == "address_hash") {
+        m_policy = std::make_shared<AddressHashAssignPolicy>();
+    }
+    else {
+        m_policy = std::make_shared<RoundRobinAssignPolicy>();
+    }
+
+    for(size_t i = 0; i < shard_count; i++) {
+        auto shard = std::make_unique<Shard>();
+        shard->m_io_manager = std::make_unique<IOManager>(1, false, name + "_" + std::to_string(i));
+        m_shards.push_back(std::move(shard));
+    }
+    bool pin = g_sharded_pin->getValue() && !cpus.empty();
+    for(size_t i = 0; i < shard_count; i++) {
+        //第一条消息在分片线程上记录分片编号并绑定CPU，之后分片内创建的协程栈都在该CPU的节点上分配
+        call(i, [this, i, pin, &cpus](){
+            t_sharded = this;
+            t_shard = static_cast<int>(i);
+            if(pin) {
+                Thread::setThisAffinity({cpus[i % cpus.size()]});
+            }
+        });
+    }
+    LOG_FORMAT_INFO(g_logger, "sharded io manager %s: %lu shards, policy %s, pin %d",
+                    name.c_str(), shard_count, policy.c_str(), pin);
+}
+
+ShardedIOManager::~ShardedIOManager()
+{
+    stop();
+}
+
+void ShardedIOManager::stop()
+{
+    for(auto& shard : m_shards) {
+        if(shard->m_io_manager) {
+            shard->m_io_manager->stop();
+        }
+    }
+}
+
+IOManager* ShardedIOManager::getShard(size_t index) const
+{
+    return m_shards[index]->m_io_manager.get();
+}
+
+void ShardedIOManager::setAssignPolicy(ShardAssignPolicy::_ptr policy)
+{
+    ScopedSpinLock lock(&m_policy_lock);
+    m_policy = std::move(policy);
+}
+
+size_t ShardedIOManager::assign(int fd, Message handler)
+{
+    ShardAssignPolicy::_ptr policy;
+    {
+        ScopedSpinLock lock(&m_policy_lock);
+        policy = m_policy;
+    }
+    size_t index = policy->assign(fd, *this);
+    assert(index < m_shards.size());
+    Shard* shard = m_shards[index].get();
+    ++shard->m_connections;
+    shard->m_io_manager->schedule([shard, handler = std::move(handler)]() mutable {
+        try {
+            handler();
+        }
+        catch(const std::exception& e) {
+            LOG_FORMAT_ERROR(g_logger, "shard connection handler error: %s", e.what());
+        }
+        catch(...) {
+            LOG_ERROR(g_logger, "shard connection handler error");
+        }
+        --shard->m_connections;
+    });
+    return index;
+}
+
+size_t ShardedIOManager::getConnectionCount(size_t index) const
+{
+    return m_shards[index]->m_connections;
+}
+
+void ShardedIOManager::post(size_t index, Message msg)
+{
+    Shard* shard = m_shards[index].get();
+    bool need_drain = false;
+    {
+        ScopedSpinLock lock(&shard->m_lock);
+        shard->m_messages.push_back(std::move(msg));
+        need_drain = !shard->m_draining;
+        shard->m_draining = true;
+    }
+    if(need_drain) {
+        //已经有协程在执行消息时，新消息会被它一起处理，不需要再唤醒目标线程
+        ++shard->m_wakeup_count;
+        shard->m_io_manager->schedule([this, shard](){
+            drain(shard);
+        });
+    }
+}
+
+void ShardedIOManager::drain(Shard* shard)
+{
+    std::vector<Message> messages;
+    while(true) {
+        {
+            ScopedSpinLock lock(&shard->m_lock);
+            if(shard->m_messages.empty()) {
+                shard->m_draining = false;
+                return;
+            }
+            messages.swap(shard->m_messages);
+        }
+        for(auto& msg : messages) {
+            try {
+                msg();
+            }
+            catch(const std::exception& e) {
+                LOG_FORMAT_ERROR(g_logger, "shard message error: %s", e.what());
+            }
+            catch(...) {
+                LOG_ERROR(g_logger, "shard message error");
+            }
+        }
+        shard->m_message_count += messages.size();
+        messages.clear();
+    }
+}
+
+uint64_t ShardedIOManager::getMessageCount() const
+{
+    uint64_t count = 0;
+    for(auto& shard : m_shards) {
+        count += shard->m_message_count;
+    }
+    return count;
+}
+
+uint64_t ShardedIOManager::getWakeupCount() const
+{
+    uint64_t count = 0;
+    for(auto& shard : m_shards) {
+        count += shard->m_wakeup_count;
+    }
+    return count;
+}
+
+ShardedIOManager* ShardedIOManager::getThis()
+{
+    return t_sharded;
+}
+
+int ShardedIOManager::getThisShard()
+{
+    return t_shard;
+}
+
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "noncopyable.h"
+#include "lock.h"
+#include "io_manager.h"
+#include "fiber_lock.h"
+#include "unique_function.h"
+
+namespace hxk
+{
+class ShardedIOManager;
+
+/**
+ * @Author: hxk
+ * @brief: 新连接分配到分片的策略
+ */
+class ShardAssignPolicy
+{
+public:
+    typedef std::shared_ptr<ShardAssignPolicy> _ptr;
+
+    virtual ~ShardAssignPolicy() = default;
+
+    /**
+     * @Author: hxk
+     * @brief: 为新连接选择分片，可能被多个线程同时调用
+     * @param {int} fd  新连接的socket
+     * @return {size_t} 分片编号，必须小于manager.getShardCount()
+     */
+    virtual size_t assign(int fd, const ShardedIOManager& manager) = 0;
+};
+
+//依次分配到每个分片
+class RoundRobinAssignPolicy : public ShardAssignPolicy
+{
+public:
+    size_t assign(int fd, const ShardedIOManager& manager) override;
+
+private:
+    std::atomic_size_t m_next{0};
+};
+
+//分配到当前连接数最少的分片，连接的处理时间差别较大时使用
+class LeastConnectionAssignPolicy : public ShardAssignPolicy
+{
+public:
+    size_t assign(int fd, const ShardedIOManager& manager) override;
+};
+
+//按对端IP地址哈希，同一个客户端的连接总是分配到同一个分片，分片内可以不加锁地缓存客户端的状态
+class AddressHashAssignPolicy : public ShardAssignPolicy
+{
+public:
+    size_t assign(int fd, const ShardedIOManager& manager) override;
+};
+
+/**
+ * @Author: hxk
+ * @brief: 每个核一个线程的分片IO调度器
+ *      由N个单线程的IOManager组成，每个分片有独立的epoll、定时器和fd表，分片之间不共享任何锁，
+ *      一个连接从分配开始只在一个分片上处理，不会在线程之间迁移
+ *      新连接由assign按分配策略（默认来自sharded.assign_policy）交给某个分片，
+ *      分片之间通过post/call传递消息，代替schedule(..., thread_id)向指定线程提交任务
+ *      sharded.pin为true时，分片i的线程按物理核紧凑的顺序绑定到一个CPU
+ */
+class ShardedIOManager : public noncopyable
+{
+public:
+    typedef std::shared_ptr<ShardedIOManager> _ptr;
+    typedef unique_function<void()> Message;
+
+    /**
+     * @Author: hxk
+     * @brief: 创建并启动所有分片
+     * @param {size_t} shard_count  分片数量，为0时等于可用的CPU数量
+     * @param {string} name         分片线程的名称前缀，分片i的线程名为name_i
+     * @return {*}
+     */
+    explicit ShardedIOManager(size_t shard_count = 0, const std::string& name = "shard");
+    ~ShardedIOManager();
+
+    void stop();    //等待所有分片的任务、事件和定时器结束后停止
+
+    size_t getShardCount() const { return m_shards.size(); }
+    IOManager* getShard(size_t index) const;
+
+    void setAssignPolicy(ShardAssignPolicy::_ptr policy);
+
+    /**
+     * @Author: hxk
+     * @brief: 按分配策略为新连接选择一个分片，在该分片上新建协程执行handler
+     *      handler返回时认为连接已经关闭，分片的连接数减1
+     * @return {size_t} 分配的分片编号
+     */
+    size_t assign(int fd, Message handler);
+
+    size_t getConnectionCount(size_t index) const;  //分片上由assign分配、handler还没有返回的连接数
+
+    /**
+     * @Author: hxk
+     * @brief: 发送消息到指定分片，由该分片的线程按发送顺序执行，不等待执行结果
+     *      同一分片的消息在一个协程中依次执行，多条消息只唤醒一次目标线程；
+     *      消息应该很快执行完，需要长时间挂起的工作应该在消息中再调用schedule
+     * @return {*}
+     */
+    void post(size_t index, Message msg);
+
+    /**
+     * @Author: hxk
+     * @brief: 在指定分片上执行fn，挂起当前执行流直到完成，返回fn的结果，fn抛出的异常在调用方重新抛出
+     *      已经在目标分片上时直接执行；否则fn作为独立的任务执行，不经过消息队列，
+     *      fn可以挂起（包括再call回当前分片），不会阻塞该分片后续的消息
+     * @return {*}
+     */
+    template<class F>
+    typename std::invoke_result<F&>::type call(size_t index, F fn)
+    {
+        typedef typename std::invoke_result<F&>::type R;
+        if(getThis() == this && getThisShard() == static_cast<int>(index)) {
+            return fn();
+        }
+        auto result = std::make_shared<CallResult<R>>();
+        getShard(index)->schedule([result, fn = std::move(fn)]() mutable {
+            result->run(fn);
+        });
+        return result->get();
+    }
+
+    uint64_t getMessageCount() const;   //所有分片执行的消息数
+    uint64_t getWakeupCount() const;    //投递消息时唤醒目标分片的次数，小于消息数说明消息被合并处理
+
+public:
+    static ShardedIOManager* getThis(); //当前线程所属的分片调度器，不是分片线程时返回nullptr
+    static int getThisShard();          //当前线程的分片编号，不是分片线程时返回-1
+
+private:
+    struct Shard
+    {
+        std::unique_ptr<IOManager> m_io_manager;
+        SpinLock m_lock;                    //保护m_messages和m_draining
+        std::vector<Message> m_messages;    //等待执行的消息
+        bool m_draining = false;            //是否已经有协程在执行消息
+        std::atomic_size_t m_connections{0};
+        std::atomic_uint64_t m_message_count{0};
+        std::atomic_uint64_t m_wakeup_count{0};
+    };
+
+    void drain(Shard* shard);   //在分片线程上依次执行消息，直到没有新消息
+
+private:
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    ShardAssignPolicy::_ptr m_policy;
+    SpinLock m_policy_lock;     //保护m_policy的替换
+};
+
+}
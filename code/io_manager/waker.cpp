@@ -0,0 +1,57 @@
+#include "waker.h"
+#include "exception.h"
+#include "hook.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace hxk
+{
+
+EventFdWaker::EventFdWaker()
+{
+    m_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(m_fd == -1) {
+        THROW_EXCEPTION_WITH_ERRNO;
+    }
+}
+
+EventFdWaker::~EventFdWaker()
+{
+    close(m_fd);
+}
+
+void EventFdWaker::prepareWait()
+{
+    //seq_cst：和唤醒方先放入工作、再读取状态的顺序配合，两者至少有一方能看到对方
+    m_state.store(SLEEPING);
+}
+
+void EventFdWaker::finishWait()
+{
+    m_state.store(AWAKE);
+}
+
+void EventFdWaker::consume()
+{
+    uint64_t value;
+    //一次读出并清零计数；唤醒方在NOTIFIED之后才写入时，下一次等待会多醒一次，不会丢失唤醒
+    //直接使用原始的系统调用：唤醒可能发生在持有fd锁时，不能经过hook的让出点
+    while(read_f(m_fd, &value, sizeof(value)) == -1 && errno == EINTR);
+}
+
+bool EventFdWaker::wake()
+{
+    int state = SLEEPING;
+    if(!m_state.compare_exchange_strong(state, NOTIFIED)) {
+        return false;
+    }
+    ++m_write_count;
+    uint64_t value = 1;
+    if(write_f(m_fd, &value, sizeof(value)) == -1) {
+        throw SystemException("eventfd write error");
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include "noncopyable.h"
+
+namespace hxk
+{
+
+/**
+ * @Author: hxk
+ * @brief: 基于eventfd的唤醒器，一个等待线程，多个唤醒线程
+ *      等待线程在阻塞之前调用prepareWait进入SLEEPING状态，再检查一次是否有工作，然后把fd()放在epoll/io_uring中等待；
+ *      wake只有在SLEEPING状态下才写eventfd，等待线程没有睡眠或已经被唤醒时不产生系统调用，多次唤醒合并为一次
+ */
+class EventFdWaker : public noncopyable
+{
+public:
+    enum State
+    {
+        AWAKE = 0,  //等待线程正在运行，会在睡眠前重新检查工作
+        SLEEPING,   //等待线程已经或即将阻塞，需要写eventfd
+        NOTIFIED    //已经写过eventfd，还没有被等待线程消费
+    };
+
+    EventFdWaker();
+    ~EventFdWaker();
+
+    int fd() const { return m_fd; }
+
+    void prepareWait();     //等待线程阻塞前调用，之后必须再检查一次工作，避免错过唤醒
+    void finishWait();      //等待线程返回后调用，回到AWAKE状态
+    void consume();         //eventfd可读时读空计数
+
+    /**
+     * @Author: hxk
+     * @brief: 唤醒等待线程
+     * @return {bool} 是否写了eventfd；等待线程没有睡眠或已经被唤醒时返回false
+     */
+    bool wake();
+
+    bool isSleeping() const { return m_state.load() == SLEEPING; }
+    uint64_t getWriteCount() const { return m_write_count; }    //实际写eventfd的次数
+
+private:
+    int m_fd;
+    std::atomic_int m_state{AWAKE};
+    std::atomic_uint64_t m_write_count{0};
+};
+
+}
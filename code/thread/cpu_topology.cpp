@@ -0,0 +1,178 @@
+#include "cpu_topology.h"
+#include "log.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace hxk
+{
+
+static Logger::_ptr g_logger = GET_LOGGER("system");
+
+static const int MPOL_PREFERRED_MODE = 1;   //<numaif.h>中的MPOL_PREFERRED，避免依赖libnuma
+static const unsigned MPOL_MF_MOVE_FLAG = 1 << 1;   //MPOL_MF_MOVE
+
+std::vector<int> CpuTopologyImpl::parseCpuList(const std::string& list)
+{
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while(pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if(end == std::string::npos) {
+            end = list.size();
+        }
+        std::string range = list.substr(pos, end - pos);
+        size_t dash = range.find('-');
+        try {
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for(int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+        }
+        catch(const std::exception&) {
+            //忽略空行和格式错误
+        }
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+static bool readLine(const std::string& path, std::string& line)
+{
+    std::ifstream ifs(path);
+    return ifs && std::getline(ifs, line);
+}
+
+static int readInt(const std::string& path, int default_value)
+{
+    std::string line;
+    if(!readLine(path, line)) {
+        return default_value;
+    }
+    try {
+        return std::stoi(line);
+    }
+    catch(const std::exception&) {
+        return default_value;
+    }
+}
+
+CpuTopologyImpl::CpuTopologyImpl()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        for(int cpu = 0; cpu < sysconf(_SC_NPROCESSORS_ONLN) && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, &allowed);
+        }
+    }
+
+    std::map<int, int> cpu_node;
+    for(int node = 0; node < 1024; node++) {
+        std::string line;
+        if(!readLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", line)) {
+            if(node > 0 && access(("/sys/devices/system/node/node" + std::to_string(node)).c_str(), F_OK)) {
+                break;  //节点编号一般是连续的
+            }
+            continue;
+        }
+        for(int cpu : parseCpuList(line)) {
+            cpu_node[cpu] = node;
+        }
+    }
+
+    std::map<std::pair<int, int>, int> core_threads;   //(package, core) -> 已经出现的超线程数
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if(!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        std::string topology = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        CpuInfo info;
+        info.m_cpu = cpu;
+        info.m_node = cpu_node.count(cpu) ? cpu_node[cpu] : 0;
+        info.m_package = readInt(topology + "physical_package_id", 0);
+        info.m_core = readInt(topology + "core_id", cpu);
+        info.m_sibling = core_threads[std::make_pair(info.m_package, info.m_core)]++;
+        m_cpus.push_back(info);
+    }
+
+    for(auto& info : m_cpus) {
+        auto it = std::find(m_nodes.begin(), m_nodes.end(), info.m_node);
+        if(it == m_nodes.end()) {
+            m_nodes.push_back(info.m_node);
+            m_node_cpus.emplace_back();
+            it = m_nodes.end() - 1;
+        }
+        m_node_cpus[it - m_nodes.begin()].push_back(info.m_cpu);
+    }
+
+    std::vector<CpuInfo> order = m_cpus;
+    std::sort(order.begin(), order.end(), [](const CpuInfo& a, const CpuInfo& b){
+        return std::make_tuple(a.m_node, a.m_package, a.m_core, a.m_sibling) <
+               std::make_tuple(b.m_node, b.m_package, b.m_core, b.m_sibling);
+    });
+    for(auto& info : order) {
+        m_compact.push_back(info.m_cpu);
+    }
+
+    //每个节点内先排每个物理核的第一个超线程，再轮流从各节点取
+    std::sort(order.begin(), order.end(), [](const CpuInfo& a, const CpuInfo& b){
+        return std::make_tuple(a.m_node, a.m_sibling, a.m_package, a.m_core) <
+               std::make_tuple(b.m_node, b.m_sibling, b.m_package, b.m_core);
+    });
+    std::vector<std::vector<int>> per_node(m_nodes.size());
+    for(auto& info : order) {
+        per_node[std::find(m_nodes.begin(), m_nodes.end(), info.m_node) - m_nodes.begin()].push_back(info.m_cpu);
+    }
+    for(size_t i = 0; m_spread.size() < m_cpus.size(); i++) {
+        for(auto& cpus : per_node) {
+            if(i < cpus.size()) {
+                m_spread.push_back(cpus[i]);
+            }
+        }
+    }
+
+    LOG_FORMAT_INFO(g_logger, "cpu topology: %lu cpus, %lu numa nodes", m_cpus.size(), m_nodes.size());
+}
+
+const std::vector<int>& CpuTopologyImpl::getNodeCpus(int node) const
+{
+    static const std::vector<int> s_empty;
+    auto it = std::find(m_nodes.begin(), m_nodes.end(), node);
+    return it == m_nodes.end() ? s_empty : m_node_cpus[it - m_nodes.begin()];
+}
+
+int CpuTopologyImpl::getCpuNode(int cpu) const
+{
+    for(auto& info : m_cpus) {
+        if(info.m_cpu == cpu) {
+            return info.m_node;
+        }
+    }
+    return -1;
+}
+
+bool CpuTopologyImpl::bindMemory(void* addr, size_t len, int node)
+{
+#ifdef SYS_mbind
+    if(node < 0 || node >= 64 || len == 0) {
+        return false;
+    }
+    static const uintptr_t s_page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = reinterpret_cast<uintptr_t>(addr) & ~(s_page_size - 1);
+    uintptr_t end = (reinterpret_cast<uintptr_t>(addr) + len + s_page_size - 1) & ~(s_page_size - 1);
+    unsigned long mask = 1ul << node;
+    return syscall(SYS_mbind, begin, end - begin, MPOL_PREFERRED_MODE, &mask, 64, MPOL_MF_MOVE_FLAG) == 0;
+#else
+    return false;
+#endif
+}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+#include "singleInstance.h"
+
+namespace hxk
+{
+
+/**
+ * @Author: hxk
+ * @brief: 当前进程可用的CPU拓扑，从/sys/devices/system读取，只包含sched_getaffinity允许的CPU
+ *      没有NUMA信息时所有CPU都属于节点0
+ */
+class CpuTopologyImpl
+{
+public:
+    CpuTopologyImpl();
+
+    size_t getCpuCount() const { return m_cpus.size(); }
+    size_t getNodeCount() const { return m_node_cpus.size(); }
+
+    const std::vector<int>& getNodes() const { return m_nodes; }           //有可用CPU的节点
+    const std::vector<int>& getNodeCpus(int node) const;                   //节点上可用的CPU
+    int getCpuNode(int cpu) const;                                          //CPU所在的节点，未知时返回-1
+
+    /**
+     * @Author: hxk
+     * @brief: 紧凑顺序：按节点、物理核依次排列，同一物理核的超线程相邻，线程尽量集中在同一节点
+     * @return {*}
+     */
+    const std::vector<int>& getCompactOrder() const { return m_compact; }
+
+    /**
+     * @Author: hxk
+     * @brief: 分散顺序：轮流从每个节点取一个CPU，每个物理核先用一个超线程，线程尽量分散
+     * @return {*}
+     */
+    const std::vector<int>& getSpreadOrder() const { return m_spread; }
+
+    /**
+     * @Author: hxk
+     * @brief: 把[addr, addr+len)所在的页绑定到节点（MPOL_PREFERRED），已经分配的页会被迁移
+     * @return {bool} 失败或没有NUMA支持时返回false，不影响使用
+     */
+    static bool bindMemory(void* addr, size_t len, int node);
+
+    static std::vector<int> parseCpuList(const std::string& list);  //解析"0-3,8,10-11"格式的CPU列表
+
+private:
+    struct CpuInfo
+    {
+        int m_cpu;
+        int m_node;
+        int m_package;
+        int m_core;
+        int m_sibling;  //在同一物理核中的序号
+    };
+
+private:
+    std::vector<CpuInfo> m_cpus;
+    std::vector<int> m_nodes;
+    std::vector<std::vector<int>> m_node_cpus;  //与m_nodes一一对应
+    std::vector<int> m_compact;
+    std::vector<int> m_spread;
+};
+
+using CpuTopology = SingleInstance<CpuTopologyImpl>;
+
+}
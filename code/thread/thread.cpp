@@ -1,4 +1,5 @@
 #include "thread.h"
+#include "cpu_topology.h"
 
 namespace hxk
 {
@@ -6,6 +7,8 @@ namespace hxk
 static thread_local pid_t t_tid = 0;
 // 记录当前线程的线程名
 static thread_local std::string t_thread_name = "UNKNOWN";
+// 当前线程绑定的NUMA节点
+static thread_local int t_node = -1;
 
 static Logger::_ptr system_logger = GET_LOGGER("system");
 
@@ -17,9 +20,10 @@ public:
     std::string m_name;   
     pid_t* m_id;
     Semaphore* m_semaphore; 
+    int m_node;
 
-    ThreadData(ThreadFunc func, const std::string& name, pid_t* id, Semaphore* semaphore)
-            :m_callback(std::move(func)),m_name(name), m_id(id), m_semaphore(semaphore)
+    ThreadData(ThreadFunc func, const std::string& name, pid_t* id, Semaphore* semaphore, int node)
+            :m_callback(std::move(func)),m_name(name), m_id(id), m_semaphore(semaphore), m_node(node)
             {
 
             }
@@ -34,6 +38,7 @@ public:
         
         t_tid = GetThreadID();
         t_thread_name = m_name.empty() ? "UNKNOWN" : m_name;
+        t_node = m_node;
 
         pthread_setname_np(pthread_self(), m_name.substr(0,15).c_str());
 
@@ -50,18 +55,67 @@ public:
 };
 
 
+//绑定的CPU都在同一个节点上时返回该节点
+static int getCpusNode(const std::vector<int>& cpus)
+{
+    int node = -1;
+    for(int cpu : cpus) {
+        int cpu_node = CpuTopology::GetInstance()->getCpuNode(cpu);
+        if(cpu_node < 0 || (node >= 0 && cpu_node != node)) {
+            return -1;
+        }
+        node = cpu_node;
+    }
+    return node;
+}
+
 Thread::Thread(ThreadFunc callback, const std::string& name)
+                    : Thread(std::move(callback), name, ThreadAttr())
+{
+
+}
+
+Thread::Thread(ThreadFunc callback, const std::string& name, const ThreadAttr& attr)
                     : m_id(-1),
                     m_name(name),
                     m_thread(0),
                     m_callback(callback),
                     m_semaphore(0),
                     m_started(true),
-                    m_joined(false)
+                    m_joined(false),
+                    m_attr(attr)
 {
-    ThreadData* data = new ThreadData(m_callback, m_name, &m_id, &m_semaphore);
+    pthread_attr_t pattr;
+    pthread_attr_init(&pattr);
+    if(!m_attr.m_cpus.empty()) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        for(int cpu : m_attr.m_cpus) {
+            CPU_SET(cpu, &cpu_set);
+        }
+        pthread_attr_setaffinity_np(&pattr, sizeof(cpu_set), &cpu_set);
+    }
+    if(m_attr.m_stack_size) {
+        pthread_attr_setstacksize(&pattr, m_attr.m_stack_size);
+    }
+    if(m_attr.m_policy != SCHED_OTHER) {
+        sched_param param;
+        param.sched_priority = m_attr.m_priority;
+        pthread_attr_setinheritsched(&pattr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&pattr, m_attr.m_policy);
+        pthread_attr_setschedparam(&pattr, &param);
+    }
 
-    int result = pthread_create(&m_thread, nullptr, &Thread::run, data);
+    ThreadData* data = new ThreadData(m_callback, m_name, &m_id, &m_semaphore, getCpusNode(m_attr.m_cpus));
+
+    int result = pthread_create(&m_thread, &pattr, &Thread::run, data);
+    if(result == EPERM && m_attr.m_policy != SCHED_OTHER) {
+        //没有设置实时调度策略的权限，使用继承的调度策略
+        LOG_FORMAT_WARN(system_logger, "no permission for sched policy %d, name: %s", m_attr.m_policy, m_name.c_str());
+        pthread_attr_setinheritsched(&pattr, PTHREAD_INHERIT_SCHED);
+        result = pthread_create(&m_thread, &pattr, &Thread::run, data);
+    }
+    pthread_attr_destroy(&pattr);
 
     if(result) {
         m_started = false;
@@ -130,6 +184,31 @@ void Thread::setThisThreadName(const std::string& name)
     t_thread_name = name;
 }
 
+int Thread::getThisNode()
+{
+    return t_node;
+}
+
+bool Thread::setThisAffinity(const std::vector<int>& cpus)
+{
+    if(cpus.empty()) {
+        return false;
+    }
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for(int cpu : cpus) {
+        CPU_SET(cpu, &cpu_set);
+    }
+    int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if(result) {
+        LOG_FORMAT_WARN(system_logger, "pthread_setaffinity_np() error, name: %s, error code: %d",
+                        t_thread_name.c_str(), result);
+        return false;
+    }
+    t_node = getCpusNode(cpus);
+    return true;
+}
+
 void* Thread::run(void* arg)
 {
     std::unique_ptr<ThreadData> data((ThreadData*)arg);
@@ -9,10 +9,24 @@
 #include <pthread.h>
 #include <functional>
 #include <memory>
+#include <vector>
+#include <sched.h>
 
 namespace hxk
 {
 
+/**
+ * @Author: hxk
+ * @brief: 创建线程时使用的属性，默认值与pthread的默认属性相同
+ */
+struct ThreadAttr
+{
+    std::vector<int> m_cpus;    //线程可以运行的CPU，为空时不设置亲和性
+    size_t m_stack_size = 0;    //线程栈大小，为0时使用系统默认值
+    int m_policy = SCHED_OTHER; //调度策略，SCHED_FIFO/SCHED_RR需要权限，没有权限时退回默认策略
+    int m_priority = 0;         //SCHED_FIFO/SCHED_RR的静态优先级
+};
+
 class Thread : public noncopyable
 {
 public:
@@ -21,6 +35,7 @@ public:
     typedef std::unique_ptr<Thread> _uptr;
 
     Thread(ThreadFunc callback, const std::string& name);
+    Thread(ThreadFunc callback, const std::string& name, const ThreadAttr& attr);
     ~Thread();
 
     pid_t getID() const;    //线程ID
@@ -38,6 +53,10 @@ public:
 
     static void setThisThreadName(const std::string& name);
 
+    static int getThisNode();   //当前线程绑定的NUMA节点，没有绑定CPU或绑定的CPU跨节点时返回-1
+
+    static bool setThisAffinity(const std::vector<int>& cpus);  //把已经在运行的当前线程绑定到指定的CPU，失败时返回false
+
     static void* run(void* arg);    
 
 private:
@@ -53,6 +72,8 @@ private:
 
     bool m_started;         //线程状态     
     bool m_joined;    
+
+    ThreadAttr m_attr;      //创建线程时使用的属性
 };
 
 
@@ -8,10 +8,10 @@ bool Timer::Compare::operator()(const Timer::_ptr& lhs, const Timer::_ptr& rhs)
     if(!lhs && !rhs) {
         return false;
     }
-    if(lhs) {
+    if(!lhs) {
         return true;
     }
-    if(rhs) {
+    if(!rhs) {
         return false;
     }
     //按绝对时间戳排序
@@ -27,15 +27,19 @@ bool Timer::Compare::operator()(const Timer::_ptr& lhs, const Timer::_ptr& rhs)
 Timer::Timer(uint64_t next) :m_cyclic(false), 
                             m_ms(0),
                             m_next(next),
-                            m_manager(nullptr)
+                            m_manager(nullptr),
+                            m_priority(PRIORITY_NORMAL),
+                            m_deadline_us(0)
 {
 
 }
-Timer::Timer(uint64_t ms, std::function<void()> fn, bool cyclic, TimerManager* manager)
+Timer::Timer(uint64_t ms, std::function<void()> fn, bool cyclic, TimerManager* manager, TaskPriority priority)
             : m_cyclic(cyclic),
             m_ms(ms),
             m_cb(fn),
-            m_manager(manager)
+            m_manager(manager),
+            m_priority(priority),
+            m_deadline_us(cyclic ? 0 : Fiber::getThisDeadline())
 {
     m_next = GetCurrentMS() + m_ms;
 }
@@ -47,7 +51,9 @@ bool Timer::cancel()
     if(m_cb) {
         m_cb = nullptr;
         auto it = m_manager->m_timers.find(shared_from_this());
-        m_manager->m_timers.erase(it);
+        if(it != m_manager->m_timers.end()) {
+            m_manager->m_timers.erase(it);
+        }
         return true;
     }
     return false;
@@ -122,9 +128,9 @@ TimerManager::~TimerManager()
 
 }
 
-Timer::_ptr TimerManager::addTimer(uint64_t ms, std::function<void()> fn, bool cyclic)
+Timer::_ptr TimerManager::addTimer(uint64_t ms, std::function<void()> fn, bool cyclic, TaskPriority priority)
 {
-    Timer::_ptr timer(new Timer(ms, fn, cyclic, this));
+    Timer::_ptr timer(new Timer(ms, fn, cyclic, this, priority));
     WriteScopedLock lock(&m_lock);
     addTimer(timer, lock);
     return timer;
@@ -141,9 +147,9 @@ void TimerManager::addTimer(Timer::_ptr timer, WriteScopedLock& lock)
 }
 
 Timer::_ptr TimerManager::addConditionTimer(uint64_t ms, std::function<void()> fn,
-                                            std::weak_ptr<void> weak_cond, bool cyclic)
+                                            std::weak_ptr<void> weak_cond, bool cyclic, TaskPriority priority)
 {
-    return addTimer(ms, std::bind(&onTimer,weak_cond, fn), cyclic);
+    return addTimer(ms, std::bind(&onTimer,weak_cond, fn), cyclic, priority);
 }
 
 uint64_t TimerManager::getNextTimer()
@@ -163,6 +169,19 @@ uint64_t TimerManager::getNextTimer()
 }
 
 void TimerManager::listExpiredCallback(std::vector<std::function<void()>>& fns)
+{
+    std::vector<TaskPriority> priorities;
+    listExpiredCallback(fns, priorities);
+}
+
+void TimerManager::listExpiredCallback(std::vector<std::function<void()>>& fns, std::vector<TaskPriority>& priorities)
+{
+    std::vector<uint64_t> deadlines;
+    listExpiredCallback(fns, priorities, deadlines);
+}
+
+void TimerManager::listExpiredCallback(std::vector<std::function<void()>>& fns, std::vector<TaskPriority>& priorities,
+                                       std::vector<uint64_t>& deadlines, size_t max_count)
 {
     uint64_t now_ms = GetCurrentMS();
     std::vector<Timer::_ptr> expired;
@@ -184,11 +203,22 @@ void TimerManager::listExpiredCallback(std::vector<std::function<void()>>& fns)
     while(it != m_timers.end() && (*it)->m_next == now_timer->m_next) {
         ++it;
     }
+    if(max_count != SIZE_MAX) {
+        auto end = m_timers.begin();
+        for(size_t count = 0; end != it && count < max_count; count++) {
+            ++end;
+        }
+        it = end;
+    }
     expired.insert(expired.begin(),m_timers.begin(), it);
     m_timers.erase(m_timers.begin(), it);
     fns.reserve(expired.size());
+    priorities.reserve(expired.size());
+    deadlines.reserve(expired.size());
     for(auto& timer : expired) {
         fns.emplace_back(timer->m_cb);
+        priorities.push_back(timer->m_priority);
+        deadlines.push_back(timer->m_deadline_us);
         if(timer->m_cyclic) {
             timer->m_next = now_ms + timer->m_ms;
             m_timers.insert(timer);
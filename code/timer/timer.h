@@ -6,6 +6,7 @@
 
 #include "lock.h"
 #include "util.h"
+#include "scheduler.h"
 
 namespace hxk
 {
@@ -42,9 +43,10 @@ private:
      * @param {function<void()>} fn 回调函数
      * @param {bool} cyclic         是否重复执行
      * @param {TimerManager*} manager   执行环境
+     * @param {TaskPriority} priority   到期后回调函数被调度的优先级
      * @return {*}
      */
-    Timer(uint64_t ms, std::function<void()> fn, bool cyclic, TimerManager* manager);
+    Timer(uint64_t ms, std::function<void()> fn, bool cyclic, TimerManager* manager, TaskPriority priority);
 
     /**
      * @Author: hxk
@@ -60,6 +62,8 @@ private:
     uint64_t m_next;    //执行的绝对时间戳
     std::function<void()> m_cb;
     TimerManager* m_manager;
+    TaskPriority m_priority;    //回调函数被调度的优先级
+    uint64_t m_deadline_us;     //回调任务的截止时间，取自创建定时器的协程，循环定时器没有截止时间
 
 private:
     struct Compare 
@@ -82,9 +86,11 @@ public:
      * @param {uint64_t} ms 延迟毫秒数
      * @param {function<void()>} fn 回调函数
      * @param {bool} cyclic     是否重复执行
+     * @param {TaskPriority} priority   到期后回调函数被调度的优先级
      * @return {*}
      */
-    Timer::_ptr addTimer(uint64_t ms, std::function<void()> fn, bool cyclic = false);
+    Timer::_ptr addTimer(uint64_t ms, std::function<void()> fn, bool cyclic = false,
+                         TaskPriority priority = PRIORITY_NORMAL);
 
     /**
      * @Author: hxk
@@ -93,9 +99,11 @@ public:
      * @param {function<void()>} fn
      * @param {weak_ptr<void>} weak_cond 条件变量，利用智能指针是否有效作为判断条件
      * @param {bool} cyclic
+     * @param {TaskPriority} priority
      * @return {*}
      */
-    Timer::_ptr addConditionTimer(uint64_t ms, std::function<void()> fn, std::weak_ptr<void> weak_cond, bool cyclic = false);
+    Timer::_ptr addConditionTimer(uint64_t ms, std::function<void()> fn, std::weak_ptr<void> weak_cond, bool cyclic = false,
+                                  TaskPriority priority = PRIORITY_NORMAL);
 
 
     /**
@@ -112,6 +120,24 @@ public:
      */
     void listExpiredCallback(std::vector<std::function<void()>>& fns);
 
+    /**
+     * @Author: hxk
+     * @brief: 同上，同时获取每个回调函数被调度的优先级
+     * @param {vector<TaskPriority>&} priorities   与fns一一对应
+     * @return {*}
+     */
+    void listExpiredCallback(std::vector<std::function<void()>>& fns, std::vector<TaskPriority>& priorities);
+
+    /**
+     * @Author: hxk
+     * @brief: 同上，同时获取每个回调任务的截止时间，0表示没有截止时间
+     * @param {vector<uint64_t>&} deadlines    与fns一一对应
+     * @param {size_t} max_count    最多取出的定时器数量，其余到期的定时器留到下一次
+     * @return {*}
+     */
+    void listExpiredCallback(std::vector<std::function<void()>>& fns, std::vector<TaskPriority>& priorities,
+                             std::vector<uint64_t>& deadlines, size_t max_count = SIZE_MAX);
+
     /**
      * @Author: hxk
      * @brief: 检查是否有等待执行的定时器
@@ -5,6 +5,12 @@
 #include <stdint.h>
 #include <pthread.h>
 #include <stdexcept>
+#include <errno.h>
+#include <time.h>
+#include <atomic>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 namespace hxk
 {
@@ -35,6 +41,26 @@ public:
             throw std::logic_error("sem_wait error");
         }
     }
+    bool waitFor(uint64_t timeout_ms)   //-1操作，值为0时最多阻塞timeout_ms，超时返回false
+    {
+        timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+        if(deadline.tv_nsec >= 1000000000) {
+            ++deadline.tv_sec;
+            deadline.tv_nsec -= 1000000000;
+        }
+        while(sem_timedwait(&m_semaphore, &deadline)) {
+            if(errno == ETIMEDOUT) {
+                return false;
+            }
+            if(errno != EINTR) {
+                throw std::logic_error("sem_timedwait error");
+            }
+        }
+        return true;
+    }
     void notify()  //+1操作
     {
         if(sem_post(&m_semaphore)){
@@ -46,6 +72,44 @@ private:
     sem_t m_semaphore;
 };
 
+/**
+ * @Author: hxk
+ * @brief: 对futex简单封装，线程直接在一个32位原子变量上等待和唤醒，不需要额外的内核对象
+ *      等待方在值仍为expected时才会阻塞，修改值的一方负责唤醒，因此不会丢失唤醒
+ */
+class Futex
+{
+public:
+    /**
+     * @Author: hxk
+     * @brief: 值等于expected时阻塞，直到被唤醒或超时，可能被虚假唤醒，调用方需要重新检查值
+     * @param {uint64_t} timeout_ms  最长等待时间
+     * @return {bool} 超时返回false
+     */
+    static bool wait(std::atomic_int& word, int expected, uint64_t timeout_ms)
+    {
+        timespec timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+        long rt = syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT_PRIVATE, expected, &timeout, nullptr, 0);
+        return !(rt == -1 && errno == ETIMEDOUT);
+    }
+
+    static void wake(std::atomic_int& word, int count = 1)   //唤醒最多count个等待的线程
+    {
+        syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+    }
+};
+
+inline void CpuRelax()  //自旋等待时降低功耗，并让出流水线给同一核心上的超线程
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
 /**
  * @Author: hxk
  * @brief: 作用域线程锁包装器
@@ -157,6 +221,14 @@ private:
 };
 
 
+//当前线程持有的Mutex、RWLock数量；持有这些锁时协程不能挂起，否则同一线程上的下一个协程加锁会阻塞整个线程
+inline thread_local uint32_t t_held_thread_locks = 0;
+
+inline uint32_t getHeldThreadLocks()
+{
+    return t_held_thread_locks;
+}
+
 /**
  * @Author: hxk
  * @brief: pthread互斥量封装
@@ -176,10 +248,13 @@ public:
 
     int lock()
     {
-        return pthread_mutex_lock(&m_mutex);
+        int result = pthread_mutex_lock(&m_mutex);
+        t_held_thread_locks += result == 0;
+        return result;
     }
     int unlock()
     {
+        --t_held_thread_locks;
         return pthread_mutex_unlock(&m_mutex);
     }
 
@@ -206,14 +281,19 @@ public:
 
     int readLock()
     {
-        return pthread_rwlock_rdlock(&m_lock);
+        int result = pthread_rwlock_rdlock(&m_lock);
+        t_held_thread_locks += result == 0;
+        return result;
     }
     int writeLock()
     {
-        return pthread_rwlock_wrlock(&m_lock);
+        int result = pthread_rwlock_wrlock(&m_lock);
+        t_held_thread_locks += result == 0;
+        return result;
     }
     int unlock()
     {
+        --t_held_thread_locks;
         return pthread_rwlock_unlock(&m_lock);
     }
 private:
@@ -221,6 +301,37 @@ private:
 };
 
 
+/**
+ * @Author: hxk
+ * @brief: pthread自旋锁封装，适用于临界区很短的场景
+ * @return {*}
+ */
+class SpinLock
+{
+public:
+    SpinLock()
+    {
+        pthread_spin_init(&m_lock, PTHREAD_PROCESS_PRIVATE);
+    }
+    ~SpinLock()
+    {
+        pthread_spin_destroy(&m_lock);
+    }
+
+    int lock()
+    {
+        return pthread_spin_lock(&m_lock);
+    }
+    int unlock()
+    {
+        return pthread_spin_unlock(&m_lock);
+    }
+
+private:
+    pthread_spinlock_t m_lock{};
+};
+
+
 /**
  * @Author: hxk
  * @brief: Mutex的RAII
@@ -242,4 +353,11 @@ using ReadScopedLock = ReadScopedLockImpl<RWLock>;
  */
 using WriteScopedLock = WriteScopedLockImpl<RWLock>;
 
+/**
+ * @Author: hxk
+ * @brief: SpinLock的RAII
+ * @return {*}
+ */
+using ScopedSpinLock = ScopedLockImpl<SpinLock>;
+
 }
\ No newline at end of file
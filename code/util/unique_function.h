@@ -0,0 +1,224 @@
+#pragma once
+
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <stddef.h>
+
+namespace hxk
+{
+
+template<class Signature>
+class unique_function;
+
+/**
+ * @Author: hxk
+ * @brief: 只能移动的函数对象，用于替代std::function保存任务回调
+ *      不要求可调用对象可拷贝，因此可以捕获unique_ptr等只能移动的对象
+ *      不超过INLINE_SIZE且移动构造不抛异常的可调用对象直接保存在对象内部，不需要分配内存
+ *      从空的std::function或空指针构造时，结果也是空的
+ */
+template<class R, class... Args>
+class unique_function<R(Args...)>
+{
+public:
+    static const size_t INLINE_SIZE = 6 * sizeof(void*);     //可以放入std::function的lambda一般不超过这个大小
+
+    unique_function() noexcept : m_ops(nullptr) {}
+    unique_function(std::nullptr_t) noexcept : m_ops(nullptr) {}
+
+    template<class F, class D = typename std::decay<F>::type,
+             class = typename std::enable_if<!std::is_same<D, unique_function>::value &&
+                                             std::is_invocable_r<R, D&, Args...>::value>::type>
+    unique_function(F&& f) : m_ops(nullptr)
+    {
+        if(isEmpty(f)) {
+            return;
+        }
+        if constexpr(IsInline<D>::value) {
+            new (&m_storage) D(std::forward<F>(f));
+            m_ops = &InlineOps<D>::s_ops;
+        }
+        else {
+            *reinterpret_cast<D**>(&m_storage) = new D(std::forward<F>(f));
+            m_ops = &HeapOps<D>::s_ops;
+        }
+    }
+
+    unique_function(unique_function&& other) noexcept : m_ops(other.m_ops)
+    {
+        if(m_ops) {
+            m_ops->m_move(&other.m_storage, &m_storage);
+            other.m_ops = nullptr;
+        }
+    }
+
+    unique_function& operator=(unique_function&& other) noexcept
+    {
+        if(this != &other) {
+            reset();
+            if(other.m_ops) {
+                other.m_ops->m_move(&other.m_storage, &m_storage);
+                m_ops = other.m_ops;
+                other.m_ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    unique_function& operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    template<class F, class = decltype(unique_function(std::declval<F>()))>
+    unique_function& operator=(F&& f)
+    {
+        return *this = unique_function(std::forward<F>(f));
+    }
+
+    unique_function(const unique_function&) = delete;
+    unique_function& operator=(const unique_function&) = delete;
+
+    ~unique_function()
+    {
+        reset();
+    }
+
+    R operator()(Args... args)
+    {
+        if(!m_ops) {
+            throw std::bad_function_call();
+        }
+        return m_ops->m_invoke(&m_storage, std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return m_ops != nullptr;
+    }
+
+    void swap(unique_function& other) noexcept
+    {
+        unique_function tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+    bool isInline() const noexcept    //可调用对象是否保存在对象内部
+    {
+        return m_ops && m_ops->m_inline;
+    }
+
+private:
+    typedef typename std::aligned_storage<INLINE_SIZE, alignof(max_align_t)>::type Storage;
+
+    struct Ops
+    {
+        R (*m_invoke)(Storage*, Args&&...);
+        void (*m_move)(Storage* from, Storage* to);     //移动到to，并析构from
+        void (*m_destroy)(Storage*);
+        bool m_inline;
+    };
+
+    template<class D>
+    struct IsInline : std::integral_constant<bool, sizeof(D) <= sizeof(Storage) &&
+                                                   alignof(Storage) % alignof(D) == 0 &&
+                                                   std::is_nothrow_move_constructible<D>::value> {};
+
+    template<class D>
+    struct InlineOps
+    {
+        static D* get(Storage* storage)
+        {
+            return std::launder(reinterpret_cast<D*>(storage));
+        }
+        static R invoke(Storage* storage, Args&&... args)
+        {
+            return std::invoke(*get(storage), std::forward<Args>(args)...);
+        }
+        static void move(Storage* from, Storage* to)
+        {
+            new (to) D(std::move(*get(from)));
+            get(from)->~D();
+        }
+        static void destroy(Storage* storage)
+        {
+            get(storage)->~D();
+        }
+        static constexpr Ops s_ops = {&invoke, &move, &destroy, true};
+    };
+
+    template<class D>
+    struct HeapOps
+    {
+        static D*& get(Storage* storage)
+        {
+            return *reinterpret_cast<D**>(storage);
+        }
+        static R invoke(Storage* storage, Args&&... args)
+        {
+            return std::invoke(*get(storage), std::forward<Args>(args)...);
+        }
+        static void move(Storage* from, Storage* to)
+        {
+            *reinterpret_cast<D**>(to) = get(from);
+        }
+        static void destroy(Storage* storage)
+        {
+            delete get(storage);
+        }
+        static constexpr Ops s_ops = {&invoke, &move, &destroy, false};
+    };
+
+    template<class F>
+    static bool isEmpty(const F& f)
+    {
+        if constexpr(std::is_pointer<F>::value || std::is_member_pointer<F>::value) {
+            return f == nullptr;
+        }
+        else {
+            return isEmptyFunction(f);
+        }
+    }
+
+    template<class S>
+    static bool isEmptyFunction(const std::function<S>& f)
+    {
+        return !f;
+    }
+
+    template<class F>
+    static bool isEmptyFunction(const F&)
+    {
+        return false;
+    }
+
+    void reset() noexcept
+    {
+        if(m_ops) {
+            m_ops->m_destroy(&m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+private:
+    Storage m_storage;
+    const Ops* m_ops;   //为nullptr时表示空
+};
+
+template<class R, class... Args>
+bool operator==(const unique_function<R(Args...)>& f, std::nullptr_t) noexcept
+{
+    return !f;
+}
+
+template<class R, class... Args>
+bool operator!=(const unique_function<R(Args...)>& f, std::nullptr_t) noexcept
+{
+    return static_cast<bool>(f);
+}
+
+}
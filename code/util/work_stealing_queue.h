@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+#include "noncopyable.h"
+
+namespace hxk
+{
+
+/**
+ * @Author: hxk
+ * @brief: Chase-Lev 工作窃取双端队列（Lê et al. 2013 的C11内存序版本）
+ *      只有拥有者线程可以push/pop（队尾），其他线程通过steal从队头取出元素
+ *      T必须是可以放入std::atomic的平凡类型，一般为指针
+ *      容量不足时自动扩容，旧的缓冲区在队列析构时才释放，保证并发的steal读到的内存有效
+ */
+template<class T>
+class WorkStealingQueue : public noncopyable
+{
+public:
+    enum StealResult
+    {
+        SUCCESS,
+        EMPTY,      //队列为空
+        ABORT       //与其他线程竞争失败，可以重试
+    };
+
+    explicit WorkStealingQueue(size_t capacity = 256):m_top(0), m_bottom(0)
+    {
+        size_t size = 1;
+        while(size < capacity) {
+            size <<= 1;
+        }
+        m_buffers.emplace_back(new Buffer(size));
+        m_buffer.store(m_buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 放入队尾，只能由拥有者线程调用
+     * @return {*}
+     */
+    void push(T value)
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        int64_t top = m_top.load(std::memory_order_acquire);
+        Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+        if(bottom - top > static_cast<int64_t>(buffer->m_mask)) {
+            buffer = grow(buffer, top, bottom);
+        }
+        buffer->put(bottom, value);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 从队尾取出（后进先出），只能由拥有者线程调用
+     * @return {bool} 队列为空时返回false
+     */
+    bool pop(T& value)
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+        m_bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+        if(top > bottom) {
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+        value = buffer->get(bottom);
+        if(top == bottom) {
+            //只剩最后一个元素，和steal竞争
+            bool success = m_top.compare_exchange_strong(top, top + 1,
+                                std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return success;
+        }
+        return true;
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 从队头取出（先进先出），任意线程都可以调用
+     * @return {StealResult}
+     */
+    StealResult steal(T& value)
+    {
+        int64_t top = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = m_bottom.load(std::memory_order_acquire);
+        if(top >= bottom) {
+            return EMPTY;
+        }
+        Buffer* buffer = m_buffer.load(std::memory_order_acquire);
+        T result = buffer->get(top);
+        if(!m_top.compare_exchange_strong(top, top + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return ABORT;
+        }
+        value = result;
+        return SUCCESS;
+    }
+
+    /**
+     * @Author: hxk
+     * @brief: 从队头取出，竞争失败时重试，直到成功或队列为空
+     * @return {bool}
+     */
+    bool take(T& value)
+    {
+        StealResult result;
+        while((result = steal(value)) == ABORT);
+        return result == SUCCESS;
+    }
+
+    size_t size() const     //并发修改时只是近似值
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+        return bottom > top ? bottom - top : 0;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+private:
+    struct Buffer
+    {
+        explicit Buffer(size_t size):m_mask(size - 1), m_data(new std::atomic<T>[size])
+        {
+
+        }
+
+        T get(int64_t index) const
+        {
+            return m_data[index & m_mask].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t index, T value)
+        {
+            m_data[index & m_mask].store(value, std::memory_order_relaxed);
+        }
+
+        size_t m_mask;
+        std::unique_ptr<std::atomic<T>[]> m_data;
+    };
+
+    Buffer* grow(Buffer* buffer, int64_t top, int64_t bottom)
+    {
+        Buffer* bigger = new Buffer((buffer->m_mask + 1) * 2);
+        for(int64_t i = top; i < bottom; i++) {
+            bigger->put(i, buffer->get(i));
+        }
+        m_buffers.emplace_back(bigger);     //只有拥有者线程会修改
+        m_buffer.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+private:
+    alignas(64) std::atomic_int64_t m_top;      //steal端
+    alignas(64) std::atomic_int64_t m_bottom;   //拥有者端
+    std::atomic<Buffer*> m_buffer;
+    std::vector<std::unique_ptr<Buffer>> m_buffers; //所有分配过的缓冲区
+};
+
+}
@@ -0,0 +1,151 @@
+#include "log.h"
+#include "io_manager.h"
+#include "channel.h"
+
+#include <list>
+#include <iostream>
+
+/*
+    通道性能测试，对比 Mutex + std::list + Semaphore（阻塞线程）的传统写法
+        ./bench_channel [数据量，默认1000000]
+    吞吐：2个生产者、2个消费者在4线程的IOManager上传递数据
+    延迟：两个协程通过一对通道做ping-pong，统计平均往返时间
+    mutex+list写法在等待时阻塞线程，协程数量不能超过线程数，因此只有通道能测试大量协程的情况
+*/
+
+//传统写法：加锁的链表，用信号量计数，消费者在空队列上阻塞线程
+template<class T>
+class ListQueue
+{
+public:
+    void push(T value)
+    {
+        {
+            hxk::ScopedLock lock(&m_mutex);
+            m_list.push_back(value);
+        }
+        m_items.notify();
+    }
+
+    T pop()
+    {
+        m_items.wait();
+        hxk::ScopedLock lock(&m_mutex);
+        T value = m_list.front();
+        m_list.pop_front();
+        return value;
+    }
+
+private:
+    hxk::Mutex m_mutex;
+    hxk::Semaphore m_items;
+    std::list<T> m_list;
+};
+
+//返回每秒传递的数据量
+template<class Send, class Recv>
+static double run_throughput(hxk::IOManager& iom, int producers, int consumers, long items, Send send, Recv recv)
+{
+    hxk::Semaphore finished(0);
+    long per_producer = items / producers, per_consumer = items / consumers;
+    uint64_t begin = hxk::GetCurrentUS();
+    for(int i = 0; i < consumers; i++) {
+        iom.schedule([&, per_consumer](){
+            long count = 0;
+            while(count < per_consumer) {
+                count += recv(per_consumer - count);
+            }
+            finished.notify();
+        });
+    }
+    for(int i = 0; i < producers; i++) {
+        iom.schedule([&, per_producer](){
+            for(long j = 0; j < per_producer; j++) {
+                send(j);
+            }
+        });
+    }
+    for(int i = 0; i < consumers; i++) {
+        finished.wait();
+    }
+    uint64_t used = hxk::GetCurrentUS() - begin;
+    return items * 1000000.0 / used;
+}
+
+//返回平均往返时间（ns）
+template<class Ping, class Pong>
+static double run_latency(hxk::IOManager& iom, long rounds, Ping ping, Pong pong)
+{
+    hxk::Semaphore finished(0);
+    uint64_t begin = hxk::GetCurrentUS();
+    iom.schedule([&](){
+        for(long i = 0; i < rounds; i++) {
+            pong();
+        }
+    });
+    iom.schedule([&](){
+        for(long i = 0; i < rounds; i++) {
+            ping();
+        }
+        finished.notify();
+    });
+    finished.wait();
+    uint64_t used = hxk::GetCurrentUS() - begin;
+    return used * 1000.0 / rounds;
+}
+
+int main(int argc, char** argv)
+{
+    long items = argc > 1 ? atol(argv[1]) : 1000000;
+    long rounds = items / 10;
+    GET_LOGGER("system")->setLevel(hxk::LogLevel::INFO);
+    hxk::IOManager iom(4, false, "bench");
+
+    {
+        ListQueue<long> queue;
+        double rate = run_throughput(iom, 2, 2, items,
+            [&](long v){ queue.push(v); },
+            [&](long){ queue.pop(); return 1; });
+        std::cout << "throughput mutex+list     2x2:     " << (long)rate << " items/s" << std::endl;
+    }
+    {
+        hxk::Channel<long> channel(1024);
+        double rate = run_throughput(iom, 2, 2, items,
+            [&](long v){ channel.send(v); },
+            [&](long){ long v; channel.recv(v); return 1; });
+        std::cout << "throughput channel        2x2:     " << (long)rate << " items/s" << std::endl;
+    }
+    {
+        hxk::Channel<long> channel(1024);
+        double rate = run_throughput(iom, 2, 2, items,
+            [&](long v){ channel.send(v); },
+            [&](long remain){
+                std::vector<long> values;
+                return (long)channel.recvMany(values, std::min(remain, 64l));
+            });
+        std::cout << "throughput channel recvMany 2x2:   " << (long)rate << " items/s" << std::endl;
+    }
+    {
+        hxk::Channel<long> channel(1024);
+        double rate = run_throughput(iom, 100, 100, items,
+            [&](long v){ channel.send(v); },
+            [&](long){ long v; channel.recv(v); return 1; });
+        std::cout << "throughput channel    100x100:     " << (long)rate << " items/s" << std::endl;
+    }
+
+    {
+        ListQueue<long> ping_queue, pong_queue;
+        double ns = run_latency(iom, rounds,
+            [&](){ ping_queue.push(1); pong_queue.pop(); },
+            [&](){ pong_queue.push(ping_queue.pop()); });
+        std::cout << "ping-pong mutex+list:  " << (long)ns << " ns/round-trip" << std::endl;
+    }
+    {
+        hxk::Channel<long> ping_channel(1), pong_channel(1);
+        double ns = run_latency(iom, rounds,
+            [&](){ long v; ping_channel.send(1); pong_channel.recv(v); },
+            [&](){ long v; ping_channel.recv(v); pong_channel.send(v); });
+        std::cout << "ping-pong channel:     " << (long)ns << " ns/round-trip" << std::endl;
+    }
+    return 0;
+}
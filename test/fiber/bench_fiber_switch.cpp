@@ -0,0 +1,73 @@
+#include "fiber.h"
+#include "util.h"
+
+#include <ucontext.h>
+#include <iostream>
+
+/*
+    协程切换延迟测试
+        * Fiber::call / Fiber::yieldToReady 往返，使用编译期选择的上下文切换实现
+        * 直接使用glibc swapcontext往返，作为对照
+    使用 -DHXK_FIBER_USE_UCONTEXT 编译时，Fiber也会使用ucontext实现
+*/
+
+static const uint64_t ROUNDS = 1000000;
+
+void fiber_loop()
+{
+    for(uint64_t i = 0; i < ROUNDS; i++) {
+        hxk::Fiber::yieldToReady();
+    }
+}
+
+void bench_fiber()
+{
+    hxk::Fiber::getThis();
+    auto fiber = std::make_shared<hxk::Fiber>(fiber_loop);
+
+    uint64_t begin = hxk::GetCurrentUS();
+    while(!fiber->finish()) {
+        fiber->call();
+    }
+    uint64_t end = hxk::GetCurrentUS();
+
+    //每轮往返包含两次切换
+    std::cout << "Fiber[" << hxk::FiberContext::backend() << "]: "
+              << (end - begin) * 1000.0 / (ROUNDS * 2) << " ns/switch" << std::endl;
+}
+
+static ucontext_t s_main_ctx;
+static ucontext_t s_loop_ctx;
+
+void ucontext_loop()
+{
+    for(uint64_t i = 0; i < ROUNDS; i++) {
+        swapcontext(&s_loop_ctx, &s_main_ctx);
+    }
+}
+
+void bench_ucontext()
+{
+    std::unique_ptr<char[]> stack(new char[128 * 1024]);
+    getcontext(&s_loop_ctx);
+    s_loop_ctx.uc_link = &s_main_ctx;
+    s_loop_ctx.uc_stack.ss_sp = stack.get();
+    s_loop_ctx.uc_stack.ss_size = 128 * 1024;
+    makecontext(&s_loop_ctx, ucontext_loop, 0);
+
+    uint64_t begin = hxk::GetCurrentUS();
+    for(uint64_t i = 0; i <= ROUNDS; i++) {
+        swapcontext(&s_main_ctx, &s_loop_ctx);
+    }
+    uint64_t end = hxk::GetCurrentUS();
+
+    std::cout << "raw swapcontext: "
+              << (end - begin) * 1000.0 / (ROUNDS * 2) << " ns/switch" << std::endl;
+}
+
+int main()
+{
+    bench_ucontext();
+    bench_fiber();
+    return 0;
+}
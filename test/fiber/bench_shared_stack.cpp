@@ -0,0 +1,72 @@
+#include "fiber.h"
+#include "util.h"
+#include "log.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+/*
+    共享栈内存测试：创建大量挂起的协程，对比私有栈和共享栈模式下的内存占用
+        ./bench_shared_stack [private|shared] [协程数量，默认100000]
+    每个协程在栈上使用约1KB数据后挂起，模拟阻塞在recv上的空闲连接
+*/
+
+static void readMemory(uint64_t& vsz_kb, uint64_t& rss_kb)
+{
+    std::ifstream statm("/proc/self/statm");
+    uint64_t vsz_pages = 0, rss_pages = 0;
+    statm >> vsz_pages >> rss_pages;
+    uint64_t page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    vsz_kb = vsz_pages * page_kb;
+    rss_kb = rss_pages * page_kb;
+}
+
+void idle_connection()
+{
+    char buffer[1024];
+    memset(buffer, 'x', sizeof(buffer));
+    hxk::Fiber::yieldToReady();
+    //恢复后栈上的数据必须保持不变
+    for(size_t i = 0; i < sizeof(buffer); i++) {
+        if(buffer[i] != 'x') {
+            std::cout << "stack corrupted" << std::endl;
+            abort();
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool shared = argc > 1 && strcmp(argv[1], "shared") == 0;
+    size_t count = argc > 2 ? atol(argv[2]) : 100000;
+    GET_LOGGER("system")->setLevel(hxk::LogLevel::INFO);
+
+    hxk::Fiber::getThis();
+    uint64_t vsz_before, rss_before;
+    readMemory(vsz_before, rss_before);
+
+    std::vector<hxk::Fiber::_ptr> fibers;
+    fibers.reserve(count);
+    uint64_t begin = hxk::GetCurrentMS();
+    for(size_t i = 0; i < count; i++) {
+        fibers.push_back(std::make_shared<hxk::Fiber>(idle_connection, 0, false, shared));
+        fibers.back()->call();
+    }
+    uint64_t parked = hxk::GetCurrentMS();
+
+    uint64_t vsz_after, rss_after;
+    readMemory(vsz_after, rss_after);
+
+    for(auto& fiber : fibers) {
+        fiber->call();
+    }
+    uint64_t end = hxk::GetCurrentMS();
+
+    std::cout << (shared ? "shared" : "private") << " stack, " << count << " parked fibers" << std::endl;
+    std::cout << "  VSZ: " << (vsz_after - vsz_before) / 1024 << " MB" << std::endl;
+    std::cout << "  RSS: " << (rss_after - rss_before) / 1024 << " MB, "
+              << (rss_after - rss_before) * 1024 / count << " bytes/fiber" << std::endl;
+    std::cout << "  park: " << parked - begin << " ms, resume: " << end - parked << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "log.h"
+#include "io_manager.h"
+#include "channel.h"
+
+static hxk::Logger::_ptr g_logger = GET_ROOT_LOGGER();
+
+void test_mpmc(hxk::IOManager& iom)
+{
+    //容量很小的有界通道，发送方和接收方都会频繁挂起
+    static hxk::Channel<int> channel(4);
+    static std::atomic_long sum(0);
+    static hxk::FiberSemaphore finished(0);
+    const int producer_count = 8, consumer_count = 8, item_count = 10000;
+
+    for(int i = 0; i < consumer_count; i++) {
+        iom.schedule([](){
+            int value;
+            while(channel.recv(value)) {
+                sum += value;
+            }
+            finished.notify();
+        });
+    }
+    for(int i = 0; i < producer_count; i++) {
+        iom.schedule([](){
+            for(int j = 1; j <= item_count; j++) {
+                channel.send(j);
+            }
+            finished.notify();
+        });
+    }
+    for(int i = 0; i < producer_count; i++) {
+        finished.wait();
+    }
+    channel.close();
+    for(int i = 0; i < consumer_count; i++) {
+        finished.wait();
+    }
+    LOG_FORMAT_INFO(g_logger, "mpmc sum = %ld, expect = %ld", sum.load(),
+                    (long)producer_count * item_count * (item_count + 1) / 2);
+}
+
+void test_recv_many(hxk::IOManager& iom)
+{
+    static hxk::Channel<int> channel;
+    static hxk::FiberSemaphore finished(0);
+    iom.schedule([](){
+        std::vector<int> values;
+        size_t batches = 0;
+        while(channel.recvMany(values, 64) > 0) {
+            ++batches;
+        }
+        LOG_FORMAT_INFO(g_logger, "recvMany got %lu values in %lu batches", values.size(), batches);
+        finished.notify();
+    });
+    for(int i = 0; i < 1000; i++) {
+        channel.send(i);
+    }
+    channel.close();
+    finished.wait();
+}
+
+void test_select(hxk::IOManager& iom)
+{
+    static hxk::Channel<int> numbers(1);
+    static hxk::Channel<std::string> words(1);
+    static hxk::FiberSemaphore finished(0);
+
+    iom.schedule([](){
+        int number;
+        std::string word;
+        bool ok;
+        int received = 0, timeout = 0;
+        while(true) {
+            hxk::ChannelSelector selector;
+            selector.onRecv(numbers, number, &ok).onRecv(words, word);
+            int index = selector.select(50);
+            if(index == -1) {
+                ++timeout;
+                if(timeout == 2) {
+                    break;
+                }
+            }
+            else if(index == 0 && !ok) {
+                break;      //numbers被关闭
+            }
+            else {
+                ++received;
+            }
+        }
+        LOG_FORMAT_INFO(g_logger, "select received = %d, timeout = %d", received, timeout);
+        finished.notify();
+    });
+    iom.schedule([](){
+        for(int i = 0; i < 100; i++) {
+            numbers.send(i);
+            words.send(std::to_string(i));
+        }
+        usleep(200 * 1000);     //hook之后只挂起当前协程，select会超时两次
+        numbers.close();
+    });
+    finished.wait();
+}
+
+int main()
+{
+    GET_LOGGER("system")->setLevel(hxk::LogLevel::INFO);
+    hxk::IOManager iom(2, false, "channel");
+
+    test_mpmc(iom);
+    test_recv_many(iom);
+    test_select(iom);
+    return 0;
+}
@@ -35,9 +35,23 @@ void test(char c)
     }
 }
 
+void test_pooled_stack()
+{
+    uint64_t size = 128 * 1024;
+    void* first = hxk::PooledStackAllocator::Alloc(size);
+    std::cout << "mapped = " << hxk::PooledStackAllocator::getMappedCount() << std::endl;
+    hxk::PooledStackAllocator::Delalloc(first, size);
+    std::cout << "cached = " << hxk::PooledStackAllocator::getCachedCount() << std::endl;
+
+    //归还的栈会被当前线程复用
+    void* second = hxk::PooledStackAllocator::Alloc(size);
+    std::cout << "reused = " << (first == second) << std::endl;
+    hxk::PooledStackAllocator::Delalloc(second, size);
+}
 
 int main()
 {
+    test_pooled_stack();
     hxk::Fiber::getThis();
     {
         auto fiber = std::make_shared<hxk::Fiber>(func);
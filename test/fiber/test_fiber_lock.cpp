@@ -0,0 +1,136 @@
+#include "log.h"
+#include "scheduler.h"
+#include "fiber_lock.h"
+
+/*
+    协程同步原语测试：调度器只有2个线程，但同时有大量协程在锁上等待，
+    等待时挂起协程而不是阻塞线程，因此不会出现线程被占满导致的死锁
+*/
+
+static hxk::Logger::_ptr g_logger = GET_ROOT_LOGGER();
+
+void test_mutex(hxk::Scheduler& sc)
+{
+    static hxk::FiberMutex mutex;
+    static int counter = 0;
+    static std::atomic_int finished(0);
+    const int fiber_count = 50, loop = 1000;
+
+    for(int i = 0; i < fiber_count; i++) {
+        sc.schedule([](){
+            for(int j = 0; j < loop; j++) {
+                hxk::FiberScopedLock lock(&mutex);
+                int value = counter;
+                if(j % 100 == 0) {
+                    hxk::Fiber::yieldToReady();     //持有锁时让出，其他协程只能挂起等待
+                }
+                counter = value + 1;
+            }
+            ++finished;
+        });
+    }
+    while(finished != fiber_count) {
+        usleep(1000);
+    }
+    LOG_FORMAT_INFO(g_logger, "mutex counter = %d, expect = %d", counter, fiber_count * loop);
+}
+
+void test_condvar_semaphore(hxk::Scheduler& sc)
+{
+    static hxk::FiberMutex mutex;
+    static hxk::FiberCondVar cond;
+    static hxk::FiberSemaphore done(0);
+    static std::deque<int> queue;
+    static int64_t sum = 0;
+    const int item_count = 10000, consumer_count = 8;
+
+    for(int i = 0; i < consumer_count; i++) {
+        sc.schedule([](){
+            while(true) {
+                int item;
+                {
+                    hxk::FiberScopedLock lock(&mutex);
+                    while(queue.empty()) {
+                        cond.wait(mutex);
+                    }
+                    item = queue.front();
+                    queue.pop_front();
+                }
+                if(item < 0) {
+                    break;
+                }
+                sum += item;    //sum只在这里修改，由下面的semaphore保证可见性
+                done.notify();
+            }
+        });
+    }
+    for(int i = 1; i <= item_count; i++) {
+        hxk::FiberScopedLock lock(&mutex);
+        queue.push_back(i);
+        cond.notifyOne();
+    }
+    //主线程不在调度器中，FiberSemaphore退化为阻塞线程
+    for(int i = 0; i < item_count; i++) {
+        done.wait();
+    }
+    {
+        hxk::FiberScopedLock lock(&mutex);
+        for(int i = 0; i < consumer_count; i++) {
+            queue.push_back(-1);
+        }
+        cond.notifyAll();
+    }
+    LOG_FORMAT_INFO(g_logger, "condvar sum = %ld, expect = %ld", sum, (int64_t)item_count * (item_count + 1) / 2);
+}
+
+void test_rwlock(hxk::Scheduler& sc)
+{
+    static hxk::FiberRWLock rwlock;
+    static int value[2] = {0, 0};
+    static std::atomic_int broken(0);
+    static hxk::FiberSemaphore finished(0);
+    const int reader_count = 20, writer_count = 5, loop = 500;
+
+    for(int i = 0; i < reader_count; i++) {
+        sc.schedule([](){
+            for(int j = 0; j < loop; j++) {
+                hxk::FiberReadScopedLock lock(&rwlock);
+                int first = value[0];
+                hxk::Fiber::yieldToReady();
+                if(first != value[1]) {
+                    ++broken;       //写锁未能互斥
+                }
+            }
+            finished.notify();
+        });
+    }
+    for(int i = 0; i < writer_count; i++) {
+        sc.schedule([](){
+            for(int j = 0; j < loop; j++) {
+                hxk::FiberWriteScopedLock lock(&rwlock);
+                ++value[0];
+                hxk::Fiber::yieldToReady();
+                ++value[1];
+            }
+            finished.notify();
+        });
+    }
+    for(int i = 0; i < reader_count + writer_count; i++) {
+        finished.wait();
+    }
+    LOG_FORMAT_INFO(g_logger, "rwlock value = %d/%d, broken reads = %d", value[0], value[1], broken.load());
+}
+
+int main()
+{
+    GET_LOGGER("system")->setLevel(hxk::LogLevel::INFO);
+    hxk::Scheduler sc(2, false, "lock");
+    sc.start();
+
+    test_mutex(sc);
+    test_condvar_semaphore(sc);
+    test_rwlock(sc);
+
+    sc.stop();
+    return 0;
+}
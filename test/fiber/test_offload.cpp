@@ -0,0 +1,177 @@
+#include "log.h"
+#include "io_manager.h"
+#include "fiber_lock.h"
+#include "offload.h"
+
+#include <fcntl.h>
+#include <fstream>
+#include <string.h>
+
+static hxk::Logger::_ptr g_logger = GET_ROOT_LOGGER();
+
+//阻塞任务在线程池中执行时，调度线程继续执行其他协程
+void test_blocking(hxk::IOManager& iom)
+{
+    static hxk::FiberSemaphore finished(0);
+    static std::atomic_int ticks(0);
+    static std::atomic_bool done(false);
+    const int task_count = 8;
+
+    iom.schedule([](){
+        while(!done) {
+            ++ticks;
+            usleep(5000);
+        }
+    });
+    uint64_t begin = hxk::GetCurrentMS();
+    for(int i = 0; i < task_count; i++) {
+        iom.schedule([i](){
+            int result = hxk::offload([i](){
+                usleep_f(50000);    //线程池中的线程不开启hook，真正阻塞
+                return i * i;
+            });
+            if(result != i * i) {
+                LOG_FORMAT_ERROR(g_logger, "offload result = %d, expect = %d", result, i * i);
+            }
+            finished.notify();
+        });
+    }
+    for(int i = 0; i < task_count; i++) {
+        finished.wait();
+    }
+    done = true;
+    LOG_FORMAT_INFO(g_logger, "%d blocking tasks in %lu ms, ticks while blocked = %d",
+                    task_count, hxk::GetCurrentMS() - begin, ticks.load());
+}
+
+void test_exception(hxk::IOManager& iom)
+{
+    static hxk::FiberSemaphore finished(0);
+    iom.schedule([](){
+        try {
+            hxk::offload([](){ throw std::runtime_error("offload failed"); });
+        }
+        catch(const std::exception& e) {
+            LOG_FORMAT_INFO(g_logger, "caught: %s", e.what());
+        }
+        finished.notify();
+    });
+    finished.wait();
+}
+
+//开启offload.file_io后，hook的read/write对普通文件交给线程池执行
+void test_file_io(hxk::IOManager& iom)
+{
+    static hxk::FiberSemaphore finished(0);
+    hxk::Config::lookUp<bool>("offload.file_io", false)->setValue(true);
+    iom.schedule([](){
+        const char* path = "/tmp/hxk_test_offload";
+        int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+        const char data[] = "offload file io";
+        ssize_t written = write(fd, data, sizeof(data));
+        char buf[64] = {0};
+        lseek(fd, 0, SEEK_SET);
+        ssize_t n = read(fd, buf, sizeof(buf));
+        ssize_t bad = read(-1, buf, sizeof(buf));
+        int err = errno;
+        close(fd);
+        unlink(path);
+        LOG_FORMAT_INFO(g_logger, "file io written = %ld, read = %ld, equal = %d, bad fd errno = %s",
+                        written, n, strcmp(buf, data) == 0, strerror(err));
+        finished.notify();
+    });
+    finished.wait();
+}
+
+//共享栈协程挂起期间栈会被其他协程复用，offload的任务和文件读写不能引用调用方的栈
+void test_shared_stack(hxk::IOManager& iom)
+{
+    static hxk::FiberSemaphore finished(0);
+    static std::atomic_int ok(0);
+    const int fiber_count = 4;
+    hxk::Config::lookUp<bool>("offload.file_io", false)->setValue(true);
+    for(int i = 0; i < fiber_count; i++) {
+        iom.schedule([i](){
+            std::string expect = "shared stack " + std::to_string(i);
+            std::string result = hxk::offload([expect](){
+                usleep_f(10000);
+                return expect;
+            });
+            char path[64];
+            snprintf(path, sizeof(path), "/tmp/hxk_test_offload_shared_%d", i);
+            int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+            char data[32] = {0};
+            snprintf(data, sizeof(data), "%s", expect.c_str());
+            write(fd, data, sizeof(data));
+            char buf[32] = {0};
+            lseek(fd, 0, SEEK_SET);
+            read(fd, buf, sizeof(buf));
+            close(fd);
+            unlink(path);
+            if(result == expect && expect == buf) {
+                ++ok;
+            }
+            finished.notify();
+        }, -1, false, true);
+    }
+    for(int i = 0; i < fiber_count; i++) {
+        finished.wait();
+    }
+    hxk::Config::lookUp<bool>("offload.file_io", false)->setValue(false);
+    LOG_FORMAT_INFO(g_logger, "shared stack ok = %d, expect = %d", ok.load(), fiber_count);
+}
+
+//开启offload.file_io后，FileLogAppender在日志锁内flush，写文件不能挂起协程，
+//否则同一线程上下一个写日志的协程会阻塞整个调度线程
+void test_log_file_io(hxk::IOManager& iom)
+{
+    static hxk::FiberSemaphore finished(0);
+    const int fiber_count = 4;
+    const int line_count = 50;
+    const char* path = "/tmp/hxk_test_offload_log";
+    unlink(path);
+    hxk::Config::lookUp<bool>("offload.file_io", false)->setValue(true);
+    auto logger = GET_LOGGER("offload_file");
+    auto appender = std::make_shared<hxk::FileLogAppender>(path);
+    logger->addAppender(appender);
+    uint64_t submitted = hxk::OffloadPool::GetInstance()->getStats().m_submitted;
+    for(int i = 0; i < fiber_count; i++) {
+        iom.schedule([logger, i, line_count](){
+            for(int j = 0; j < line_count; j++) {
+                LOG_FORMAT_INFO(logger, "fiber %d line %d", i, j);
+            }
+            finished.notify();
+        });
+    }
+    for(int i = 0; i < fiber_count; i++) {
+        finished.wait();
+    }
+    logger->delAppender(appender);
+    hxk::Config::lookUp<bool>("offload.file_io", false)->setValue(false);
+
+    std::ifstream in(path);
+    std::string line;
+    int lines = 0;
+    while(std::getline(in, line)) {
+        ++lines;
+    }
+    unlink(path);
+    LOG_FORMAT_INFO(g_logger, "log lines = %d, expect = %d, offloaded = %lu", lines, fiber_count * line_count,
+                    hxk::OffloadPool::GetInstance()->getStats().m_submitted - submitted);
+}
+
+int main()
+{
+    hxk::IOManager iom(1, false, "offload");
+    test_blocking(iom);
+    test_exception(iom);
+    test_file_io(iom);
+    test_log_file_io(iom);
+    test_shared_stack(iom);
+
+    hxk::OffloadStats stats = hxk::OffloadPool::GetInstance()->getStats();
+    LOG_FORMAT_INFO(g_logger, "offload threads = %lu, submitted = %lu, completed = %lu, queue wait max = %lu us, run = %lu us",
+                    stats.m_thread_count, stats.m_submitted, stats.m_completed,
+                    stats.m_max_queue_wait_us, stats.m_run_us);
+    return 0;
+}
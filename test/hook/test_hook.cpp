@@ -2,6 +2,7 @@
 #include "io_manager.h"
 #include "log.h"
 #include <arpa/inet.h>
+#include <iostream>
 
 
 hxk::Logger::_ptr g_logger = GET_ROOT_LOGGER();
@@ -70,8 +71,59 @@ void test_sock()
     LOG_FORMAT_DEBUG(g_logger, "buff:\n %s", buff.c_str());
 }
 
+//协程执行超过时间片之后，在hook的socket调用处让出，同一线程上排队的任务得以执行；
+//让出前经过FileLogAppender写日志不会在日志锁内让出
+void test_preempt_hooked()
+{
+    hxk::Config::lookUp<uint64_t>("scheduler.time_slice_ms", 0)->setValue(10);
+    auto system_logger = GET_LOGGER("system");
+    auto appender = std::make_shared<hxk::FileLogAppender>("/tmp/test_hook_preempt.log");
+    system_logger->addAppender(appender);
+    static std::atomic_bool short_done(false);
+    static std::atomic_bool yielded_at_write(false);
+    uint64_t preempt_count = 0;
+    {
+        hxk::IOManager iom(1, false, "preempt");
+        iom.schedule([system_logger](){
+            int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            bind(listen_fd, (sockaddr*)&addr, sizeof(addr));
+            listen(listen_fd, 1);
+            socklen_t len = sizeof(addr);
+            getsockname(listen_fd, (sockaddr*)&addr, &len);
+            int client = socket(AF_INET, SOCK_STREAM, 0);
+            connect(client, (sockaddr*)&addr, sizeof(addr));
+            int server = accept(listen_fd, nullptr, nullptr);
+
+            uint64_t start = hxk::GetCurrentMS();
+            while(hxk::GetCurrentMS() - start < 100);   //没有让出点的计算
+            LOG_INFO(system_logger, "spin finished");
+            char c = 'x';
+            write(client, &c, 1);                       //让出点
+            yielded_at_write = short_done.load();
+            read(server, &c, 1);
+            close(server);
+            close(client);
+            close(listen_fd);
+        });
+        iom.schedule([](){
+            short_done = true;
+        });
+        iom.stop();
+        preempt_count = iom.getPreemptCount();
+    }
+    system_logger->delAppender(appender);
+    hxk::Config::lookUp<uint64_t>("scheduler.time_slice_ms", 0)->setValue(0);
+    std::cout << "preempted at hooked write = " << yielded_at_write
+              << ", preempt count = " << preempt_count << std::endl;
+}
+
 int main()
 {
+    test_preempt_hooked();
+
     LOG_DEBUG(g_logger, "main() 开始");
     hxk::IOManager iom(1);
     iom.schedule(test_sock);
@@ -0,0 +1,109 @@
+#include "config.h"
+#include "log.h"
+#include "io_manager.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+/*
+    忙轮询模式的ping-pong延迟测试
+        ./bench_busy_poll [往返次数，默认20000] [忙轮询微秒数，默认50] [epoll|io_uring，默认epoll]
+    服务端和客户端各自运行在一个单线程IOManager上，通过一条loopback连接逐个发送64字节消息，
+    分别测试阻塞等待和忙轮询，输出每次往返延迟的p50/p99/p999；
+    忙轮询需要每个IOManager独占一个CPU，CPU数少于2时结果没有参考意义
+*/
+
+static const size_t MESSAGE_SIZE = 64;
+
+static void run(uint64_t busy_poll_us, size_t round_trips)
+{
+    hxk::Config::lookUp<uint64_t>("iomanager.busy_poll_us")->setValue(busy_poll_us);
+    std::vector<double> latencies;
+    latencies.reserve(round_trips);
+    uint64_t busy_polls = 0;
+    {
+        hxk::IOManager server_iom(1, false, "server");
+        hxk::IOManager client_iom(1, false, "client");
+
+        int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(listen_fd, (sockaddr*)&addr, sizeof(addr));
+        listen(listen_fd, 16);
+        socklen_t len = sizeof(addr);
+        getsockname(listen_fd, (sockaddr*)&addr, &len);
+
+        server_iom.schedule([listen_fd](){
+            int server = accept(listen_fd, nullptr, nullptr);
+            close(listen_fd);
+            int one = 1;
+            setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            char buf[MESSAGE_SIZE];
+            ssize_t n;
+            while((n = read(server, buf, sizeof(buf))) > 0) {
+                if(write(server, buf, n) != n) {
+                    break;
+                }
+            }
+            close(server);
+        });
+        client_iom.schedule([addr, round_trips, &latencies](){
+            int client = socket(AF_INET, SOCK_STREAM, 0);
+            connect(client, (sockaddr*)&addr, sizeof(addr));
+            int one = 1;
+            setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            char buf[MESSAGE_SIZE];
+            memset(buf, 'x', sizeof(buf));
+            for(size_t i = 0; i < round_trips; i++) {
+                auto start = std::chrono::steady_clock::now();
+                if(write(client, buf, sizeof(buf)) != (ssize_t)sizeof(buf)
+                   || read(client, buf, sizeof(buf)) != (ssize_t)sizeof(buf)) {
+                    break;
+                }
+                auto end = std::chrono::steady_clock::now();
+                latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+            }
+            close(client);
+        });
+        client_iom.stop();
+        server_iom.stop();
+        busy_polls = client_iom.getBusyPollCount() + server_iom.getBusyPollCount();
+    }
+    if(latencies.empty()) {
+        std::cout << "no round trips completed" << std::endl;
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p){
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(latencies.size() * p))];
+    };
+    std::cout << (busy_poll_us ? "busy-poll" : "blocking ") << ": "
+              << "p50 " << percentile(0.5) << " us, "
+              << "p99 " << percentile(0.99) << " us, "
+              << "p999 " << percentile(0.999) << " us, "
+              << busy_polls << " busy polls" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    size_t round_trips = argc > 1 ? atoi(argv[1]) : 20000;
+    uint64_t busy_poll_us = argc > 2 ? atoi(argv[2]) : 50;
+    if(argc > 3) {
+        hxk::Config::lookUp<std::string>("iomanager.backend")->setValue(argv[3]);
+    }
+    GET_LOGGER("system")->setLevel(hxk::LogLevel::WARN);
+
+    run(0, round_trips);
+    run(busy_poll_us, round_trips);
+    return 0;
+}
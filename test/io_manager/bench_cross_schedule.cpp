@@ -0,0 +1,64 @@
+#include "config.h"
+#include "log.h"
+#include "io_manager.h"
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+/*
+    跨线程调度的唤醒开销测试
+        ./bench_cross_schedule [工作线程数，默认2] [外部线程数，默认2] [每个外部线程的任务数，默认200000]
+    若干个非调度器线程向IOManager投递大量小任务，分别测试共享epoll和每线程epoll模式，
+    输出每秒完成的任务数以及每个任务对应的eventfd写入次数
+*/
+
+static void run(bool per_thread, size_t threads, size_t producers, size_t tasks)
+{
+    hxk::Config::lookUp<bool>("iomanager.per_thread_epoll")->setValue(per_thread);
+    std::atomic_uint64_t done(0);
+    uint64_t total = producers * tasks;
+    uint64_t writes = 0;
+    uint64_t start_us = 0, end_us = 0;
+    {
+        hxk::IOManager iom(threads, false, "bench");
+        start_us = hxk::GetCurrentUS();
+        std::vector<std::thread> workers;
+        for(size_t i = 0; i < producers; i++) {
+            workers.emplace_back([&iom, &done, tasks](){
+                for(size_t j = 0; j < tasks; j++) {
+                    iom.schedule([&done](){
+                        ++done;
+                    });
+                }
+            });
+        }
+        for(auto& t : workers) {
+            t.join();
+        }
+        while(done < total) {
+            std::this_thread::yield();
+        }
+        end_us = hxk::GetCurrentUS();
+        writes = iom.getTickleCount();
+        iom.stop();
+    }
+    double seconds = (end_us - start_us) / 1000000.0;
+    std::cout << (per_thread ? "per-thread epoll" : "shared epoll    ") << ": "
+              << (uint64_t)(total / seconds) << " tasks/s, "
+              << writes << " eventfd writes, "
+              << (double)writes / total << " writes/task" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    size_t threads = argc > 1 ? atoi(argv[1]) : 2;
+    size_t producers = argc > 2 ? atoi(argv[2]) : 2;
+    size_t tasks = argc > 3 ? atoi(argv[3]) : 200000;
+    GET_LOGGER("system")->setLevel(hxk::LogLevel::WARN);
+
+    run(false, threads, producers, tasks);
+    run(true, threads, producers, tasks);
+    return 0;
+}
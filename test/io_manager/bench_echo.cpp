@@ -0,0 +1,141 @@
+#include "config.h"
+#include "log.h"
+#include "sharded_io_manager.h"
+
+#include <arpa/inet.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+    分片IO调度器的echo吞吐测试
+        ./bench_echo [最大分片数，默认4] [连接数，默认64] [每轮秒数，默认2] [后端，epoll或io_uring，默认epoll]
+    服务端在分片0上accept，按分配策略把连接交给各个分片；客户端由独立的IOManager驱动，
+    每个连接循环发送64字节并等待回显。依次用1..N个分片测试，输出每秒往返次数和相对单分片的加速比
+*/
+
+static const size_t MESSAGE_SIZE = 64;
+
+static void echo(int fd)
+{
+    char buf[MESSAGE_SIZE * 4];
+    while(true) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if(n <= 0) {
+            break;
+        }
+        if(write(fd, buf, n) != n) {
+            break;
+        }
+    }
+    close(fd);
+}
+
+//建立连接后循环往返直到stop_us，返回往返次数
+static uint64_t client(uint16_t port, uint64_t stop_us)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return 0;
+    }
+    char buf[MESSAGE_SIZE];
+    memset(buf, 'x', sizeof(buf));
+    uint64_t round_trips = 0;
+    while(hxk::GetCurrentUS() < stop_us) {
+        if(write(fd, buf, sizeof(buf)) != (ssize_t)sizeof(buf)) {
+            break;
+        }
+        size_t received = 0;
+        while(received < sizeof(buf)) {
+            ssize_t n = read(fd, buf + received, sizeof(buf) - received);
+            if(n <= 0) {
+                close(fd);
+                return round_trips;
+            }
+            received += n;
+        }
+        ++round_trips;
+    }
+    close(fd);
+    return round_trips;
+}
+
+static double run(size_t shards, size_t connections, uint64_t seconds)
+{
+    hxk::ShardedIOManager server(shards, "echo");
+    int listen_fd = server.call(0, [](){
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(fd, (sockaddr*)&addr, sizeof(addr));
+        listen(fd, 1024);
+        return fd;
+    });
+    sockaddr_in local;
+    socklen_t len = sizeof(local);
+    getsockname(listen_fd, (sockaddr*)&local, &len);
+    uint16_t port = ntohs(local.sin_port);
+
+    server.getShard(0)->schedule([&server, listen_fd](){
+        while(true) {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if(fd < 0) {
+                break;  //监听socket被关闭
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            server.assign(fd, [fd](){ echo(fd); });
+        }
+    });
+
+    std::atomic_uint64_t total(0);
+    uint64_t stop_us = hxk::GetCurrentUS() + seconds * 1000000;
+    {
+        hxk::IOManager clients(2, false, "client");
+        for(size_t i = 0; i < connections; i++) {
+            clients.schedule([&total, port, stop_us](){
+                total += client(port, stop_us);
+            });
+        }
+    }
+    //在分片0上关闭，hook的close会取消阻塞在accept上的事件
+    server.call(0, [listen_fd](){ close(listen_fd); });
+    server.stop();
+    return total / (double)seconds;
+}
+
+int main(int argc, char** argv)
+{
+    size_t max_shards = argc > 1 ? atoi(argv[1]) : 4;
+    size_t connections = argc > 2 ? atoi(argv[2]) : 64;
+    uint64_t seconds = argc > 3 ? atoi(argv[3]) : 2;
+    std::string backend = argc > 4 ? argv[4] : "epoll";
+    GET_LOGGER("system")->setLevel(hxk::LogLevel::WARN);
+    hxk::Config::lookUp<std::string>("iomanager.backend")->setValue(backend);
+
+    double base = 0;
+    for(size_t shards = 1; shards <= max_shards; shards++) {
+        double rate = run(shards, connections, seconds);
+        if(shards == 1) {
+            base = rate;
+        }
+        std::cout << backend << ", " << shards << " shards, " << connections << " connections: "
+                  << (uint64_t)rate << " round trips/s, speedup " << (base ? rate / base : 0) << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include "config.h"
+#include "log.h"
+#include "io_manager.h"
+
+#include <arpa/inet.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+    事件循环批量大小和每轮预算测试
+        ./bench_loop [连接数，默认1000] [每轮秒数，默认2]
+    单线程IOManager上同时运行大量请求/响应连接和一个1ms的循环定时器，
+    分别测试固定64的批量且不限预算、自适应批量且不限预算、自适应批量加默认预算，
+    输出每秒往返次数、每轮分发的事件数和耗时，以及定时器的最大延迟
+*/
+
+static const size_t MESSAGE_SIZE = 64;
+
+static void run(const char* name, uint64_t max_events, uint64_t budget, size_t connections, uint64_t seconds)
+{
+    hxk::Config::lookUp<uint64_t>("iomanager.max_events")->setValue(max_events);
+    hxk::Config::lookUp<uint64_t>("iomanager.loop_budget")->setValue(budget);
+    std::atomic_uint64_t total(0);
+    uint64_t max_lag_us = 0;
+    std::atomic_bool measuring(false);  //建立连接期间不统计定时器延迟
+    hxk::IOManager::LoopStats stats;
+    {
+        hxk::IOManager iom(1, false, "bench");
+        uint64_t last_us = hxk::GetCurrentUS();
+        auto timer = iom.addTimer(1, [&last_us, &max_lag_us, &measuring](){
+            uint64_t now_us = hxk::GetCurrentUS();
+            if(measuring && now_us - last_us > 1000) {
+                max_lag_us = std::max(max_lag_us, now_us - last_us - 1000);
+            }
+            last_us = now_us;
+        }, true);
+        iom.schedule([&total, &measuring, connections, seconds, timer](){
+            int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            bind(listen_fd, (sockaddr*)&addr, sizeof(addr));
+            listen(listen_fd, 4096);
+            socklen_t len = sizeof(addr);
+            getsockname(listen_fd, (sockaddr*)&addr, &len);
+
+            uint64_t stop_us = hxk::GetCurrentUS() + seconds * 1000000;
+            for(size_t i = 0; i < connections; i++) {
+                int client = socket(AF_INET, SOCK_STREAM, 0);
+                connect(client, (sockaddr*)&addr, sizeof(addr));
+                int server = accept(listen_fd, nullptr, nullptr);
+                int one = 1;
+                setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                hxk::IOManager::getThis()->schedule([server](){
+                    char buf[MESSAGE_SIZE];
+                    ssize_t n;
+                    while((n = read(server, buf, sizeof(buf))) > 0) {
+                        if(write(server, buf, n) != n) {
+                            break;
+                        }
+                    }
+                    close(server);
+                });
+                hxk::IOManager::getThis()->schedule([client, stop_us, &total](){
+                    char buf[MESSAGE_SIZE];
+                    memset(buf, 'x', sizeof(buf));
+                    uint64_t round_trips = 0;
+                    while(hxk::GetCurrentUS() < stop_us) {
+                        if(write(client, buf, sizeof(buf)) != (ssize_t)sizeof(buf)
+                           || read(client, buf, sizeof(buf)) != (ssize_t)sizeof(buf)) {
+                            break;
+                        }
+                        ++round_trips;
+                    }
+                    total += round_trips;
+                    close(client);
+                });
+            }
+            close(listen_fd);
+            measuring = true;
+            hxk::IOManager::getThis()->addTimer(seconds * 1000, [timer, &measuring](){
+                measuring = false;
+                timer->cancel();
+            });
+        });
+        iom.stop();
+        stats = iom.getLoopStats();
+    }
+    std::cout << name << ": " << (uint64_t)(total / (double)seconds) << " round trips/s, "
+              << stats.eventsPerIteration() << " events/iter, "
+              << stats.usPerIteration() << " us/iter, "
+              << stats.m_deferred << " deferred, max batch " << stats.m_max_batch
+              << ", timer max lag " << max_lag_us << " us" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    size_t connections = argc > 1 ? atoi(argv[1]) : 1000;
+    uint64_t seconds = argc > 2 ? atoi(argv[2]) : 2;
+    GET_LOGGER("system")->setLevel(hxk::LogLevel::WARN);
+
+    run("fixed 64, no budget    ", 64, UINT32_MAX, connections, seconds);
+    run("adaptive, no budget    ", 1024, UINT32_MAX, connections, seconds);
+    run("adaptive, budget 256   ", 1024, 256, connections, seconds);
+    return 0;
+}
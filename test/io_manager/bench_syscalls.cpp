@@ -0,0 +1,99 @@
+#include "config.h"
+#include "log.h"
+#include "io_manager.h"
+
+#include <arpa/inet.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+    epoll持久注册的系统调用次数测试
+        ./bench_syscalls [连接数，默认16] [每轮秒数，默认2]
+    在同一个单线程IOManager上运行若干对请求/响应连接，分别关闭和开启iomanager.persistent，
+    输出每秒往返次数以及每次往返的epoll_ctl和epoll_wait调用次数
+*/
+
+static const size_t MESSAGE_SIZE = 64;
+
+static void setNoDelay(int fd)
+{
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static void run(bool persistent, size_t connections, uint64_t seconds)
+{
+    hxk::Config::lookUp<bool>("iomanager.persistent")->setValue(persistent);
+    std::atomic_uint64_t total(0);
+    uint64_t ctl = 0, wait = 0;
+    {
+        hxk::IOManager iom(1, false, "bench");
+        iom.schedule([&total, connections, seconds](){
+            int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            bind(listen_fd, (sockaddr*)&addr, sizeof(addr));
+            listen(listen_fd, 1024);
+            socklen_t len = sizeof(addr);
+            getsockname(listen_fd, (sockaddr*)&addr, &len);
+
+            uint64_t stop_us = hxk::GetCurrentUS() + seconds * 1000000;
+            for(size_t i = 0; i < connections; i++) {
+                int client = socket(AF_INET, SOCK_STREAM, 0);
+                connect(client, (sockaddr*)&addr, sizeof(addr));
+                int server = accept(listen_fd, nullptr, nullptr);
+                setNoDelay(client);
+                setNoDelay(server);
+                hxk::IOManager::getThis()->schedule([server](){
+                    char buf[MESSAGE_SIZE];
+                    ssize_t n;
+                    while((n = read(server, buf, sizeof(buf))) > 0) {
+                        if(write(server, buf, n) != n) {
+                            break;
+                        }
+                    }
+                    close(server);
+                });
+                hxk::IOManager::getThis()->schedule([client, stop_us, &total](){
+                    char buf[MESSAGE_SIZE];
+                    memset(buf, 'x', sizeof(buf));
+                    uint64_t round_trips = 0;
+                    while(hxk::GetCurrentUS() < stop_us) {
+                        if(write(client, buf, sizeof(buf)) != (ssize_t)sizeof(buf)
+                           || read(client, buf, sizeof(buf)) != (ssize_t)sizeof(buf)) {
+                            break;
+                        }
+                        ++round_trips;
+                    }
+                    total += round_trips;
+                    close(client);
+                });
+            }
+            close(listen_fd);
+        });
+        iom.stop();
+        ctl = iom.getEpollCtlCount();
+        wait = iom.getEpollWaitCount();
+    }
+    double rt = total ? (double)total : 1;
+    std::cout << (persistent ? "persistent" : "one-shot  ") << ": "
+              << (uint64_t)(total / (double)seconds) << " round trips/s, "
+              << ctl / rt << " epoll_ctl/rt, " << wait / rt << " epoll_wait/rt" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    size_t connections = argc > 1 ? atoi(argv[1]) : 16;
+    uint64_t seconds = argc > 2 ? atoi(argv[2]) : 2;
+    GET_LOGGER("system")->setLevel(hxk::LogLevel::WARN);
+
+    run(false, connections, seconds);
+    run(true, connections, seconds);
+    return 0;
+}
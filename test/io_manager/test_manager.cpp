@@ -1,5 +1,6 @@
 #include "io_manager.h"
 #include "log.h"
+#include "config.h"
 #include <arpa/inet.h>
 #include <cstring>
 #include <fcntl.h>
@@ -67,10 +68,57 @@ void TEST_timer()
     }, true);
 }
 
+//每线程epoll模式下迁移fd：挂起的读在迁移后仍能被唤醒；没有线程的槽位拒绝迁移，fd保持原来的绑定
+void TEST_migrate()
+{
+    hxk::Config::lookUp<bool>("iomanager.per_thread_epoll", false)->setValue(true);
+    static std::atomic_int client(-1);
+    static std::atomic_int server(-1);
+    static std::atomic_bool read_done(false);
+    {
+        hxk::IOManager io_manager(2, false, "migrate", 4);     //槽位2、3没有线程
+        io_manager.schedule([](){
+            int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr;
+            bzero(&addr, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            bind(listen_fd, (sockaddr*)&addr, sizeof(addr));
+            listen(listen_fd, 1);
+            socklen_t len = sizeof(addr);
+            getsockname(listen_fd, (sockaddr*)&addr, &len);
+            client = socket(AF_INET, SOCK_STREAM, 0);
+            connect(client, (sockaddr*)&addr, sizeof(addr));
+            int fd = accept(listen_fd, nullptr, nullptr);
+            close(listen_fd);
+            server = fd;
+            char c;
+            read_done = read(fd, &c, 1) == 1;   //挂起，等待迁移之后的写入
+        });
+        while(server < 0 || io_manager.getFdOwner(server) < 0) {
+            usleep(1000);
+        }
+        usleep(50000);
+        int owner = io_manager.getFdOwner(server);
+        bool retired_rejected = !io_manager.migrate(server, 3) && io_manager.getFdOwner(server) == owner;
+        int target = 1 - owner;
+        bool migrated = io_manager.migrate(server, target) && io_manager.getFdOwner(server) == target;
+        write(client, "x", 1);
+        for(int i = 0; i < 2000 && !read_done; i++) {
+            usleep(1000);
+        }
+        LOG_FORMAT_INFO(g_logger, "migrate from %d: retired slot rejected = %d, migrated to %d = %d, read resumed = %d",
+                        owner, retired_rejected, target, migrated, read_done.load());
+        close(client);
+        close(server);
+    }
+    hxk::Config::lookUp<bool>("iomanager.per_thread_epoll", false)->setValue(false);
+}
 
 int main()
 {
     // TEST_CreateIOManager();
+    TEST_migrate();
     TEST_timer();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include "log.h"
+#include "scheduler.h"
+#include "parallel.h"
+
+#include <iostream>
+#include <vector>
+
+/*
+    parallel_for / parallel_reduce 的扩展性测试
+        ./bench_parallel [最大线程数，默认8] [数据大小MB，默认64]
+    对同一块数据分别用1..N个线程计算分块校验和（parallel_reduce）和逐字节变换（parallel_for），
+    输出耗时和相对单线程的加速比，并与串行结果比较
+*/
+
+static const size_t GRAIN = 64 * 1024;
+
+static uint64_t checksum(const uint8_t* data, size_t begin, size_t end)
+{
+    //FNV-1a，每块独立计算，块之间再组合
+    uint64_t hash = 14695981039346656037ull;
+    for(size_t i = begin; i < end; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint64_t combine(uint64_t a, uint64_t b)
+{
+    return a * 31 + b;
+}
+
+int main(int argc, char** argv)
+{
+    size_t max_threads = argc > 1 ? atoi(argv[1]) : 8;
+    size_t size = (argc > 2 ? atol(argv[2]) : 64) * 1024 * 1024;
+    GET_LOGGER("system")->setLevel(hxk::LogLevel::INFO);
+
+    std::vector<uint8_t> data(size);
+    for(size_t i = 0; i < size; i++) {
+        data[i] = (uint8_t)(i * 2654435761u >> 24);
+    }
+    uint64_t expect = 0;
+    for(size_t begin = 0; begin < size; begin += GRAIN) {
+        expect = combine(expect, checksum(data.data(), begin, std::min(begin + GRAIN, size)));
+    }
+
+    std::vector<uint8_t> output(size);
+    double base_ms = 0;
+    for(size_t threads = 1; threads <= max_threads; threads++) {
+        hxk::Scheduler sc(threads, false, "parallel");
+        sc.start();
+
+        uint64_t result = 0;
+        uint64_t begin_us = hxk::GetCurrentUS();
+        //在调度器的协程中发起，等待时挂起协程，调度线程同样参与计算
+        hxk::FiberSemaphore finished(0);
+        sc.schedule([&](){
+            result = hxk::parallel_reduce<uint64_t>(0, size, GRAIN, 0,
+                [&](size_t begin, size_t end){ return checksum(data.data(), begin, end); }, &combine);
+            hxk::parallel_for(0, size, GRAIN, [&](size_t begin, size_t end){
+                for(size_t i = begin; i < end; i++) {
+                    output[i] = data[i] ^ 0x5a;
+                }
+            });
+            finished.notify();
+        });
+        finished.wait();
+        double used_ms = (hxk::GetCurrentUS() - begin_us) / 1000.0;
+        sc.stop();
+
+        if(threads == 1) {
+            base_ms = used_ms;
+        }
+        bool ok = result == expect && output[size / 2] == (data[size / 2] ^ 0x5a);
+        std::cout << threads << " threads: " << used_ms << " ms, speedup " << base_ms / used_ms
+                  << (ok ? "" : ", RESULT MISMATCH") << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include "log.h"
+#include "scheduler.h"
+
+#include <iostream>
+
+/*
+    调度器吞吐测试：任务在执行时不断提交新任务（类似请求处理中派生子任务）
+        ./bench_scheduler [线程数，默认8] [任务数，默认2000000]
+    统计每秒完成的任务数，以及本地队列之间的窃取次数
+*/
+
+static std::atomic_long s_remain(0);
+
+static void spawn(hxk::Scheduler* sc, int depth)
+{
+    //每个任务派生两个子任务，形成一棵二叉树
+    if(depth > 0) {
+        sc->schedule(std::bind(&spawn, sc, depth - 1));
+        sc->schedule(std::bind(&spawn, sc, depth - 1));
+    }
+    --s_remain;
+}
+
+int main(int argc, char** argv)
+{
+    size_t threads = argc > 1 ? atoi(argv[1]) : 8;
+    long tasks = argc > 2 ? atol(argv[2]) : 2000000;
+    GET_LOGGER("system")->setLevel(hxk::LogLevel::INFO);
+
+    //每棵树 2^(depth+1)-1 个任务，由外部线程提交树根
+    const int depth = 10;
+    long per_tree = (1l << (depth + 1)) - 1;
+    long trees = tasks / per_tree;
+    s_remain = trees * per_tree;
+
+    hxk::Scheduler sc(threads, false, "bench");
+    sc.start();
+    uint64_t begin = hxk::GetCurrentUS();
+    for(long i = 0; i < trees; i++) {
+        sc.schedule(std::bind(&spawn, &sc, depth));
+    }
+    while(s_remain > 0) {
+        usleep(1000);
+    }
+    uint64_t used = hxk::GetCurrentUS() - begin;
+    sc.stop();
+
+    std::cout << threads << " threads, " << trees * per_tree << " tasks in " << used / 1000 << " ms, "
+              << (long)(trees * per_tree * 1000000.0 / used) << " tasks/s" << std::endl;
+    std::cout << "steal count = " << sc.getStealCount() << std::endl;
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include "log.h"
+#include "scheduler.h"
+
+#include <iostream>
+#include <stdlib.h>
+
+/*
+    统计调度一个任务平均需要的内存分配次数
+        ./bench_task_alloc [任务数，默认100000]
+    外部线程提交：任务进入全局队列，Task节点在调度线程释放，提交线程每次都要新分配
+    调度线程提交：64条任务链，每个任务执行时提交链上的下一个任务，Task节点来自线程本地的空闲链表
+    大捕获：lambda超过unique_function的内联大小，需要为回调分配一次内存
+    std::function：回调先被包装为std::function再提交
+*/
+
+static std::atomic_uint64_t s_alloc_count(0);
+
+void* operator new(size_t size)
+{
+    ++s_alloc_count;
+    void* ptr = malloc(size ? size : 1);
+    if(!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+static std::atomic_long s_done(0);
+static const long CHAIN_COUNT = 64;
+
+static void wait_done(long count)
+{
+    while(s_done < count) {
+        sched_yield();
+    }
+    s_done = 0;
+}
+
+//submit提交任务并返回任务总数
+template<class Submit>
+static void run_case(const char* name, long count, Submit submit)
+{
+    wait_done(submit(count / 10));  //预热，填充协程缓存和Task空闲链表
+    uint64_t begin = s_alloc_count;
+    uint64_t begin_us = hxk::GetCurrentUS();
+    long total = submit(count);
+    wait_done(total);
+    uint64_t allocs = s_alloc_count - begin;
+    uint64_t used = hxk::GetCurrentUS() - begin_us;
+    std::cout << name << (double)allocs / total << " allocs/task, "
+              << (long)(total * 1000000.0 / used) << " tasks/s" << std::endl;
+}
+
+//每条任务链同一时间只有一个任务在队列中，执行时提交链上的下一个任务
+template<class Next>
+static long submit_chains(hxk::Scheduler& sc, long count, Next next)
+{
+    long length = count / CHAIN_COUNT;
+    for(long i = 0; i < CHAIN_COUNT; i++) {
+        sc.schedule([&sc, length, next](){
+            next(sc, length, next);
+        });
+    }
+    return length * CHAIN_COUNT;
+}
+
+struct SmallNext
+{
+    void operator()(hxk::Scheduler& sc, long remain, SmallNext self) const
+    {
+        ++s_done;
+        if(remain > 1) {
+            hxk::Scheduler* psc = &sc;
+            sc.schedule([psc, remain, self](){ self(*psc, remain - 1, self); });
+        }
+    }
+};
+
+struct BigNext
+{
+    void operator()(hxk::Scheduler& sc, long remain, BigNext self) const
+    {
+        ++s_done;
+        if(remain > 1) {
+            hxk::Scheduler* psc = &sc;
+            char payload[128] = {0};
+            sc.schedule([psc, remain, self, payload](){ self(*psc, remain - 1 + payload[0], self); });
+        }
+    }
+};
+
+struct FunctionNext
+{
+    void operator()(hxk::Scheduler& sc, long remain, FunctionNext self) const
+    {
+        ++s_done;
+        if(remain > 1) {
+            hxk::Scheduler* psc = &sc;
+            std::function<void()> fn = [psc, remain, self](){ self(*psc, remain - 1, self); };
+            sc.schedule(std::move(fn));
+        }
+    }
+};
+
+int main(int argc, char** argv)
+{
+    long count = argc > 1 ? atol(argv[1]) : 100000;
+    GET_LOGGER("system")->setLevel(hxk::LogLevel::INFO);
+    hxk::Scheduler sc(1, false, "alloc");
+    sc.start();
+
+    run_case("external submit:      ", count, [&](long n){
+        for(long i = 0; i < n; i++) {
+            sc.schedule([](){ ++s_done; });
+        }
+        return n;
+    });
+    run_case("worker submit:        ", count, [&](long n){
+        return submit_chains(sc, n, SmallNext());
+    });
+    run_case("worker submit big:    ", count, [&](long n){
+        return submit_chains(sc, n, BigNext());
+    });
+    run_case("worker std::function: ", count, [&](long n){
+        return submit_chains(sc, n, FunctionNext());
+    });
+    sc.stop();
+    return 0;
+}
@@ -1,6 +1,9 @@
 #include "log.h"
 
 #include "scheduler.h"
+#include "parallel.h"
+
+#include <algorithm>
 
 void fun1()
 {
@@ -18,6 +21,174 @@ void fun2()
     }
 }
 
+//打印直方图中被采样的任务数和中位数所在的桶
+void print_wait_histogram(hxk::Scheduler& sc, hxk::TaskPriority priority, const char* name)
+{
+    std::vector<uint64_t> histogram = sc.getQueueWaitHistogram(priority);
+    uint64_t total = 0, count = 0;
+    for(auto n : histogram) {
+        total += n;
+    }
+    size_t median = 0;
+    for(; median < histogram.size(); median++) {
+        count += histogram[median];
+        if(count * 2 >= total) {
+            break;
+        }
+    }
+    std::cout << name << " sampled tasks = " << total << ", median wait < " << (1ul << median) << "us" << std::endl;
+}
+
+//单线程调度器被阻塞期间放入后台和高优先级任务，高优先级先执行，后台任务仍能分到执行机会
+void test_priority()
+{
+    hxk::Scheduler sc(1, false, "priority");
+    sc.start();
+    static std::atomic_bool release(false);
+    std::vector<hxk::TaskPriority> order;
+    sc.schedule([](){
+        while(!release) {
+            sched_yield();
+        }
+    });
+    for(int i = 0; i < 200; i++) {
+        sc.schedule([&order](){ order.push_back(hxk::PRIORITY_BACKGROUND); }, -1, hxk::PRIORITY_BACKGROUND);
+    }
+    for(int i = 0; i < 200; i++) {
+        sc.schedule([&order](){ order.push_back(hxk::PRIORITY_HIGH); }, -1, hxk::PRIORITY_HIGH);
+    }
+    release = true;
+    sc.stop();
+
+    size_t last_high = 0, background_before = 0;
+    for(size_t i = 0; i < order.size(); i++) {
+        if(order[i] == hxk::PRIORITY_HIGH) {
+            last_high = i;
+        }
+    }
+    for(size_t i = 0; i < last_high; i++) {
+        if(order[i] == hxk::PRIORITY_BACKGROUND) {
+            ++background_before;
+        }
+    }
+    std::cout << "last high task at " << last_high << " of " << order.size()
+              << ", background tasks before it = " << background_before << std::endl;
+    print_wait_histogram(sc, hxk::PRIORITY_HIGH, "high");
+    print_wait_histogram(sc, hxk::PRIORITY_NORMAL, "normal");
+    print_wait_histogram(sc, hxk::PRIORITY_BACKGROUND, "background");
+}
+
+//缩容时，绑定到退出线程的任务转给其他线程执行，不会丢失
+void test_elastic()
+{
+    hxk::Scheduler sc(1, false, "elastic", 4);
+    sc.start();
+    sc.resize(4);
+    std::cout << "elastic threads = " << sc.getThreadCount() << std::endl;
+
+    static std::atomic_bool release(false);
+    static std::atomic_int executed(0);
+    std::vector<long> ids = sc.getThreadIds();
+    for(int i = 0; i < 400; i++) {
+        sc.schedule([](){
+            while(!release) {
+                sched_yield();
+            }
+            ++executed;
+        }, ids[i % ids.size()]);
+    }
+    sc.resize(1);
+    release = true;
+    while(executed < 400) {
+        usleep(1000);
+    }
+    usleep(10000);
+    std::cout << "elastic executed = " << executed << ", threads = " << sc.getThreadCount()
+              << ", ids = " << sc.getThreadIds().size() << std::endl;
+    sc.stop();
+}
+
+//长时间计算的协程在让出点被看门狗打断，同一线程上的其他任务不会一直等待
+void test_preempt()
+{
+    hxk::Config::lookUp<uint64_t>("scheduler.time_slice_ms", 0)->setValue(10);
+    hxk::Scheduler sc(1, false, "preempt");
+    sc.start();
+    static std::atomic_uint64_t short_task_us(0);
+    uint64_t begin = hxk::GetCurrentUS();
+    sc.schedule([](){
+        uint64_t start = hxk::GetCurrentMS();
+        while(hxk::GetCurrentMS() - start < 200) {
+            hxk::maybeYield();
+        }
+    });
+    sc.schedule([begin](){
+        short_task_us = hxk::GetCurrentUS() - begin;
+    });
+    sc.stop();
+    hxk::Config::lookUp<uint64_t>("scheduler.time_slice_ms", 0)->setValue(0);
+    std::cout << "short task waited " << short_task_us / 1000 << " ms behind a 200 ms hog, preempt count = "
+              << sc.getPreemptCount() << std::endl;
+}
+
+//TaskGroup在普通线程中等待时阻塞线程，任务中的parallel_for在协程中等待时挂起协程
+void test_task_group()
+{
+    hxk::Scheduler sc(2, false, "group");
+    sc.start();
+    static std::atomic_long sum(0);
+    hxk::TaskGroup group(&sc);
+    for(int i = 0; i < 8; i++) {
+        group.run([](){
+            hxk::parallel_for(0, 1000, 16, [](size_t begin, size_t end){
+                for(size_t j = begin; j < end; j++) {
+                    sum += j;
+                }
+            });
+        });
+    }
+    group.run([](){ throw std::runtime_error("task failed"); });
+    std::string error;
+    try {
+        group.wait();
+    }
+    catch(const std::exception& e) {
+        error = e.what();
+    }
+    sc.stop();
+    std::cout << "task group sum = " << sum << ", expect = " << 8 * 999 * 1000 / 2
+              << ", error = " << error << std::endl;
+}
+
+//截止时间调度：任务按截止时间执行，已经过期的函数任务被丢弃
+void test_deadline()
+{
+    hxk::Scheduler sc(1, false, "deadline");
+    sc.setDeadlineMode(true);
+    sc.start();
+    static std::atomic_bool release(false);
+    std::vector<int> order;
+    sc.schedule([](){
+        while(!release) {
+            sched_yield();
+        }
+    });
+    uint64_t now = hxk::GetCurrentUS();
+    //逆序提交，截止时间越早的越晚提交
+    for(int i = 9; i >= 0; i--) {
+        sc.scheduleWithDeadline([&order, i](){ order.push_back(i); }, now + 1000000 + i * 1000);
+    }
+    for(int i = 0; i < 5; i++) {
+        sc.scheduleWithDeadline([&order](){ order.push_back(-1); }, now - 1000000);
+    }
+    release = true;
+    sc.stop();
+
+    bool sorted = std::is_sorted(order.begin(), order.end());
+    std::cout << "deadline order sorted = " << sorted << ", executed = " << order.size()
+              << ", dropped = " << sc.getDroppedCount() << ", late = " << sc.getLateCount() << std::endl;
+}
+
 int main()
 {
     hxk::Scheduler sc(2, true, "test");
@@ -29,5 +200,41 @@ int main()
             std::cout << ">>>>" <<std::endl;
         });
     }
+    for(i=0;i<100;i++){
+        sc.schedule([](){});
+    }
+    //调度线程内部提交的任务进入本地队列，空闲线程从中窃取
+    sc.schedule([&sc](){
+        for(int j = 0; j < 1000; j++) {
+            sc.schedule([](){});
+        }
+    });
+    //绑定线程的任务进入目标线程的mailbox，只能由该线程执行
+    static std::atomic_long target(0);
+    static std::atomic_int mismatch(0);
+    sc.schedule([](){
+        target = hxk::GetThreadID();
+    });
+    while(target == 0) {
+        usleep(1000);
+    }
+    for(i=0;i<100;i++){
+        sc.schedule([](){
+            if(hxk::GetThreadID() != target) {
+                ++mismatch;
+            }
+        }, target);
+    }
     sc.stop();
+    std::cout << "pinned task mismatch = " << mismatch << std::endl;
+    std::cout << "global queue = " << sc.getGlobalQueueDepth()
+              << ", steal count = " << sc.getStealCount() << std::endl;
+    std::cout << "fiber cache hit = " << sc.getFiberCacheHits()
+              << ", miss = " << sc.getFiberCacheMisses() << std::endl;
+
+    test_priority();
+    test_elastic();
+    test_preempt();
+    test_task_group();
+    test_deadline();
 }
\ No newline at end of file
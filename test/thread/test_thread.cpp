@@ -1,6 +1,7 @@
 #include "thread.h"
 #include "log.h"
 #include "lock.h"
+#include "cpu_topology.h"
 
 auto logger  = GET_ROOT_LOGGER();
 
@@ -61,10 +62,36 @@ void Test_RWLock()
     LOG_FORMAT_DEBUG(logger, "count = %ld", count);
 }
 
+void Test_threadAttr()
+{
+    auto topology = hxk::CpuTopology::GetInstance();
+    LOG_FORMAT_DEBUG(logger, "cpus = %lu, numa nodes = %lu", topology->getCpuCount(), topology->getNodeCount());
+
+    hxk::ThreadAttr attr;
+    attr.m_cpus.push_back(topology->getCompactOrder().back());
+    attr.m_stack_size = 256 * 1024;
+    attr.m_policy = SCHED_FIFO;     //没有权限时退回默认策略
+    attr.m_priority = 1;
+    hxk::Thread thread([&attr](){
+        cpu_set_t cpu_set;
+        pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+        size_t stack_size = 0;
+        pthread_attr_t pattr;
+        pthread_getattr_np(pthread_self(), &pattr);
+        pthread_attr_getstacksize(&pattr, &stack_size);
+        pthread_attr_destroy(&pattr);
+        LOG_FORMAT_DEBUG(logger, "pinned = %d, cpu count = %d, node = %d, stack size = %lu",
+                         CPU_ISSET(attr.m_cpus[0], &cpu_set), CPU_COUNT(&cpu_set),
+                         hxk::Thread::getThisNode(), stack_size);
+    }, "attr_thread", attr);
+    thread.join();
+}
+
 int main()
 {
     //Test_createThreadJoin();
     //Test_createThreadDetach();
     Test_RWLock();
+    Test_threadAttr();
     return 0;
 }
\ No newline at end of file